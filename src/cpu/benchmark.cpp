@@ -0,0 +1,194 @@
+#include "benchmark.h"
+#include "helper.h"
+#include "model.h"
+#include "onnx.h"
+#include "optimizer.h"
+#include "utilities/sha256.h"
+#include "utilities/time.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+std::string describeLayer(const cpu::LayerDesc& layer) {
+    constexpr const char* activations[] = {"None", "Relu", "LeakyRelu", "Sigmoid", "Clip"};
+    if (layer.type == cpu::LayerType::Activation)
+        return activations[static_cast<int>(layer.activation)];
+    if (layer.type == cpu::LayerType::SqueezeExcitation)
+        return "SqueezeExcitation " + std::to_string(layer.inChannels) + "->" + std::to_string(layer.outChannels);
+
+    auto description = layer.type == cpu::LayerType::Add
+        ? "Add " + std::to_string(layer.outChannels) + " " + std::to_string(layer.outWidth) + "x" + std::to_string(layer.outHeight)
+        : "Conv " + std::to_string(layer.kernelH) + "x" + std::to_string(layer.kernelW)
+            + " " + std::to_string(layer.inChannels) + "->" + std::to_string(layer.outChannels)
+            + " " + std::to_string(layer.outWidth) + "x" + std::to_string(layer.outHeight);
+    if (layer.scaleTensor >= 0 || layer.scale2Tensor >= 0)
+        description += " (scaled)";
+    if (layer.activation != cpu::Activation::None)
+        description += std::string(" + ") + activations[static_cast<int>(layer.activation)];
+    if (layer.type == cpu::LayerType::Conv && layer.poolTensor >= 0)
+        description += " + Pool";
+    if (layer.kernel == cpu::KernelType::Jit) {
+        description += " [" + std::to_string(layer.jitBlocks) + "x" + std::to_string(layer.jitPixels);
+        if (layer.jitTailBlocks)
+            description += " + " + std::to_string(layer.jitTailBlocks) + "x" + std::to_string(layer.jitTailPixels);
+        description += "]";
+    }
+    return description;
+}
+
+void fillInput(cpu::Model& model) {
+    const auto& header = model.getHeader();
+    const auto& tensor = model.getTensor(header.inputTensor);
+    for (int b = 0; b < header.batchSize; ++b) {
+        auto* data = model.getTensorData(header.inputTensor, b);
+        const auto count = tensor.size / sizeof(float);
+        for (size_t i = 0; i < count; ++i) {
+            const auto channel = i / (static_cast<size_t>(tensor.height) * tensor.width * cpu::blockSize)
+                * cpu::blockSize + i % cpu::blockSize;
+            data[i] = channel < tensor.channels ? static_cast<float>((i * 7919 + b * 104729) % 256) / 255.0f : 0.0f;
+        }
+    }
+}
+
+std::vector<float> readOutput(cpu::Model& model) {
+    const auto& header = model.getHeader();
+    const auto& tensor = model.getTensor(header.outputTensor);
+    std::vector<float> output;
+    for (int b = 0; b < header.batchSize; ++b) {
+        const auto* data = model.getTensorData(header.outputTensor, b);
+        output.insert(output.end(), data, data + tensor.size / sizeof(float));
+    }
+    return output;
+}
+
+const char* cpu::getKernelName(KernelType kernel) {
+    switch (kernel) {
+        case KernelType::Generic:
+            return "generic";
+        case KernelType::Avx2:
+            return "avx2";
+        case KernelType::Jit:
+            return "jit";
+    }
+    return "unknown";
+}
+
+cpu::BenchmarkResult cpu::benchmarkKernels(const std::string& path, const BuildConfig& config, int threads, int iterations,
+    bool counters) {
+    if (iterations < 1)
+        throw std::runtime_error("benchmark needs at least one iteration");
+
+    auto graph = parseOnnx(path);
+    optimizeGraph(graph, {config.batchSize, config.channels, config.height, config.width});
+    const auto cpuFeatures = cpuGetFeatures();
+    const auto modelPath = (std::filesystem::temp_directory_path()
+        / ("waifu2x_benchmark_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())
+        + ".cpu")).string();
+    utils::ThreadPool pool(threads);
+    utils::PerfCounters perfCounters;
+    if (counters) {
+        std::atomic<bool> opened = true;
+        pool.runOnEachThread([&] {
+            if (!perfCounters.addThread())
+                opened = false;
+        });
+        if (!opened)
+            throw std::runtime_error("hardware counters are not available, perf_event_open failed");
+    }
+
+    BenchmarkResult result;
+    std::vector<float> reference;
+    for (const auto kernel : {KernelType::Generic, KernelType::Avx2, KernelType::Jit}) {
+        if ((getKernelFeatures(kernel) & cpuFeatures) != getKernelFeatures(kernel))
+            continue;
+
+        {
+            const auto image = Model::compile(graph, config, kernel);
+            std::ofstream file(modelPath, std::ios::binary);
+            file.write(image.data(), static_cast<long long>(image.size()));
+            if (!file)
+                throw std::runtime_error("could not write " + modelPath);
+        }
+        Model model;
+        model.load(modelPath);
+        std::filesystem::remove(modelPath);
+
+        const auto layerCount = static_cast<int>(model.getHeader().layerCount);
+        result.layers.clear();
+        for (int i = 0; i < layerCount; ++i)
+            result.layers.push_back(describeLayer(model.getLayer(i)));
+
+        // One untimed run warms up caches and the thread pool
+        KernelBenchmark benchmark;
+        benchmark.kernel = kernel;
+        benchmark.layerMilliseconds.assign(layerCount, 0.0);
+        if (counters)
+            benchmark.layerCounters.assign(layerCount, utils::CounterSample());
+        fillInput(model);
+        model.run(pool);
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            fillInput(model);
+            auto& iterationMilliseconds = benchmark.iterationMilliseconds.emplace_back(0.0);
+            for (int i = 0; i < layerCount; ++i) {
+                const auto t0 = std::chrono::steady_clock::now();
+                if (counters)
+                    perfCounters.measure(benchmark.layerCounters[i], [&] { model.runLayer(i, pool); });
+                else
+                    model.runLayer(i, pool);
+                const auto t1 = std::chrono::steady_clock::now();
+                benchmark.layerMilliseconds[i] += utils::getElapsedMilliseconds(t0, t1) / iterations;
+                iterationMilliseconds += utils::getElapsedMilliseconds(t0, t1);
+            }
+        }
+        for (const auto milliseconds : benchmark.layerMilliseconds)
+            benchmark.totalMilliseconds += milliseconds;
+
+        const auto output = readOutput(model);
+        if (reference.empty())
+            reference = output;
+        for (size_t i = 0; i < output.size() && i < reference.size(); ++i)
+            benchmark.maxError = std::max(benchmark.maxError, static_cast<double>(std::abs(output[i] - reference[i])));
+        result.kernels.push_back(benchmark);
+
+        const auto& outputTensor = model.getTensor(model.getHeader().outputTensor);
+        result.outputPixels = static_cast<int64_t>(model.getHeader().batchSize) * outputTensor.width * outputTensor.height;
+    }
+    result.peakMemory = utils::getPeakMemory();
+    return result;
+}
+
+std::vector<utils::BenchmarkMetric> cpu::getBenchmarkMetrics(const BenchmarkResult& result) {
+    std::vector<utils::BenchmarkMetric> metrics;
+    for (const auto& kernel : result.kernels) {
+        std::vector<double> megapixelsPerSecond;
+        for (const auto milliseconds : kernel.iterationMilliseconds)
+            megapixelsPerSecond.push_back(static_cast<double>(result.outputPixels) / (milliseconds * 1000.0));
+        metrics.push_back({
+            .name = std::string(getKernelName(kernel.kernel)) + " MPix/s",
+            .samples = megapixelsPerSecond,
+            .percentile = 50.0,
+            .higherIsBetter = true
+        });
+
+        metrics.push_back({
+            .name = std::string(getKernelName(kernel.kernel)) + " p99 latency ms",
+            .samples = kernel.iterationMilliseconds,
+            .percentile = 99.0
+        });
+    }
+    metrics.push_back({
+        .name = "peak memory MiB",
+        .samples = {static_cast<double>(result.peakMemory) / (1 << 20)}
+    });
+    return metrics;
+}
+
+std::string cpu::getHostFingerprint() {
+    return utils::sha256(cpuGetDeviceName() + "|" + cpuGetFeatureString(cpuGetFeatures())
+        + "|" + std::to_string(std::thread::hardware_concurrency())).substr(0, 12);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef WAIFU2X_TENSORRT_CPU_BENCHMARK_H
+#define WAIFU2X_TENSORRT_CPU_BENCHMARK_H
+
+#include "config.h"
+#include "kernels.h"
+#include "utilities/baseline.h"
+#include "utilities/counters.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpu {
+    struct KernelBenchmark {
+        KernelType kernel;
+        std::vector<double> layerMilliseconds; // mean per iteration
+        std::vector<double> iterationMilliseconds;
+        double totalMilliseconds = 0.0;
+        double maxError = 0.0;                 // against the generic kernels
+        std::vector<utils::CounterSample> layerCounters; // summed over the iterations, empty unless counted
+    };
+
+    struct BenchmarkResult {
+        std::vector<std::string> layers;
+        std::vector<KernelBenchmark> kernels;
+        int64_t outputPixels = 0; // of a batch
+        uint64_t peakMemory = 0;  // resident bytes of the process by the end
+    };
+
+    [[nodiscard]] const char* getKernelName(KernelType kernel);
+
+    // Throughput and tail latency of every kernel type, and the peak memory, as tracked against baselines
+    [[nodiscard]] std::vector<utils::BenchmarkMetric> getBenchmarkMetrics(const BenchmarkResult& result);
+
+    // Short hash of the CPU name, its features and its hardware threads. Baselines are only
+    // compared on the host they were recorded on.
+    [[nodiscard]] std::string getHostFingerprint();
+
+    // Compiles the model once per kernel type the host can run and times every layer on the
+    // same input, so generated code can be compared against the intrinsic kernels. With counters,
+    // the hardware counters of every layer tell layers bound by compute from those bound by memory.
+    BenchmarkResult benchmarkKernels(const std::string& path, const BuildConfig& config, int threads, int iterations,
+        bool counters = false);
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_BENCHMARK_H
\ No newline at end of file
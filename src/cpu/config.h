@@ -0,0 +1,30 @@
+#ifndef WAIFU2X_TENSORRT_CPU_CONFIG_H
+#define WAIFU2X_TENSORRT_CPU_CONFIG_H
+
+#include <opencv2/core/types.hpp>
+
+namespace cpu {
+    struct BuildConfig {
+        int batchSize = 1;
+        int channels = 3;
+        int height = 256;
+        int width = 256;
+        int bandHeight = 0; // rows per pass of streamed execution over a whole frame, 0 for tiles
+    };
+
+    struct RenderConfig {
+        int threads = 0; // 0 uses every hardware thread
+        int batchSize = 1;
+        int channels = 3;
+        int height = 256;
+        int width = 256;
+        int scaling = 4;
+        cv::Point2d overlap = cv::Point2d(0.0625, 0.0625);
+        bool tta = false;
+        bool wholeFrame = false; // streams the frame through the model instead of tiling it
+        int warmup = 0;          // synthetic batches run by load, so the first render is not slower
+        bool counters = false;   // hardware counters per pipeline stage, see Img2Img::getStageCounters
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_CONFIG_H
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "cost.h"
+#include "onnx.h"
+#include "optimizer.h"
+#include <algorithm>
+#include <map>
+#include <set>
+
+uint64_t getShapeSize(const cpu::Shape& shape) {
+    uint64_t size = 1;
+    for (const auto dim : shape)
+        size *= static_cast<uint64_t>(dim);
+    return size;
+}
+
+uint64_t getConstantBytes(const cpu::Tensor& tensor) {
+    return static_cast<uint64_t>(tensor.size()) * (tensor.type == cpu::DataType::Float ? sizeof(float) : sizeof(int64_t));
+}
+
+// Multiply-accumulates of the compute ops, zero for data movement and elementwise ops
+uint64_t getNodeMacs(const cpu::Graph& graph, const cpu::Node& node, const std::map<std::string, cpu::Shape>& shapes) {
+    const auto& output = shapes.at(node.outputs[0]);
+    if (node.op == "Conv" || node.op == "ConvTranspose") {
+        const auto* weights = graph.findConstant(node.inputs[1]);
+        if (!weights || weights->dims.size() < 3)
+            return 0;
+        // Weights are [OC][IC / group][k...] for Conv and [IC][OC / group][k...] for ConvTranspose
+        uint64_t kernelSize = 1;
+        for (size_t i = 2; i < weights->dims.size(); ++i)
+            kernelSize *= static_cast<uint64_t>(weights->dims[i]);
+        if (node.op == "Conv")
+            return getShapeSize(output) * static_cast<uint64_t>(weights->dims[1]) * kernelSize;
+        const auto& input = shapes.at(node.inputs[0]);
+        return getShapeSize(input) * static_cast<uint64_t>(weights->dims[1]) * kernelSize;
+    }
+    if (node.op == "SqueezeExcitation") {
+        const auto* w1 = graph.findConstant(node.inputs[1]);
+        const auto batchSize = static_cast<uint64_t>(output[0]);
+        const auto fc = w1 ? 2 * static_cast<uint64_t>(w1->size()) * batchSize : 0;
+        return fc + getShapeSize(output);
+    }
+    return 0;
+}
+
+double cpu::ModelCost::getMacsPerOutputPixel() const {
+    if (outputShape.size() != 4)
+        return 0.0;
+    const auto pixels = static_cast<double>(outputShape[0]) * static_cast<double>(outputShape[2])
+        * static_cast<double>(outputShape[3]);
+    return pixels > 0.0 ? static_cast<double>(macs) / pixels : 0.0;
+}
+
+cpu::ModelCost cpu::estimateCost(const Graph& graph, const Shape& inputShape) {
+    const auto shapes = inferShapes(graph, inputShape);
+
+    ModelCost cost;
+    cost.inputShape = inputShape;
+    cost.outputShape = shapes.at(graph.outputs[0].name);
+
+    // Live range of every activation in node indices, the input is live from the start
+    struct LiveRange {
+        int first;
+        int last;
+        uint64_t bytes;
+    };
+    std::map<std::string, LiveRange> ranges;
+    std::set<std::string> constants;
+    ranges[graph.inputs[0].name] = LiveRange{-1, -1, getShapeSize(inputShape) * sizeof(float)};
+
+    for (int i = 0; i < static_cast<int>(graph.nodes.size()); ++i) {
+        const auto& node = graph.nodes[i];
+        if (node.op == "Constant")
+            continue;
+
+        NodeCost nodeCost;
+        nodeCost.name = node.name;
+        nodeCost.op = node.op;
+        nodeCost.outputShape = shapes.at(node.outputs[0]);
+        nodeCost.macs = getNodeMacs(graph, node, shapes);
+        for (const auto& input : node.inputs) {
+            if (input.empty())
+                continue;
+            if (const auto* constant = graph.findConstant(input)) {
+                nodeCost.weightBytes += getConstantBytes(*constant);
+                if (constants.insert(input).second)
+                    cost.weightBytes += getConstantBytes(*constant);
+                continue;
+            }
+            const auto it = ranges.find(input);
+            if (it == ranges.end())
+                continue;
+            it->second.last = i;
+            nodeCost.activationBytes += it->second.bytes;
+        }
+        for (const auto& output : node.outputs) {
+            if (output.empty() || shapes.find(output) == shapes.end())
+                continue;
+            const auto bytes = getShapeSize(shapes.at(output)) * sizeof(float);
+            ranges[output] = LiveRange{i, i, bytes};
+            nodeCost.activationBytes += bytes;
+        }
+
+        cost.macs += nodeCost.macs;
+        cost.activationBytes += nodeCost.activationBytes;
+        cost.nodes.push_back(std::move(nodeCost));
+    }
+
+    const auto end = static_cast<int>(graph.nodes.size());
+    for (const auto& output : graph.outputs) {
+        const auto it = ranges.find(output.name);
+        if (it != ranges.end())
+            it->second.last = end;
+    }
+    for (int i = -1; i <= end; ++i) {
+        uint64_t live = 0;
+        for (const auto& [name, range] : ranges) {
+            if (range.first <= i && i <= range.last)
+                live += range.bytes;
+        }
+        cost.peakMemory = std::max(cost.peakMemory, live);
+    }
+    return cost;
+}
+
+cpu::ModelCost cpu::estimateCost(const std::string& path, const BuildConfig& config) {
+    const Shape inputShape = {config.batchSize, config.channels, config.height, config.width};
+    auto graph = parseOnnx(path);
+    optimizeGraph(graph, inputShape);
+    return estimateCost(graph, inputShape);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef WAIFU2X_TENSORRT_CPU_COST_H
+#define WAIFU2X_TENSORRT_CPU_COST_H
+
+#include "config.h"
+#include "graph.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpu {
+    struct NodeCost {
+        std::string name;
+        std::string op;
+        Shape outputShape;
+        uint64_t macs = 0;
+        uint64_t activationBytes = 0; // read and written, constants excluded
+        uint64_t weightBytes = 0;     // constant inputs
+    };
+
+    struct ModelCost {
+        Shape inputShape;
+        Shape outputShape;
+        uint64_t macs = 0;
+        uint64_t activationBytes = 0;
+        uint64_t weightBytes = 0; // every constant counted once
+        uint64_t peakMemory = 0;  // largest total size of the activations live at the same time
+        std::vector<NodeCost> nodes;
+
+        [[nodiscard]] double getMacsPerOutputPixel() const;
+    };
+
+    // Walks the graph for one NCHW input shape, i.e. one tile shape and batch size. Convolutions
+    // and SE blocks count multiply-accumulates, other ops only count memory. Activations are
+    // assumed to be float and live from their producer to their last consumer in node order.
+    ModelCost estimateCost(const Graph& graph, const Shape& inputShape);
+
+    // Cost of the graph the CPU backend runs for the configured tile, i.e. after optimizeGraph
+    ModelCost estimateCost(const std::string& path, const BuildConfig& config);
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_COST_H
\ No newline at end of file
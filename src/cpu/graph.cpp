@@ -0,0 +1,303 @@
+#include "graph.h"
+#include <algorithm>
+#include <stdexcept>
+
+int64_t cpu::Tensor::size() const {
+    int64_t size = 1;
+    for (const auto dim : dims)
+        size *= dim;
+    return size;
+}
+
+bool cpu::Node::hasAttribute(const std::string& key) const {
+    return attributes.find(key) != attributes.end();
+}
+
+int64_t cpu::Node::getInt(const std::string& key, int64_t defaultValue) const {
+    const auto it = attributes.find(key);
+    return it == attributes.end() ? defaultValue : it->second.i;
+}
+
+float cpu::Node::getFloat(const std::string& key, float defaultValue) const {
+    const auto it = attributes.find(key);
+    return it == attributes.end() ? defaultValue : it->second.f;
+}
+
+std::vector<int64_t> cpu::Node::getInts(const std::string& key, const std::vector<int64_t>& defaultValue) const {
+    const auto it = attributes.find(key);
+    return it == attributes.end() ? defaultValue : it->second.ints;
+}
+
+const cpu::Tensor* cpu::Graph::findConstant(const std::string& name) const {
+    const auto it = initializers.find(name);
+    if (it != initializers.end())
+        return &it->second;
+
+    for (const auto& node : nodes) {
+        if (node.op == "Constant" && !node.outputs.empty() && node.outputs[0] == name) {
+            const auto attribute = node.attributes.find("value");
+            if (attribute == node.attributes.end())
+                throw std::runtime_error("constant \"" + name + "\" has no tensor value");
+            return &attribute->second.t;
+        }
+    }
+    return nullptr;
+}
+
+const cpu::Shape& getInputShape(const std::map<std::string, cpu::Shape>& shapes,
+    const cpu::Graph& graph, const cpu::Node& node, int index) {
+    if (index >= node.inputs.size())
+        throw std::runtime_error("node \"" + node.name + "\" is missing input " + std::to_string(index));
+    const auto it = shapes.find(node.inputs[index]);
+    if (it != shapes.end())
+        return it->second;
+    const auto* constant = graph.findConstant(node.inputs[index]);
+    if (!constant)
+        throw std::runtime_error("unknown value \"" + node.inputs[index] + "\"");
+    return constant->dims;
+}
+
+int64_t getConvolutionSize(int64_t size, int64_t kernel, int64_t stride, int64_t dilation,
+    int64_t padBegin, int64_t padEnd) {
+    return (size + padBegin + padEnd - dilation * (kernel - 1) - 1) / stride + 1;
+}
+
+int64_t getTransposedConvolutionSize(int64_t size, int64_t kernel, int64_t stride, int64_t dilation,
+    int64_t padBegin, int64_t padEnd, int64_t outputPadding) {
+    return stride * (size - 1) + outputPadding + (kernel - 1) * dilation + 1 - padBegin - padEnd;
+}
+
+std::vector<int64_t> getConstantInts(const cpu::Graph& graph, const cpu::Node& node, int index) {
+    const auto* constant = index < node.inputs.size() && !node.inputs[index].empty()
+        ? graph.findConstant(node.inputs[index]) : nullptr;
+    if (!constant || constant->type != cpu::DataType::Int64)
+        throw std::runtime_error("input " + std::to_string(index) + " of node \"" + node.name
+            + "\" must be an integer constant");
+    return constant->ints;
+}
+
+// Attribute before opset 13, optional constant input after
+std::vector<int64_t> getAxes(const cpu::Graph& graph, const cpu::Node& node, int index, int64_t rank) {
+    auto axes = node.hasAttribute("axes") ? node.getInts("axes", {})
+        : index < node.inputs.size() && !node.inputs[index].empty() ? getConstantInts(graph, node, index)
+        : std::vector<int64_t>{};
+    for (auto& axis : axes) {
+        if (axis < 0)
+            axis += rank;
+        if (axis < 0 || axis >= rank)
+            throw std::runtime_error("axis out of range in node \"" + node.name + "\"");
+    }
+    return axes;
+}
+
+cpu::Shape cpu::broadcastShapes(const Shape& a, const Shape& b) {
+    Shape result(std::max(a.size(), b.size()), 1);
+    for (size_t i = 0; i < result.size(); ++i) {
+        const auto da = i < result.size() - a.size() ? 1 : a[i - (result.size() - a.size())];
+        const auto db = i < result.size() - b.size() ? 1 : b[i - (result.size() - b.size())];
+        if (da != db && da != 1 && db != 1)
+            throw std::runtime_error("shapes cannot be broadcast");
+        result[i] = da == 1 ? db : da;
+    }
+    return result;
+}
+
+cpu::Shape cpu::inferShape(const Graph& graph, const Node& node, const std::map<std::string, Shape>& shapes) {
+    const auto& x = getInputShape(shapes, graph, node, 0);
+    const auto rank = static_cast<int64_t>(x.size());
+    Shape y;
+    if (node.op == "Conv" || node.op == "ConvTranspose") {
+        const auto& w = getInputShape(shapes, graph, node, 1);
+        if (x.size() != 4 || w.size() != 4)
+            throw std::runtime_error("node \"" + node.name + "\" expects 4D input and weights");
+        const auto strides = node.getInts("strides", {1, 1});
+        const auto dilations = node.getInts("dilations", {1, 1});
+        const auto pads = node.getInts("pads", {0, 0, 0, 0});
+        const auto group = node.getInt("group", 1);
+        if (node.op == "Conv") {
+            y = {
+                x[0], w[0],
+                getConvolutionSize(x[2], w[2], strides[0], dilations[0], pads[0], pads[2]),
+                getConvolutionSize(x[3], w[3], strides[1], dilations[1], pads[1], pads[3])
+            };
+        } else {
+            const auto outputPadding = node.getInts("output_padding", {0, 0});
+            y = {
+                x[0], w[1] * group,
+                getTransposedConvolutionSize(x[2], w[2], strides[0], dilations[0], pads[0], pads[2], outputPadding[0]),
+                getTransposedConvolutionSize(x[3], w[3], strides[1], dilations[1], pads[1], pads[3], outputPadding[1])
+            };
+        }
+    } else if (node.op == "Relu" || node.op == "LeakyRelu" || node.op == "Sigmoid" || node.op == "Clip" ||
+        node.op == "Identity" || node.op == "Dropout" || node.op == "Cast" || node.op == "Sqrt" ||
+        node.op == "SqueezeExcitation") {
+        y = x;
+    } else if (node.op == "Add" || node.op == "Sub" || node.op == "Mul" || node.op == "Div") {
+        y = broadcastShapes(x, getInputShape(shapes, graph, node, 1));
+    } else if (node.op == "Expand") {
+        y = broadcastShapes(x, getConstantInts(graph, node, 1));
+    } else if (node.op == "GlobalAveragePool") {
+        y = x;
+        std::fill(y.begin() + std::min<int64_t>(2, rank), y.end(), 1);
+    } else if (node.op == "ReduceMean") {
+        auto axes = getAxes(graph, node, 1, rank);
+        if (axes.empty()) {
+            for (int64_t i = 0; i < rank; ++i)
+                axes.push_back(i);
+        }
+        const auto keepDims = node.getInt("keepdims", 1) != 0;
+        for (int64_t i = 0; i < rank; ++i) {
+            if (std::find(axes.begin(), axes.end(), i) == axes.end())
+                y.push_back(x[i]);
+            else if (keepDims)
+                y.push_back(1);
+        }
+    } else if (node.op == "Shape") {
+        y = {rank};
+    } else if (node.op == "Reshape") {
+        const auto target = getConstantInts(graph, node, 1);
+        int64_t known = 1;
+        int inferred = -1;
+        for (int i = 0; i < target.size(); ++i) {
+            const auto dim = target[i] == 0 && i < rank ? x[i] : target[i];
+            if (dim == -1)
+                inferred = i;
+            else
+                known *= dim;
+            y.push_back(dim);
+        }
+        int64_t size = 1;
+        for (const auto dim : x)
+            size *= dim;
+        if (inferred >= 0 && known > 0)
+            y[inferred] = size / known;
+    } else if (node.op == "Flatten") {
+        auto axis = node.getInt("axis", 1);
+        if (axis < 0)
+            axis += rank;
+        y = {1, 1};
+        for (int64_t i = 0; i < rank; ++i)
+            y[i < axis ? 0 : 1] *= x[i];
+    } else if (node.op == "Squeeze") {
+        const auto axes = getAxes(graph, node, 1, rank);
+        for (int64_t i = 0; i < rank; ++i) {
+            const auto squeezed = axes.empty() ? x[i] == 1 : std::find(axes.begin(), axes.end(), i) != axes.end();
+            if (!squeezed)
+                y.push_back(x[i]);
+        }
+    } else if (node.op == "Unsqueeze") {
+        const auto axesCount = static_cast<int64_t>(node.hasAttribute("axes")
+            ? node.getInts("axes", {}).size() : getConstantInts(graph, node, 1).size());
+        const auto axes = getAxes(graph, node, 1, rank + axesCount);
+        auto it = x.begin();
+        for (int64_t i = 0; i < rank + axesCount; ++i)
+            y.push_back(std::find(axes.begin(), axes.end(), i) != axes.end() ? 1 : *it++);
+    } else if (node.op == "Slice") {
+        const auto starts = getConstantInts(graph, node, 1);
+        const auto ends = getConstantInts(graph, node, 2);
+        auto axes = getAxes(graph, node, 3, rank);
+        if (axes.empty()) {
+            for (int64_t i = 0; i < static_cast<int64_t>(starts.size()); ++i)
+                axes.push_back(i);
+        }
+        const auto steps = node.inputs.size() > 4 && !node.inputs[4].empty()
+            ? getConstantInts(graph, node, 4) : std::vector<int64_t>(starts.size(), 1);
+        y = x;
+        for (size_t i = 0; i < axes.size(); ++i) {
+            const auto dim = x[axes[i]];
+            if (steps[i] <= 0)
+                throw std::runtime_error("negative slice steps in node \"" + node.name + "\" are not supported");
+            auto start = starts[i] < 0 ? starts[i] + dim : starts[i];
+            auto end = ends[i] < 0 ? ends[i] + dim : ends[i];
+            start = std::clamp<int64_t>(start, 0, dim);
+            end = std::clamp<int64_t>(end, 0, dim);
+            y[axes[i]] = end > start ? (end - start + steps[i] - 1) / steps[i] : 0;
+        }
+    } else if (node.op == "Pad") {
+        const auto pads = node.hasAttribute("pads") ? node.getInts("pads", {}) : getConstantInts(graph, node, 1);
+        if (pads.size() != 2 * x.size())
+            throw std::runtime_error("node \"" + node.name + "\" has invalid pads");
+        y = x;
+        for (int64_t i = 0; i < rank; ++i)
+            y[i] += pads[i] + pads[i + rank];
+    } else if (node.op == "Concat") {
+        auto axis = node.getInt("axis", 0);
+        if (axis < 0)
+            axis += rank;
+        y = x;
+        for (int i = 1; i < node.inputs.size(); ++i)
+            y[axis] += getInputShape(shapes, graph, node, i)[axis];
+    } else if (node.op == "Gather") {
+        auto axis = node.getInt("axis", 0);
+        if (axis < 0)
+            axis += rank;
+        const auto& indices = getInputShape(shapes, graph, node, 1);
+        y.assign(x.begin(), x.begin() + axis);
+        y.insert(y.end(), indices.begin(), indices.end());
+        y.insert(y.end(), x.begin() + axis + 1, x.end());
+    } else {
+        throw std::runtime_error("unsupported op \"" + node.op + "\" in node \"" + node.name + "\"");
+    }
+    return y;
+}
+
+cpu::Shape cpu::getCropOffsets(const Graph& graph, const Node& node, const Shape& inputShape) {
+    const auto rank = static_cast<int64_t>(inputShape.size());
+    Shape offsets(rank, 0);
+    if (node.op == "Pad") {
+        const auto pads = node.hasAttribute("pads") ? node.getInts("pads", {}) : getConstantInts(graph, node, 1);
+        if (pads.size() != 2 * inputShape.size())
+            throw std::runtime_error("node \"" + node.name + "\" has invalid pads");
+        for (int64_t i = 0; i < rank; ++i) {
+            if (pads[i] > 0 || pads[i + rank] > 0)
+                throw std::runtime_error("padding in node \"" + node.name + "\" is not supported");
+            offsets[i] = -pads[i];
+        }
+        return offsets;
+    }
+    if (node.op != "Slice")
+        throw std::runtime_error("node \"" + node.name + "\" is not a crop");
+
+    const auto starts = getConstantInts(graph, node, 1);
+    auto axes = getAxes(graph, node, 3, rank);
+    if (axes.empty()) {
+        for (int64_t i = 0; i < static_cast<int64_t>(starts.size()); ++i)
+            axes.push_back(i);
+    }
+    if (node.inputs.size() > 4 && !node.inputs[4].empty()) {
+        for (const auto step : getConstantInts(graph, node, 4)) {
+            if (step != 1)
+                throw std::runtime_error("strided slice in node \"" + node.name + "\" is not supported");
+        }
+    }
+    for (size_t i = 0; i < axes.size(); ++i) {
+        const auto dim = inputShape[axes[i]];
+        const auto start = starts[i] < 0 ? starts[i] + dim : starts[i];
+        offsets[axes[i]] = std::clamp<int64_t>(start, 0, dim);
+    }
+    return offsets;
+}
+
+std::map<std::string, cpu::Shape> cpu::inferShapes(const Graph& graph, const Shape& inputShape) {
+    if (graph.inputs.size() != 1 || graph.outputs.size() != 1)
+        throw std::runtime_error("graph must have exactly one input and one output");
+
+    std::map<std::string, Shape> shapes;
+    shapes[graph.inputs[0].name] = inputShape;
+
+    for (const auto& node : graph.nodes) {
+        if (node.op == "Constant")
+            continue;
+
+        const auto y = inferShape(graph, node, shapes);
+        for (const auto dim : y) {
+            if (dim <= 0)
+                throw std::runtime_error("node \"" + node.name + "\" produces an empty tensor");
+        }
+        shapes[node.outputs[0]] = y;
+    }
+
+    if (shapes.find(graph.outputs[0].name) == shapes.end())
+        throw std::runtime_error("graph output \"" + graph.outputs[0].name + "\" is never produced");
+    return shapes;
+}
\ No newline at end of file
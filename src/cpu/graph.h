@@ -0,0 +1,78 @@
+#ifndef WAIFU2X_TENSORRT_CPU_GRAPH_H
+#define WAIFU2X_TENSORRT_CPU_GRAPH_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cpu {
+    using Shape = std::vector<int64_t>;
+
+    enum class DataType {
+        Float,
+        Int64
+    };
+
+    struct Tensor {
+        DataType type = DataType::Float;
+        Shape dims;
+        std::vector<float> floats;
+        std::vector<int64_t> ints;
+
+        [[nodiscard]] int64_t size() const;
+    };
+
+    struct Attribute {
+        float f = 0.0f;
+        int64_t i = 0;
+        std::string s;
+        std::vector<float> floats;
+        std::vector<int64_t> ints;
+        Tensor t;
+    };
+
+    struct Node {
+        std::string op;
+        std::string name;
+        std::vector<std::string> inputs;
+        std::vector<std::string> outputs;
+        std::map<std::string, Attribute> attributes;
+
+        [[nodiscard]] bool hasAttribute(const std::string& key) const;
+        [[nodiscard]] int64_t getInt(const std::string& key, int64_t defaultValue) const;
+        [[nodiscard]] float getFloat(const std::string& key, float defaultValue) const;
+        [[nodiscard]] std::vector<int64_t> getInts(const std::string& key, const std::vector<int64_t>& defaultValue) const;
+    };
+
+    struct ValueInfo {
+        std::string name;
+        Shape dims; // -1 for dynamic dimensions
+    };
+
+    struct Graph {
+        std::vector<Node> nodes;
+        std::map<std::string, Tensor> initializers;
+        std::vector<ValueInfo> inputs;
+        std::vector<ValueInfo> outputs;
+
+        // Returns the constant behind a value, either an initializer or the output of a Constant node
+        [[nodiscard]] const Tensor* findConstant(const std::string& name) const;
+    };
+
+    // Numpy style broadcasting of two shapes
+    Shape broadcastShapes(const Shape& a, const Shape& b);
+
+    // Output shape of a single node given the shapes of its non-constant inputs; shape inputs
+    // (Reshape, Slice, Expand, ...) have to be constants
+    Shape inferShape(const Graph& graph, const Node& node, const std::map<std::string, Shape>& shapes);
+
+    // Offset of the first element kept along every axis by a Slice with unit steps or a Pad
+    // with only negative pads, both of which crop their input
+    Shape getCropOffsets(const Graph& graph, const Node& node, const Shape& inputShape);
+
+    // Propagates the NCHW input shape through the graph, throws on unsupported ops
+    std::map<std::string, Shape> inferShapes(const Graph& graph, const Shape& inputShape);
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_GRAPH_H
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef WAIFU2X_TENSORRT_CPU_HELPER_H
+#define WAIFU2X_TENSORRT_CPU_HELPER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(_MSC_VER)
+#define CPU_TARGET_AVX2
+#define CPU_UNROLL
+#else
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CPU_UNROLL _Pragma("GCC unroll 16")
+#endif
+
+namespace cpu {
+    enum CpuFeature : uint32_t {
+        SSE42 = 1 << 0,
+        AVX = 1 << 1,
+        AVX2 = 1 << 2,
+        FMA = 1 << 3,
+        AVX512F = 1 << 4,
+        SHA = 1 << 5
+    };
+
+    [[maybe_unused]]
+    static inline void cpuId(int leaf, int subleaf, uint32_t (&regs)[4]) {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, leaf, subleaf);
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<uint32_t>(info[i]);
+#elif defined(__x86_64__) || defined(__i386__)
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+    }
+
+    [[maybe_unused]]
+    [[nodiscard]]
+    static inline uint64_t cpuGetXcr0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#else
+        return 0;
+#endif
+    }
+
+    [[maybe_unused]]
+    [[nodiscard]]
+    static inline uint32_t cpuGetFeatures() {
+        uint32_t regs[4];
+        cpuId(0, 0, regs);
+        const auto maxLeaf = regs[0];
+        if (maxLeaf < 1)
+            return 0;
+
+        uint32_t features = 0;
+        cpuId(1, 0, regs);
+        const auto ecx1 = regs[2];
+        if (ecx1 & (1U << 20))
+            features |= SSE42;
+
+        // AVX state must be enabled by the OS, not only supported by the CPU
+        const bool osxsave = ecx1 & (1U << 27);
+        const auto xcr0 = osxsave ? cpuGetXcr0() : 0;
+        const bool ymmState = (xcr0 & 0x6) == 0x6;
+        const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+        if ((ecx1 & (1U << 28)) && ymmState)
+            features |= AVX;
+        if ((ecx1 & (1U << 12)) && ymmState)
+            features |= FMA;
+
+        if (maxLeaf >= 7) {
+            cpuId(7, 0, regs);
+            const auto ebx7 = regs[1];
+            if ((ebx7 & (1U << 5)) && ymmState)
+                features |= AVX2;
+            if ((ebx7 & (1U << 16)) && zmmState)
+                features |= AVX512F;
+            if (ebx7 & (1U << 29))
+                features |= SHA;
+        }
+        return features;
+    }
+
+    constexpr std::pair<CpuFeature, const char*> cpuFeatureNames[] = {
+        {SSE42, "sse4.2"},
+        {AVX, "avx"},
+        {AVX2, "avx2"},
+        {FMA, "fma"},
+        {AVX512F, "avx512f"},
+        {SHA, "sha"}
+    };
+
+    [[maybe_unused]]
+    [[nodiscard]]
+    static inline std::string cpuGetFeatureString(uint32_t features) {
+        std::string result;
+        for (const auto& [feature, name] : cpuFeatureNames) {
+            if (!(features & feature))
+                continue;
+            if (!result.empty())
+                result += ".";
+            result += name;
+        }
+        return result.empty() ? "generic" : result;
+    }
+
+    [[maybe_unused]]
+    [[nodiscard]]
+    static inline uint32_t cpuParseFeatureString(const std::string& string) {
+        uint32_t features = 0;
+        size_t begin = 0;
+        while (begin <= string.size()) {
+            auto end = string.find('.', begin);
+            if (end == std::string::npos)
+                end = string.size();
+            // "sse4.2" contains the separator itself
+            if (string.compare(begin, end - begin, "sse4") == 0 && string.compare(end, 2, ".2") == 0)
+                end += 2;
+            const auto token = string.substr(begin, end - begin);
+            for (const auto& [feature, name] : cpuFeatureNames) {
+                if (token == name)
+                    features |= feature;
+            }
+            begin = end + 1;
+        }
+        return features;
+    }
+
+    [[maybe_unused]]
+    [[nodiscard]]
+    static inline std::string cpuGetDeviceName() {
+        uint32_t regs[4];
+        cpuId(static_cast<int>(0x80000000), 0, regs);
+        if (regs[0] < 0x80000004)
+            return "unknown";
+
+        char brand[49] = {};
+        for (int i = 0; i < 3; ++i) {
+            cpuId(static_cast<int>(0x80000002 + i), 0, regs);
+            std::memcpy(brand + 16 * i, regs, sizeof(regs));
+        }
+        std::string name(brand);
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        return name;
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_HELPER_H
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef WAIFU2X_TENSORRT_CPU_IMG2IMG_H
+#define WAIFU2X_TENSORRT_CPU_IMG2IMG_H
+
+#include "config.h"
+#include "graph.h"
+#include "model.h"
+#include "tensorrt/logger.h"
+#include "utilities/counters.h"
+#include "utilities/dispatcher.h"
+#include "utilities/threadpool.h"
+#include "utilities/time.h"
+#include <opencv2/core/mat.hpp>
+#include <array>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace cpu {
+    using trt::MessageCallback;
+    using trt::ProgressCallback;
+
+    // Input tile read straight out of an image, rows and columns outside of it replicate the
+    // border of the image, so edge tiles need no padded copy
+    struct TileRegion {
+        const cv::Mat* image = nullptr; // blank tile when null
+        cv::Rect2i rect;
+    };
+
+    class Img2Img : public utils::TileBackend {
+    public:
+        Img2Img();
+        virtual ~Img2Img();
+        bool build(const std::string& path, const BuildConfig& config);
+        bool load(const std::string& path, const RenderConfig& config);
+        bool render(const cv::Mat& src, cv::Mat& dst);
+        void setMessageCallback(MessageCallback callback);
+        void setProgressCallback(ProgressCallback callback);
+        // Latency of the warm-up batches of the last load
+        [[nodiscard]] const utils::WarmupResult& getWarmupResult() const;
+        // Hardware counts of the pipeline stages since openCounters, zero unless the config asked
+        // for them and perf events are available
+        [[nodiscard]] const utils::StageCounters& getStageCounters() const;
+        // Counts function as a stage run by the caller, such as encoding the rendered frame
+        void measureStage(utils::Stage stage, const std::function<void()>& function);
+
+        // Threads are not copied into a forked process, so the pool is stopped before forking and
+        // started again in the child. load starts it.
+        void startThreads();
+        void stopThreads();
+        // Opens the hardware counters of the pool and of the calling thread, which takes part in every
+        // parallelFor and runs the stages measured with measureStage. So it has to be called from the
+        // thread that renders, not from one that only loads the model. Closed again by startThreads.
+        void openCounters();
+
+        // Tiles of the loaded model for a TileDispatcher, without test-time augmentation
+        [[nodiscard]] int getBatchSize() const override;
+        [[nodiscard]] cv::Size2i getInputTileSize() const override;
+        [[nodiscard]] cv::Size2i getOutputTileSize() const override;
+        bool inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) override;
+        bool inferRegions(const cv::Mat& image, const std::vector<cv::Rect2i>& rects, std::vector<cv::Mat>& outputs) override;
+
+    private:
+        bool infer(const std::vector<TileRegion>& inputs, std::vector<cv::Mat>& outputs);
+        bool renderFrame(const cv::Mat& src, cv::Mat& dst);
+        void compileFrame(const cv::Size2i& size);
+
+        // Model
+        trt::Logger logger;
+        Model model;
+        std::unique_ptr<utils::ThreadPool> pool;
+
+        // Inference
+        RenderConfig renderConfig;
+        utils::WarmupResult warmupResult;
+        utils::PerfCounters counters;
+        utils::StageCounters stageCounters;
+        cv::Mat output;
+        cv::Size2i inputTileSize;
+        cv::Size2i outputTileSize;
+
+        // Whole frame, recompiled whenever the frame size changes
+        Graph graph;
+        cv::Size2i frameSize;
+        cv::Point2i framePadding;
+        cv::Point2i frameCrop;
+
+        // Blending
+        std::array<cv::Mat, 4> weights;
+
+        // Augmentation
+        std::vector<cv::Mat> ttaInputTiles;
+        cv::Mat ttaOutputTile;
+        cv::Mat tmpOutputMat;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_IMG2IMG_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "img2img.h"
+#include <atomic>
+#include <thread>
+
+cpu::Img2Img::Img2Img() = default;
+cpu::Img2Img::~Img2Img() = default;
+
+void cpu::Img2Img::setMessageCallback(MessageCallback callback) {
+    logger.setMessageCallback(std::move(callback));
+}
+
+void cpu::Img2Img::setProgressCallback(ProgressCallback callback) {
+    logger.setProgressCallback(std::move(callback));
+}
+
+void cpu::Img2Img::startThreads() {
+    const auto threads = renderConfig.threads > 0
+        ? renderConfig.threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+    if (!pool || pool->size() != threads)
+        pool = std::make_unique<utils::ThreadPool>(threads);
+    counters.close();
+}
+
+void cpu::Img2Img::openCounters() {
+    counters.close();
+    stageCounters = utils::StageCounters();
+    if (!renderConfig.counters || !pool)
+        return;
+
+    // Every thread of the pool counts for itself, the calling thread included
+    std::atomic<bool> opened = true;
+    pool->runOnEachThread([&] {
+        if (!counters.addThread())
+            opened = false;
+    });
+    if (!opened) {
+        counters.close();
+        logger.LOG(trt::warn, "Hardware counters are not available, perf_event_open failed.");
+    }
+}
+
+void cpu::Img2Img::stopThreads() {
+    counters.close();
+    pool.reset();
+}
+
+int cpu::Img2Img::getBatchSize() const {
+    return renderConfig.batchSize;
+}
+
+cv::Size2i cpu::Img2Img::getInputTileSize() const {
+    return inputTileSize;
+}
+
+cv::Size2i cpu::Img2Img::getOutputTileSize() const {
+    return outputTileSize;
+}
+
+const utils::WarmupResult& cpu::Img2Img::getWarmupResult() const {
+    return warmupResult;
+}
+
+const utils::StageCounters& cpu::Img2Img::getStageCounters() const {
+    return stageCounters;
+}
+
+void cpu::Img2Img::measureStage(utils::Stage stage, const std::function<void()>& function) {
+    counters.measure(stageCounters[stage], function);
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "img2img.h"
+#include "helper.h"
+#include "onnx.h"
+#include "optimizer.h"
+#include "utilities/sha256.h"
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+
+std::string getConfigHash(const std::string& modelHash, uint32_t cpuFeatures, const cpu::BuildConfig& config) {
+    std::ostringstream oss;
+    oss << modelHash << "."
+        << cpu::cpuGetFeatureString(cpuFeatures) << "."
+        << config.batchSize << "." << config.channels << "."
+        << config.width << "." << config.height;
+    return utils::sha256(oss.str());
+}
+
+void serializeConfig(const std::string& path, const std::string& modelHash, uint32_t cpuFeatures, const cpu::BuildConfig& config) {
+    const auto j = nlohmann::ordered_json{
+        {"deviceName", cpu::cpuGetDeviceName()},
+        {"cpuFeatures", cpu::cpuGetFeatureString(cpuFeatures)},
+        {"modelHash", modelHash},
+        {"batchSize", config.batchSize},
+        {"channels", config.channels},
+        {"width", config.width},
+        {"height", config.height}
+    };
+    std::ofstream outputFile(path);
+    if (!outputFile.is_open())
+        throw std::runtime_error("could not open config \"" + path + "\"");
+    outputFile << std::setw(4) << j;
+}
+
+std::string formatBytes(uint64_t bytes) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / (1024.0 * 1024.0) << " MiB";
+    return oss.str();
+}
+
+bool cpu::Img2Img::build(const std::string& onnxModelPath, const BuildConfig& config) try {
+    // Parse ONNX model
+    Graph graph;
+    std::string modelHash;
+    try {
+        graph = parseOnnx(onnxModelPath);
+        modelHash = utils::sha256File(onnxModelPath);
+    }
+    catch (const std::exception& e) {
+        logger.LOG(trt::error, "Failed to parse ONNX model: " + std::string(e.what()) + ".");
+        return false;
+    }
+
+    // Optimize graph for the tile shape
+    try {
+        const auto report = optimizeGraph(graph, {config.batchSize, config.channels, config.height, config.width});
+        logger.LOG(trt::info, "Optimized graph from " + std::to_string(report.before.ops) + " to "
+            + std::to_string(report.after.ops) + " ops (" + std::to_string(report.folded) + " folded, "
+            + std::to_string(report.eliminated) + " eliminated, " + std::to_string(report.fused) + " fused), "
+            + "estimated memory traffic from " + formatBytes(report.before.traffic) + " to "
+            + formatBytes(report.after.traffic) + ".");
+    }
+    catch (const std::exception& e) {
+        logger.LOG(trt::error, "Failed to optimize graph: " + std::string(e.what()) + ".");
+        return false;
+    }
+
+    // Compile model for the host cpu
+    const auto kernel = getKernelType(cpuGetFeatures());
+    const auto cpuFeatures = getKernelFeatures(kernel);
+    std::vector<char> compiledModel;
+    try {
+        compiledModel = Model::compile(graph, config, kernel);
+    }
+    catch (const std::exception& e) {
+        logger.LOG(trt::error, "Failed to compile model: " + std::string(e.what()) + ".");
+        return false;
+    }
+
+    // Serialize model
+    const auto basePath = std::filesystem::path(onnxModelPath).replace_extension("").string()
+        + "_" + getConfigHash(modelHash, cpuFeatures, config).substr(0, 16);
+    const auto configPath = basePath + ".json";
+    const auto compiledModelPath = basePath + ".cpu";
+    serializeConfig(configPath, modelHash, cpuFeatures, config);
+    try {
+        std::ofstream modelFile(compiledModelPath, std::ios::binary);
+        modelFile.exceptions(std::ios::failbit | std::ios::badbit);
+        modelFile.write(compiledModel.data(), static_cast<long long>(compiledModel.size()));
+    }
+    catch (const std::exception& e) {
+        logger.LOG(trt::error, "Failed to serialize model to disk: " + std::string(e.what()) + ".");
+        return false;
+    }
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(trt::error, "Model build failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
\ No newline at end of file
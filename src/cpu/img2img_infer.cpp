@@ -0,0 +1,125 @@
+#include "img2img.h"
+#include <algorithm>
+
+// Converts BGR 8-bit tiles into the channel-blocked RGB input tensor, writing every lane of the
+// block since the arena region of the input is reused by later layers. Tiles are read straight
+// out of their image with coordinates clamped to it, which replicates its border.
+void packInputs(const std::vector<cpu::TileRegion>& tiles, cpu::Model& model, utils::ThreadPool& pool) {
+    const auto& header = model.getHeader();
+    const auto& tensor = model.getTensor(header.inputTensor);
+    const auto height = tensor.height;
+    const auto width = tensor.width;
+
+    pool.parallelFor(static_cast<int>(tiles.size()) * height, [&](int task) {
+        const auto batchIndex = task / height;
+        const auto y = task % height;
+        const auto& tile = tiles[batchIndex];
+        auto* dst = model.getTensorData(header.inputTensor, batchIndex) + static_cast<size_t>(y) * width * cpu::blockSize;
+        if (!tile.image) {
+            std::fill(dst, dst + static_cast<size_t>(width) * cpu::blockSize, 0.0f);
+            return;
+        }
+
+        const auto& image = *tile.image;
+        const auto* src = image.ptr<uint8_t>(std::clamp(tile.rect.y + y, 0, image.rows - 1));
+        for (int x = 0; x < width; ++x, dst += cpu::blockSize) {
+            const auto* pixel = src + std::clamp(tile.rect.x + x, 0, image.cols - 1) * 3;
+            dst[0] = static_cast<float>(pixel[2]) * (1.0f / 255.0f);
+            dst[1] = static_cast<float>(pixel[1]) * (1.0f / 255.0f);
+            dst[2] = static_cast<float>(pixel[0]) * (1.0f / 255.0f);
+            for (int c = 3; c < cpu::blockSize; ++c)
+                dst[c] = 0.0f;
+        }
+    });
+}
+
+void unpackOutputs(cpu::Model& model, std::vector<cv::Mat>& images, utils::ThreadPool& pool) {
+    const auto& header = model.getHeader();
+    const auto& tensor = model.getTensor(header.outputTensor);
+    const auto height = tensor.height;
+    const auto width = tensor.width;
+
+    for (auto& image : images)
+        image.create(height, width, CV_32FC3);
+
+    pool.parallelFor(static_cast<int>(images.size()) * height, [&](int task) {
+        const auto batchIndex = task / height;
+        const auto y = task % height;
+        const auto* src = model.getTensorData(header.outputTensor, batchIndex) + static_cast<size_t>(y) * width * cpu::blockSize;
+        auto* dst = images[batchIndex].ptr<float>(y);
+        for (int x = 0; x < width; ++x, src += cpu::blockSize, dst += 3) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+        }
+    });
+}
+
+bool cpu::Img2Img::infer(const std::vector<TileRegion>& inputs, std::vector<cv::Mat>& outputs) try {
+    // Check batch size
+    if (inputs.size() != renderConfig.batchSize) {
+        logger.LOG(trt::error, "Input has invalid batch size: expected "
+            + std::to_string(renderConfig.batchSize) + ", got " + std::to_string(inputs.size()) + ".");
+        return false;
+    }
+
+    // Check image size
+    for (const auto& tile: inputs) {
+        if (!tile.image)
+            continue;
+
+        if (tile.image->type() != CV_8UC3) {
+            logger.LOG(trt::error, "Input image has invalid type: expected CV_8UC3, got " + std::to_string(tile.image->type()) + ".");
+            return false;
+        }
+
+        if (tile.image->empty()) {
+            logger.LOG(trt::error, "Input image is empty.");
+            return false;
+        }
+
+        if (tile.rect.height != renderConfig.height) {
+            logger.LOG(trt::error, "Input tile has invalid height: expected "
+                + std::to_string(renderConfig.height) + ", got " + std::to_string(tile.rect.height) + ".");
+            return false;
+        }
+
+        if (tile.rect.width != renderConfig.width) {
+            logger.LOG(trt::error, "Input tile has invalid width: expected "
+                + std::to_string(renderConfig.width) + ", got " + std::to_string(tile.rect.width) + ".");
+            return false;
+        }
+        ++stageCounters.tiles;
+    }
+
+    // Preprocess input
+    counters.measure(stageCounters[utils::Stage::Pack], [&] { packInputs(inputs, model, *pool); });
+
+    // Run model
+    counters.measure(stageCounters[utils::Stage::Convolution], [&] { model.run(*pool); });
+
+    // Postprocess output
+    outputs.resize(inputs.size());
+    counters.measure(stageCounters[utils::Stage::Blend], [&] { unpackOutputs(model, outputs, *pool); });
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(trt::error, "Model inference failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
+
+bool cpu::Img2Img::inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) {
+    std::vector<TileRegion> tiles;
+    tiles.reserve(inputs.size());
+    for (const auto& input : inputs)
+        tiles.push_back({&input, cv::Rect2i(0, 0, input.cols, input.rows)});
+    return infer(tiles, outputs);
+}
+
+bool cpu::Img2Img::inferRegions(const cv::Mat& image, const std::vector<cv::Rect2i>& rects, std::vector<cv::Mat>& outputs) {
+    std::vector<TileRegion> tiles(renderConfig.batchSize, {nullptr, cv::Rect2i(cv::Point2i(), inputTileSize)});
+    for (size_t i = 0; i < rects.size() && i < tiles.size(); ++i)
+        tiles[i] = {&image, rects[i]};
+    return infer(tiles, outputs);
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "img2img.h"
+#include "helper.h"
+#include "onnx.h"
+#include "utilities/sha256.h"
+#include "utilities/tiling.h"
+#include <nlohmann/json.hpp>
+#include <opencv2/core.hpp>
+#include <filesystem>
+#include <fstream>
+
+bool isCompatible(const cpu::RenderConfig& renderConfig, const cpu::BuildConfig& buildConfig, uint32_t cpuFeatures) {
+    return (cpuFeatures & cpu::cpuGetFeatures()) == cpuFeatures &&
+        renderConfig.batchSize == buildConfig.batchSize &&
+        renderConfig.channels == buildConfig.channels &&
+        renderConfig.width == buildConfig.width &&
+        renderConfig.height == buildConfig.height;
+}
+
+bool isOptimized(uint32_t cpuFeatures) {
+    return cpuFeatures == cpu::getKernelFeatures(cpu::getKernelType(cpu::cpuGetFeatures()));
+}
+
+void deserializeConfig(const std::string& path, cpu::BuildConfig& config, std::string& modelHash, uint32_t& cpuFeatures) {
+    std::ifstream inputFile(path);
+    if (!inputFile.is_open())
+        throw std::runtime_error("could not open config \"" + path + "\"");
+    nlohmann::json j;
+    inputFile >> j;
+
+    cpuFeatures = cpu::cpuParseFeatureString(j.at("cpuFeatures").get<std::string>());
+    j.at("modelHash").get_to(modelHash);
+    j.at("batchSize").get_to(config.batchSize);
+    j.at("channels").get_to(config.channels);
+    j.at("width").get_to(config.width);
+    j.at("height").get_to(config.height);
+}
+
+std::string getCompiledModelPath(const std::string& modelPath, const cpu::RenderConfig& config) {
+    namespace fs = std::filesystem;
+    if (!fs::exists(modelPath))
+        throw std::runtime_error("model file does not exist");
+
+    const auto modelHash = utils::sha256File(modelPath);
+    std::string modelName = fs::path(modelPath).stem().string();
+    std::string compiledModelPath;
+    for (const auto& entry : fs::directory_iterator(fs::path(modelPath).parent_path())) {
+        if (!entry.is_regular_file())
+            continue;
+
+        const auto& path = entry.path();
+        if (path.filename().string().rfind(modelName, 0) != 0 ||
+            path.extension().string() != ".cpu")
+            continue;
+
+        std::string configPath = std::filesystem::path(path).replace_extension("").string() + ".json";
+        if (!fs::exists(configPath))
+            continue;
+
+        cpu::BuildConfig buildConfig;
+        std::string buildModelHash;
+        uint32_t cpuFeatures = 0;
+        deserializeConfig(configPath, buildConfig, buildModelHash, cpuFeatures);
+        if (buildModelHash == modelHash && isCompatible(config, buildConfig, cpuFeatures)) {
+            if (isOptimized(cpuFeatures)) {
+                compiledModelPath = path.string();
+                break;
+            } else if (compiledModelPath.empty()) {
+                compiledModelPath = path.string();
+            }
+        }
+    }
+
+    if (compiledModelPath.empty())
+        throw std::runtime_error("could not satisfy render configuration");
+    return compiledModelPath;
+}
+
+bool cpu::Img2Img::load(const std::string& modelPath, const RenderConfig& config) try {
+    // Whole frames compile on the first render, once the frame size is known
+    if (config.wholeFrame) {
+        if (config.tta) {
+            logger.LOG(trt::error, "Test-time augmentation is not supported for whole frames.");
+            return false;
+        }
+        try {
+            graph = parseOnnx(modelPath);
+        }
+        catch (const std::exception& e) {
+            logger.LOG(trt::error, "Failed to parse ONNX model \"" + modelPath + "\": " + std::string(e.what()) + ".");
+            return false;
+        }
+
+        renderConfig = config;
+        startThreads();
+        frameSize = cv::Size2i();
+        warmupResult = utils::WarmupResult();
+        if (config.warmup > 0)
+            logger.LOG(trt::warn, "Whole frames compile on the first render, skipping warm-up.");
+        return true;
+    }
+
+    // Find compiled model
+    std::string compiledModelPath;
+    try {
+        compiledModelPath = getCompiledModelPath(modelPath, config);
+    } catch (const std::exception& e) {
+        logger.LOG(trt::error, "Failed to find compiled model for model \"" + modelPath + "\": " + std::string(e.what()) + ".");
+        return false;
+    }
+
+    // Map compiled model
+    try {
+        model.load(compiledModelPath);
+    }
+    catch (const std::exception& e) {
+        logger.LOG(trt::error, "Failed to load compiled model \"" + compiledModelPath + "\": " + std::string(e.what()) + ".");
+        return false;
+    }
+
+    // Validate model
+    const auto& header = model.getHeader();
+    const auto& inputTensor = model.getTensor(header.inputTensor);
+    const auto& outputTensor = model.getTensor(header.outputTensor);
+    if (inputTensor.channels != 3 || outputTensor.channels != 3) {
+        logger.LOG(trt::error, "Compiled model has invalid number of channels: expected 3, got "
+            + std::to_string(inputTensor.channels) + " and " + std::to_string(outputTensor.channels) + ".");
+        return false;
+    }
+
+    // Create thread pool
+    renderConfig = config;
+    startThreads();
+    inputTileSize = cv::Size2i(inputTensor.width, inputTensor.height);
+    outputTileSize = cv::Size2i(outputTensor.width, outputTensor.height);
+
+    const auto scaledOutputOverlap = cv::Point2i(
+        static_cast<int>(std::lround(inputTileSize.width * renderConfig.scaling * renderConfig.overlap.x)),
+        static_cast<int>(std::lround(inputTileSize.height * renderConfig.scaling * renderConfig.overlap.y))
+    );
+
+    if (renderConfig.overlap.x != 0 || renderConfig.overlap.y != 0) {
+        utils::createTileWeights(weights, scaledOutputOverlap, outputTileSize);
+    }
+
+    if (renderConfig.tta) {
+        ttaInputTiles.resize(renderConfig.batchSize);
+        for (auto& ttaInputTile : ttaInputTiles) {
+            ttaInputTile.create(inputTileSize, CV_8UC3);
+        }
+        ttaOutputTile.create(outputTileSize, CV_32FC3);
+        tmpOutputMat.create(outputTileSize, CV_32FC3);
+    } else {
+        ttaInputTiles.clear();
+        ttaOutputTile.release();
+        tmpOutputMat.release();
+    }
+
+    // Warm up, the first batch faults in the arena and output tiles and starts the pool threads
+    warmupResult = utils::WarmupResult();
+    if (config.warmup > 0) {
+        model.prefault();
+        std::vector<TileRegion> tiles(config.batchSize, {nullptr, cv::Rect2i(cv::Point2i(), inputTileSize)});
+        std::vector<cv::Mat> outputTiles;
+        if (!utils::measureWarmup(config.warmup, [&] { return infer(tiles, outputTiles); }, warmupResult)) {
+            logger.LOG(trt::error, "Warm-up inference failed.");
+            return false;
+        }
+        stageCounters = utils::StageCounters();
+    }
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(trt::error, "Model load failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
\ No newline at end of file
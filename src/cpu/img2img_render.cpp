@@ -0,0 +1,207 @@
+#include "img2img.h"
+#include "utilities/tiling.h"
+#include "utilities/time.h"
+#include <opencv2/core.hpp>
+
+void applyAugmentation(const cv::Mat& src, cv::Mat& dst, int augmentationIndex) {
+    cv::Mat tmp;
+    switch (augmentationIndex) {
+        default:
+        case utils::Augmentation::None:
+            src.copyTo(dst);
+            break;
+
+        case utils::Augmentation::FlipHorizontal:
+            cv::flip(src, dst, 0);
+            break;
+
+        case utils::Augmentation::FlipVertical:
+            cv::flip(src, dst, 1);
+            break;
+
+        case utils::Augmentation::Rotate90:
+            cv::rotate(src, dst, cv::ROTATE_90_COUNTERCLOCKWISE);
+            break;
+
+        case utils::Augmentation::Rotate180:
+            cv::rotate(src, dst, cv::ROTATE_180);
+            break;
+
+        case utils::Augmentation::Rotate270:
+            cv::rotate(src, dst, cv::ROTATE_90_CLOCKWISE);
+            break;
+
+        case utils::Augmentation::FlipHorizontalRotate90:
+            cv::flip(src, tmp, 0);
+            cv::rotate(tmp, dst, cv::ROTATE_90_COUNTERCLOCKWISE);
+            break;
+
+        case utils::Augmentation::FlipVerticalRotate90:
+            cv::flip(src, tmp, 1);
+            cv::rotate(tmp, dst, cv::ROTATE_90_COUNTERCLOCKWISE);
+            break;
+    }
+}
+
+void reverseAugmentation(const cv::Mat& src, cv::Mat& dst, int augmentationIndex) {
+    cv::Mat tmp;
+    switch (augmentationIndex) {
+        default:
+        case utils::Augmentation::None:
+            src.copyTo(dst);
+            break;
+
+        case utils::Augmentation::FlipHorizontal:
+            cv::flip(src, dst, 0);
+            break;
+
+        case utils::Augmentation::FlipVertical:
+            cv::flip(src, dst, 1);
+            break;
+
+        case utils::Augmentation::Rotate90:
+            cv::rotate(src, dst, cv::ROTATE_90_CLOCKWISE);
+            break;
+
+        case utils::Augmentation::Rotate180:
+            cv::rotate(src, dst, cv::ROTATE_180);
+            break;
+
+        case utils::Augmentation::Rotate270:
+            cv::rotate(src, dst, cv::ROTATE_90_COUNTERCLOCKWISE);
+            break;
+
+        case utils::Augmentation::FlipHorizontalRotate90:
+            cv::rotate(src, tmp, cv::ROTATE_90_CLOCKWISE);
+            cv::flip(tmp, dst, 0);
+            break;
+
+        case utils::Augmentation::FlipVerticalRotate90:
+            cv::rotate(src, tmp, cv::ROTATE_90_CLOCKWISE);
+            cv::flip(tmp, dst, 1);
+            break;
+    }
+}
+
+bool cpu::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
+    if (renderConfig.wholeFrame)
+        return renderFrame(src, dst);
+
+    // Allocate output, color conversion happens while packing and unpacking tensors
+    const auto& input = src;
+    output.create(input.rows * renderConfig.scaling, input.cols * renderConfig.scaling, CV_32FC3);
+    output.setTo(cv::Scalar(0, 0, 0));
+
+    // Calculate tiles
+    const auto inputRect = cv::Rect2i(0, 0, input.cols, input.rows);
+    const auto outputRect = cv::Rect2i(0, 0, output.cols, output.rows);
+    const auto scaling = renderConfig.scaling;
+    const auto overlap = renderConfig.overlap;
+    auto [tileCount, inputTileRects, outputTileRects] = utils::calculateTiles(
+        inputRect, outputRect, inputTileSize, outputTileSize, scaling, overlap
+    );
+
+    // Constants
+    const auto tta = renderConfig.tta;
+    const auto overlapping = renderConfig.overlap.x != 0 || renderConfig.overlap.y != 0;
+
+    constexpr auto ttaSize = 8;
+    const auto batchSize = renderConfig.batchSize;
+    const auto stepsPerTile = tta ? ttaSize : 1;
+    const auto batchCount = std::lround(std::ceil(static_cast<double>(tileCount * stepsPerTile) / batchSize));
+    const auto stepCount = batchCount * batchSize;
+
+    // Tile buffers and indices
+    std::queue<std::tuple<int, int>> tileIndices;
+    std::vector<TileRegion> inputTiles(batchSize);
+    std::vector<cv::Mat> outputTiles(batchSize);
+
+    // Render image
+    for (auto stepIndex = 0; stepIndex < stepCount; ++stepIndex) {
+        const auto t0 = std::chrono::steady_clock::now();
+
+        // Calculate indices
+        auto tileIndex = stepIndex / stepsPerTile;
+        auto augmentationIndex = stepIndex % stepsPerTile;
+        auto batchIndex = stepIndex % batchSize;
+        tileIndices.emplace(tileIndex, augmentationIndex);
+
+        // Preprocess batch
+        // Tiles are read straight out of the input, only augmented tiles need a copy
+        if (tileIndex < tileCount) {
+            const auto& inputTileRect = inputTileRects[tileIndex];
+            if (tta && augmentationIndex != utils::Augmentation::None) {
+                auto& ttaInputTile = ttaInputTiles[batchIndex];
+                applyAugmentation(utils::padRoi(input, inputTileRect), ttaInputTile, augmentationIndex);
+                inputTiles[batchIndex] = {&ttaInputTile, cv::Rect2i(cv::Point2i(), inputTileSize)};
+            } else {
+                inputTiles[batchIndex] = {&input, inputTileRect};
+            }
+        } else {
+            inputTiles[batchIndex] = {nullptr, cv::Rect2i(cv::Point2i(), inputTileSize)};
+        }
+
+        // Check if batch is full
+        if (batchIndex != batchSize - 1)
+            continue;
+
+        // Infer batch
+        if (!infer(inputTiles, outputTiles)) {
+            logger.LOG(trt::error, "Failed to infer tile " + std::to_string(tileIndex + 1)
+                + "/" + std::to_string(tileCount) + ".");
+            return false;
+        }
+
+        // Postprocess batch
+        counters.measure(stageCounters[utils::Stage::Blend], [&] {
+            for (batchIndex = 0; batchIndex < batchSize; ++batchIndex) {
+                std::tie(tileIndex, augmentationIndex) = tileIndices.front();
+                if (tileIndex == tileCount)
+                    break;
+                tileIndices.pop();
+                auto* outputTile = &outputTiles[batchIndex];
+                auto& outputTileRect = outputTileRects[tileIndex];
+
+                // Postprocess TTA
+                if (tta) {
+                    if (augmentationIndex == utils::Augmentation::None) {
+                        outputTile->copyTo(ttaOutputTile);
+                    } else {
+                        reverseAugmentation(*outputTile, tmpOutputMat, augmentationIndex);
+                        cv::add(ttaOutputTile, tmpOutputMat, ttaOutputTile);
+                        if (augmentationIndex == ttaSize - 1) {
+                            cv::multiply(ttaOutputTile, 1.0 / ttaSize, ttaOutputTile);
+                            outputTile = &ttaOutputTile;
+                        }
+                    }
+                }
+
+                // Check if tile is fully rendered
+                if (!(!tta || augmentationIndex == ttaSize - 1))
+                    continue;
+
+                // Postprocess blending
+                if (overlapping)
+                    utils::applyTileWeights(*outputTile, *outputTile, outputTileRect, outputRect, weights);
+
+                // Add tile to output
+                cv::add((*outputTile)(cv::Rect2i(0, 0, outputTileRect.width, outputTileRect.height)),
+                    output(outputTileRect), output(outputTileRect));
+            }
+        });
+
+        // Log progress
+        const auto t1 = std::chrono::steady_clock::now();
+        const auto elapsed = utils::getElapsedMilliseconds(t0, t1);
+        logger.log(stepIndex / batchSize + 1, batchCount, 1000.0 / elapsed);
+    }
+
+    // Postprocess output
+    counters.measure(stageCounters[utils::Stage::Encode], [&] { output.convertTo(dst, CV_8UC3, 255.0); });
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(trt::error, "Render failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "img2img.h"
+#include "helper.h"
+#include "optimizer.h"
+#include "utilities/time.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+
+cv::Size2i getOutputSize(const cpu::Graph& graph, const cv::Size2i& inputSize) {
+    const auto shapes = cpu::inferShapes(graph, {1, 3, inputSize.height, inputSize.width});
+    const auto& shape = shapes.at(graph.outputs[0].name);
+    if (shape.size() != 4)
+        throw std::runtime_error("graph output is not an image");
+    return {static_cast<int>(shape[3]), static_cast<int>(shape[2])};
+}
+
+// Unpadded convolutions shrink the frame, so it is padded by replicating its border until the
+// output covers the scaled frame, the excess is cropped evenly from both sides
+void cpu::Img2Img::compileFrame(const cv::Size2i& size) {
+    constexpr auto bandHeight = 32;
+    const auto scaling = renderConfig.scaling;
+    const auto outputSize = getOutputSize(graph, size);
+    framePadding = cv::Point2i(
+        std::max(0, (size.width * scaling - outputSize.width + 2 * scaling - 1) / (2 * scaling)),
+        std::max(0, (size.height * scaling - outputSize.height + 2 * scaling - 1) / (2 * scaling))
+    );
+
+    const auto paddedSize = cv::Size2i(size.width + 2 * framePadding.x, size.height + 2 * framePadding.y);
+    const auto paddedOutputSize = getOutputSize(graph, paddedSize);
+    frameCrop = cv::Point2i(
+        (paddedOutputSize.width - size.width * scaling) / 2,
+        (paddedOutputSize.height - size.height * scaling) / 2
+    );
+    if (frameCrop.x < 0 || frameCrop.y < 0)
+        throw std::runtime_error("model output does not cover the scaled frame");
+
+    auto frameGraph = graph;
+    const BuildConfig config{1, 3, paddedSize.height, paddedSize.width, bandHeight};
+    optimizeGraph(frameGraph, {config.batchSize, config.channels, config.height, config.width});
+    model.load(Model::compile(frameGraph, config, getKernelType(cpuGetFeatures())));
+
+    const auto& header = model.getHeader();
+    if (model.getTensor(header.inputTensor).channels != 3 || model.getTensor(header.outputTensor).channels != 3)
+        throw std::runtime_error("model does not map RGB to RGB");
+    frameSize = size;
+}
+
+bool cpu::Img2Img::renderFrame(const cv::Mat& src, cv::Mat& dst) try {
+    if (src.type() != CV_8UC3) {
+        logger.LOG(trt::error, "Input image has invalid type: expected CV_8UC3, got " + std::to_string(src.type()) + ".");
+        return false;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    if (src.size() != frameSize) {
+        try {
+            compileFrame(src.size());
+        }
+        catch (const std::exception& e) {
+            logger.LOG(trt::error, "Failed to compile model for a " + std::to_string(src.cols) + "x"
+                + std::to_string(src.rows) + " frame: " + std::string(e.what()) + ".");
+            frameSize = cv::Size2i();
+            return false;
+        }
+    }
+
+    const auto& header = model.getHeader();
+    const auto inputWidth = model.getTensor(header.inputTensor).width;
+    output.create(src.rows * renderConfig.scaling, src.cols * renderConfig.scaling, CV_32FC3);
+
+    // Rows and columns of the padding replicate the border of the frame
+    const auto readRow = [&](int row, float* data, size_t) {
+        const auto* srcRow = src.ptr<uint8_t>(std::clamp(row - framePadding.y, 0, src.rows - 1));
+        for (int x = 0; x < inputWidth; ++x, data += blockSize) {
+            const auto* pixel = srcRow + std::clamp(x - framePadding.x, 0, src.cols - 1) * 3;
+            data[0] = static_cast<float>(pixel[2]) * (1.0f / 255.0f);
+            data[1] = static_cast<float>(pixel[1]) * (1.0f / 255.0f);
+            data[2] = static_cast<float>(pixel[0]) * (1.0f / 255.0f);
+            for (int c = 3; c < blockSize; ++c)
+                data[c] = 0.0f;
+        }
+    };
+    const auto writeRow = [&](int row, float* data, size_t) {
+        const auto y = row - frameCrop.y;
+        if (y < 0 || y >= output.rows)
+            return;
+        const auto* srcPixel = data + static_cast<size_t>(frameCrop.x) * blockSize;
+        auto* dstPixel = output.ptr<float>(y);
+        for (int x = 0; x < output.cols; ++x, srcPixel += blockSize, dstPixel += 3) {
+            dstPixel[0] = srcPixel[2];
+            dstPixel[1] = srcPixel[1];
+            dstPixel[2] = srcPixel[0];
+        }
+    };
+    // Packing and unpacking the bands is interleaved with the layers, all of it counts as convolution
+    ++stageCounters.tiles;
+    counters.measure(stageCounters[utils::Stage::Convolution], [&] { model.runStreamed(*pool, readRow, writeRow); });
+
+    counters.measure(stageCounters[utils::Stage::Encode], [&] { output.convertTo(dst, CV_8UC3, 255.0); });
+
+    const auto t1 = std::chrono::steady_clock::now();
+    logger.log(1, 1, 1000.0 / utils::getElapsedMilliseconds(t0, t1));
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(trt::error, "Render failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
\ No newline at end of file
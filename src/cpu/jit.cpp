@@ -0,0 +1,184 @@
+#include "jit.h"
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr int map0F = 1;     // 0F
+    constexpr int map0F38 = 2;   // 0F 38
+    constexpr int noPrefix = 0;
+    constexpr int prefix66 = 1;
+
+    int index(cpu::Reg reg) {
+        return static_cast<int>(reg);
+    }
+}
+
+cpu::JitEmitter::Label cpu::JitEmitter::label() const noexcept {
+    return code.size();
+}
+
+const std::vector<uint8_t>& cpu::JitEmitter::getCode() const noexcept {
+    return code;
+}
+
+void cpu::JitEmitter::emit(uint8_t byte) {
+    code.push_back(byte);
+}
+
+void cpu::JitEmitter::emit32(uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+        emit(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void cpu::JitEmitter::rex(bool wide, int reg, int rm) {
+    const auto byte = static_cast<uint8_t>(0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2) | (rm >> 3));
+    if (byte != 0x40)
+        emit(byte);
+}
+
+void cpu::JitEmitter::modrm(int reg, int rm) {
+    emit(static_cast<uint8_t>(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// Always uses an explicit displacement so rbp/r13 need no special case; rsp/r12 need a SIB byte
+void cpu::JitEmitter::modrm(int reg, const Mem& mem) {
+    const auto base = index(mem.base) & 7;
+    const bool shortDisp = mem.disp >= -128 && mem.disp <= 127;
+    emit(static_cast<uint8_t>((shortDisp ? 0x40 : 0x80) | ((reg & 7) << 3) | base));
+    if (base == 4)
+        emit(0x24);
+    if (shortDisp)
+        emit(static_cast<uint8_t>(static_cast<int8_t>(mem.disp)));
+    else
+        emit32(static_cast<uint32_t>(mem.disp));
+}
+
+void cpu::JitEmitter::vex(int map, int prefix, bool wide, bool ymm, int reg, int vvvv, int rm) {
+    emit(0xc4);
+    emit(static_cast<uint8_t>(((~reg >> 3) & 1) << 7 | 1 << 6 | ((~rm >> 3) & 1) << 5 | map));
+    emit(static_cast<uint8_t>((wide ? 0x80 : 0) | ((~vvvv & 15) << 3) | (ymm ? 0x04 : 0) | prefix));
+}
+
+void cpu::JitEmitter::vexOp(uint8_t opcode, int map, int prefix, bool ymm, int reg, int vvvv, int rm) {
+    vex(map, prefix, false, ymm, reg, vvvv, rm);
+    emit(opcode);
+    modrm(reg, rm);
+}
+
+void cpu::JitEmitter::vexOp(uint8_t opcode, int map, int prefix, bool ymm, int reg, int vvvv, const Mem& mem) {
+    vex(map, prefix, false, ymm, reg, vvvv, index(mem.base));
+    emit(opcode);
+    modrm(reg, mem);
+}
+
+void cpu::JitEmitter::push(Reg reg) {
+    rex(false, 0, index(reg));
+    emit(static_cast<uint8_t>(0x50 | (index(reg) & 7)));
+}
+
+void cpu::JitEmitter::pop(Reg reg) {
+    rex(false, 0, index(reg));
+    emit(static_cast<uint8_t>(0x58 | (index(reg) & 7)));
+}
+
+void cpu::JitEmitter::ret() {
+    emit(0xc3);
+}
+
+void cpu::JitEmitter::mov(Reg dst, Reg src) {
+    rex(true, index(src), index(dst));
+    emit(0x89);
+    modrm(index(src), index(dst));
+}
+
+void cpu::JitEmitter::mov(Reg dst, const Mem& src) {
+    rex(true, index(dst), index(src.base));
+    emit(0x8b);
+    modrm(index(dst), src);
+}
+
+void cpu::JitEmitter::mov(Reg dst, int32_t imm) {
+    rex(true, 0, index(dst));
+    emit(0xc7);
+    modrm(0, index(dst));
+    emit32(static_cast<uint32_t>(imm));
+}
+
+void cpu::JitEmitter::add(Reg dst, int32_t imm) {
+    rex(true, 0, index(dst));
+    emit(0x81);
+    modrm(0, index(dst));
+    emit32(static_cast<uint32_t>(imm));
+}
+
+void cpu::JitEmitter::sub(Reg dst, int32_t imm) {
+    rex(true, 0, index(dst));
+    emit(0x81);
+    modrm(5, index(dst));
+    emit32(static_cast<uint32_t>(imm));
+}
+
+void cpu::JitEmitter::dec(Reg dst) {
+    rex(true, 0, index(dst));
+    emit(0xff);
+    modrm(1, index(dst));
+}
+
+void cpu::JitEmitter::jnz(Label target) {
+    const auto rel = static_cast<int64_t>(target) - static_cast<int64_t>(code.size() + 6);
+    if (rel < std::numeric_limits<int32_t>::min())
+        throw std::runtime_error("jump target out of range");
+    emit(0x0f);
+    emit(0x85);
+    emit32(static_cast<uint32_t>(static_cast<int32_t>(rel)));
+}
+
+void cpu::JitEmitter::vmovups(int dst, const Mem& src) {
+    vexOp(0x10, map0F, noPrefix, true, dst, 0, src);
+}
+
+void cpu::JitEmitter::vmovups(const Mem& dst, int src) {
+    vexOp(0x11, map0F, noPrefix, true, src, 0, dst);
+}
+
+void cpu::JitEmitter::vmovupsXmm(int dst, const Mem& src) {
+    vexOp(0x10, map0F, noPrefix, false, dst, 0, src);
+}
+
+void cpu::JitEmitter::vmovupsXmm(const Mem& dst, int src) {
+    vexOp(0x11, map0F, noPrefix, false, src, 0, dst);
+}
+
+void cpu::JitEmitter::vbroadcastss(int dst, const Mem& src) {
+    vexOp(0x18, map0F38, prefix66, true, dst, 0, src);
+}
+
+void cpu::JitEmitter::vfmadd231ps(int dst, int src1, int src2) {
+    vexOp(0xb8, map0F38, prefix66, true, dst, src1, src2);
+}
+
+void cpu::JitEmitter::vaddps(int dst, int src1, int src2) {
+    vexOp(0x58, map0F, noPrefix, true, dst, src1, src2);
+}
+
+void cpu::JitEmitter::vmulps(int dst, int src1, int src2) {
+    vexOp(0x59, map0F, noPrefix, true, dst, src1, src2);
+}
+
+void cpu::JitEmitter::vmaxps(int dst, int src1, int src2) {
+    vexOp(0x5f, map0F, noPrefix, true, dst, src1, src2);
+}
+
+void cpu::JitEmitter::vminps(int dst, int src1, int src2) {
+    vexOp(0x5d, map0F, noPrefix, true, dst, src1, src2);
+}
+
+void cpu::JitEmitter::vxorps(int dst, int src1, int src2) {
+    vexOp(0x57, map0F, noPrefix, true, dst, src1, src2);
+}
+
+void cpu::JitEmitter::vzeroupper() {
+    emit(0xc5);
+    emit(0xf8);
+    emit(0x77);
+}
\ No newline at end of file
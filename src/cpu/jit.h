@@ -0,0 +1,66 @@
+#ifndef WAIFU2X_TENSORRT_CPU_JIT_H
+#define WAIFU2X_TENSORRT_CPU_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpu {
+    enum class Reg : uint8_t {
+        rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+        r8, r9, r10, r11, r12, r13, r14, r15
+    };
+
+    struct Mem {
+        Reg base;
+        int32_t disp = 0;
+    };
+
+    // Minimal x86-64 assembler for the instructions the generated kernels need; vector
+    // registers are given by index and always encoded as 256-bit ymm unless noted
+    class JitEmitter {
+    public:
+        using Label = size_t;
+
+        [[nodiscard]] Label label() const noexcept;
+        [[nodiscard]] const std::vector<uint8_t>& getCode() const noexcept;
+
+        void push(Reg reg);
+        void pop(Reg reg);
+        void ret();
+        void mov(Reg dst, Reg src);
+        void mov(Reg dst, const Mem& src);
+        void mov(Reg dst, int32_t imm);
+        void add(Reg dst, int32_t imm);
+        void sub(Reg dst, int32_t imm);
+        void dec(Reg dst);
+        void jnz(Label target);
+
+        void vmovups(int dst, const Mem& src);
+        void vmovups(const Mem& dst, int src);
+        void vmovupsXmm(int dst, const Mem& src);
+        void vmovupsXmm(const Mem& dst, int src);
+        void vbroadcastss(int dst, const Mem& src);
+        void vfmadd231ps(int dst, int src1, int src2);
+        void vaddps(int dst, int src1, int src2);
+        void vmulps(int dst, int src1, int src2);
+        void vmaxps(int dst, int src1, int src2);
+        void vminps(int dst, int src1, int src2);
+        void vxorps(int dst, int src1, int src2);
+        void vzeroupper();
+
+    private:
+        void emit(uint8_t byte);
+        void emit32(uint32_t value);
+        void rex(bool wide, int reg, int rm);
+        void modrm(int reg, int rm);
+        void modrm(int reg, const Mem& mem);
+        void vex(int map, int prefix, bool wide, bool ymm, int reg, int vvvv, int rm);
+        void vexOp(uint8_t opcode, int map, int prefix, bool ymm, int reg, int vvvv, int rm);
+        void vexOp(uint8_t opcode, int map, int prefix, bool ymm, int reg, int vvvv, const Mem& mem);
+
+        std::vector<uint8_t> code;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_JIT_H
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef WAIFU2X_TENSORRT_CPU_KERNELS_H
+#define WAIFU2X_TENSORRT_CPU_KERNELS_H
+
+#include "helper.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpu {
+    // Activations are stored channel-blocked as [C / 8][H][W][8] so that one SIMD register
+    // holds the same pixel of eight consecutive channels
+    constexpr int blockSize = 8;
+
+    [[nodiscard]]
+    static inline int getBlockCount(int channels) {
+        return (channels + blockSize - 1) / blockSize;
+    }
+
+    enum class KernelType : int32_t {
+        Generic,
+        Avx2,
+        Jit
+    };
+
+    // Picks the fastest kernel the given cpu features can run
+    [[nodiscard]]
+    static inline KernelType getKernelType(uint32_t cpuFeatures) {
+        return (cpuFeatures & AVX2) && (cpuFeatures & FMA) ? KernelType::Jit : KernelType::Generic;
+    }
+
+    [[nodiscard]]
+    static inline uint32_t getKernelFeatures(KernelType kernel) {
+        return kernel == KernelType::Generic ? 0 : AVX2 | FMA;
+    }
+
+    enum class Activation : int32_t {
+        None,
+        Relu,
+        LeakyRelu,
+        Sigmoid,
+        Clip
+    };
+
+    // Piecewise linear activations can be fused into the convolution epilogue
+    [[nodiscard]]
+    static inline bool isFusableActivation(Activation activation) {
+        return activation != Activation::Sigmoid;
+    }
+
+    [[nodiscard]]
+    static inline float activate(float x, Activation activation, float alpha, float beta) {
+        switch (activation) {
+            case Activation::Relu:
+                return std::max(x, 0.0f);
+            case Activation::LeakyRelu:
+                return x < 0.0f ? x * alpha : x;
+            case Activation::Clip:
+                return std::clamp(x, alpha, beta);
+            default:
+                return x;
+        }
+    }
+
+    struct ConvParams {
+        const float* src = nullptr;
+        float* dst = nullptr;
+        const float* weights = nullptr; // [OC / 8][KH][KW][IC][8]
+        const float* bias = nullptr;    // [OC / 8][8]
+
+        int inChannels = 0;
+        int srcHeight = 0;
+        int srcWidth = 0;
+        int srcOffsetY = 0;
+        int srcOffsetX = 0;
+
+        int outChannels = 0;
+        int outHeight = 0;
+        int outWidth = 0;
+
+        int kernelH = 1;
+        int kernelW = 1;
+        int strideH = 1;
+        int strideW = 1;
+
+        // Output pixel (y, x) is written to dst at (dstOffsetY + y * dstStrideY, dstOffsetX + x * dstStrideX),
+        // which lets the phases of a transposed convolution interleave into one tensor
+        int dstHeight = 0;
+        int dstWidth = 0;
+        int dstOffsetY = 0;
+        int dstOffsetX = 0;
+        int dstStrideY = 1;
+        int dstStrideX = 1;
+
+        // Applied before the store, alpha is the LeakyRelu slope or the Clip minimum, beta the Clip maximum
+        Activation activation = Activation::None;
+        float alpha = 0.0f;
+        float beta = 0.0f;
+
+        // Adds the activated outputs of every row to pool, [OC / 8][dstHeight][8], for the
+        // global average pool of a fused SE block
+        bool pooling = false;
+        float* pool = nullptr;
+    };
+
+    // Computes output rows [row0, row1) of output channel blocks [block0, block1)
+    void convGeneric(const ConvParams& params, int block0, int block1, int row0, int row1);
+    void convAvx2(const ConvParams& params, int block0, int block1, int row0, int row1);
+
+    // Generated kernels compute one output row of a fixed number of channel blocks; src points
+    // at the first input pixel read for that row, dst at the first output pixel of the first block
+    struct JitConvArgs {
+        const float* src;
+        float* dst;
+        const float* weights;
+        const float* bias;
+        const float* activation; // alpha, beta
+        float* pool;             // channel sums of the row for the first block
+    };
+
+    using JitConvFunction = void (*)(const JitConvArgs* args);
+
+    struct JitConvBlocking {
+        int blocks = 1;
+        int pixels = 1;
+        int tailBlocks = 0; // channel blocks left over after the last full group
+        int tailPixels = 0;
+    };
+
+    // Picks the register tile (channel blocks x output pixels) with the lowest estimated cost
+    JitConvBlocking chooseConvJitBlocking(const ConvParams& params);
+    // Emits position independent AVX2 code with every shape parameter of params baked in
+    std::vector<uint8_t> generateConvJit(const ConvParams& params, int blocks, int pixels);
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_KERNELS_H
\ No newline at end of file
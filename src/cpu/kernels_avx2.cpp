@@ -0,0 +1,115 @@
+#include "kernels.h"
+#include "helper.h"
+#include <immintrin.h>
+#include <algorithm>
+
+CPU_TARGET_AVX2
+static inline __m256 activateAvx2(__m256 x, const cpu::ConvParams& p) {
+    switch (p.activation) {
+        case cpu::Activation::Relu:
+            return _mm256_max_ps(x, _mm256_setzero_ps());
+        case cpu::Activation::LeakyRelu:
+            return _mm256_blendv_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(p.alpha)),
+                _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+        case cpu::Activation::Clip:
+            return _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(p.alpha)), _mm256_set1_ps(p.beta));
+        default:
+            return x;
+    }
+}
+
+// Computes a register tile of RX output pixels by OCB output channel blocks
+template<int OCB, int RX>
+CPU_TARGET_AVX2
+static inline void convTileAvx2(const cpu::ConvParams& p, int block, int y, int x) {
+    using cpu::blockSize;
+    const auto srcPlane = static_cast<size_t>(p.srcHeight) * p.srcWidth * blockSize;
+    const auto weightBlock = static_cast<size_t>(p.inChannels) * p.kernelH * p.kernelW * blockSize;
+    const int iy = p.srcOffsetY + y * p.strideH;
+    const int ix = p.srcOffsetX + x * p.strideW;
+    const int pixelStride = p.strideW * blockSize;
+
+    __m256 acc[OCB][RX];
+    CPU_UNROLL
+    for (int o = 0; o < OCB; ++o) {
+        const auto bias = _mm256_loadu_ps(p.bias + (block + o) * blockSize);
+        CPU_UNROLL
+        for (int r = 0; r < RX; ++r)
+            acc[o][r] = bias;
+    }
+
+    const float* w = p.weights + block * weightBlock;
+    for (int ky = 0; ky < p.kernelH; ++ky) {
+        for (int kx = 0; kx < p.kernelW; ++kx) {
+            const float* src = p.src + (static_cast<size_t>(iy + ky) * p.srcWidth + ix + kx) * blockSize;
+            for (int ic = 0; ic < p.inChannels; ic += blockSize) {
+                const int lanes = std::min(blockSize, p.inChannels - ic);
+                for (int l = 0; l < lanes; ++l) {
+                    __m256 weights[OCB];
+                    CPU_UNROLL
+                    for (int o = 0; o < OCB; ++o)
+                        weights[o] = _mm256_loadu_ps(w + o * weightBlock);
+                    CPU_UNROLL
+                    for (int r = 0; r < RX; ++r) {
+                        const auto v = _mm256_broadcast_ss(src + r * pixelStride + l);
+                        CPU_UNROLL
+                        for (int o = 0; o < OCB; ++o)
+                            acc[o][r] = _mm256_fmadd_ps(v, weights[o], acc[o][r]);
+                    }
+                    w += blockSize;
+                }
+                src += srcPlane;
+            }
+        }
+    }
+
+    const auto dstPlane = static_cast<size_t>(p.dstHeight) * p.dstWidth * blockSize;
+    float* dst = p.dst + block * dstPlane + (static_cast<size_t>(p.dstOffsetY + y * p.dstStrideY) * p.dstWidth
+        + p.dstOffsetX + static_cast<size_t>(x) * p.dstStrideX) * blockSize;
+    CPU_UNROLL
+    for (int o = 0; o < OCB; ++o) {
+        auto sum = _mm256_setzero_ps();
+        CPU_UNROLL
+        for (int r = 0; r < RX; ++r) {
+            const auto value = activateAvx2(acc[o][r], p);
+            _mm256_storeu_ps(dst + o * dstPlane + static_cast<size_t>(r) * p.dstStrideX * blockSize, value);
+            sum = _mm256_add_ps(sum, value);
+        }
+        if (p.pooling) {
+            float* pool = p.pool + (static_cast<size_t>(block + o) * p.dstHeight + p.dstOffsetY + y * p.dstStrideY) * blockSize;
+            _mm256_storeu_ps(pool, _mm256_add_ps(_mm256_loadu_ps(pool), sum));
+        }
+    }
+}
+
+template<int OCB, int RX>
+CPU_TARGET_AVX2
+static inline void convTailAvx2(const cpu::ConvParams& p, int block, int y, int x, int remaining) {
+    if constexpr (RX > 0) {
+        if (remaining == RX)
+            convTileAvx2<OCB, RX>(p, block, y, x);
+        else
+            convTailAvx2<OCB, RX - 1>(p, block, y, x, remaining);
+    }
+}
+
+template<int OCB, int RX>
+CPU_TARGET_AVX2
+static void convRowAvx2(const cpu::ConvParams& p, int block, int y) {
+    int x = 0;
+    for (; x + RX <= p.outWidth; x += RX)
+        convTileAvx2<OCB, RX>(p, block, y, x);
+    convTailAvx2<OCB, RX - 1>(p, block, y, x, p.outWidth - x);
+}
+
+// 2 x 6 accumulators + 2 weights + 1 broadcast fit in the 16 ymm registers
+CPU_TARGET_AVX2
+void cpu::convAvx2(const ConvParams& p, int block0, int block1, int row0, int row1) {
+    for (int y = row0; y < row1; ++y) {
+        int block = block0;
+        for (; block + 2 <= block1; block += 2)
+            convRowAvx2<2, 6>(p, block, y);
+        if (block < block1)
+            convRowAvx2<1, 12>(p, block, y);
+    }
+}
\ No newline at end of file
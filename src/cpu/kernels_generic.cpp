@@ -0,0 +1,47 @@
+#include "kernels.h"
+
+void cpu::convGeneric(const ConvParams& p, int block0, int block1, int row0, int row1) {
+    const auto srcPlane = static_cast<size_t>(p.srcHeight) * p.srcWidth * blockSize;
+    const auto dstPlane = static_cast<size_t>(p.dstHeight) * p.dstWidth * blockSize;
+    const auto weightBlock = static_cast<size_t>(p.inChannels) * p.kernelH * p.kernelW * blockSize;
+
+    for (int block = block0; block < block1; ++block) {
+        const float* weights = p.weights + block * weightBlock;
+        float* dstPlanePtr = p.dst + block * dstPlane;
+
+        for (int y = row0; y < row1; ++y) {
+            const int iy = p.srcOffsetY + y * p.strideH;
+            const int dy = p.dstOffsetY + y * p.dstStrideY;
+            float* dstRow = dstPlanePtr + (static_cast<size_t>(dy) * p.dstWidth + p.dstOffsetX) * blockSize;
+            float* poolRow = p.pooling ? p.pool + (static_cast<size_t>(block) * p.dstHeight + dy) * blockSize : nullptr;
+
+            for (int x = 0; x < p.outWidth; ++x) {
+                const int ix = p.srcOffsetX + x * p.strideW;
+                float acc[blockSize];
+                for (int l = 0; l < blockSize; ++l)
+                    acc[l] = p.bias[block * blockSize + l];
+
+                const float* w = weights;
+                for (int ky = 0; ky < p.kernelH; ++ky) {
+                    for (int kx = 0; kx < p.kernelW; ++kx) {
+                        const float* src = p.src + (static_cast<size_t>(iy + ky) * p.srcWidth + ix + kx) * blockSize;
+                        for (int ic = 0; ic < p.inChannels; ++ic) {
+                            const float v = src[(ic / blockSize) * srcPlane + ic % blockSize];
+                            for (int l = 0; l < blockSize; ++l)
+                                acc[l] += v * w[l];
+                            w += blockSize;
+                        }
+                    }
+                }
+
+                float* dst = dstRow + static_cast<size_t>(x) * p.dstStrideX * blockSize;
+                for (int l = 0; l < blockSize; ++l)
+                    dst[l] = activate(acc[l], p.activation, p.alpha, p.beta);
+                if (poolRow) {
+                    for (int l = 0; l < blockSize; ++l)
+                        poolRow[l] += dst[l];
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "kernels.h"
+#include "jit.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    using cpu::Reg;
+    using cpu::Mem;
+
+    constexpr int registerCount = 16;
+    constexpr int floatBytes = sizeof(float);
+    constexpr int pixelBytes = cpu::blockSize * floatBytes;
+
+    int32_t checked(int64_t value) {
+        if (value < std::numeric_limits<int32_t>::min() || value > std::numeric_limits<int32_t>::max())
+            throw std::runtime_error("layer is too large for generated code");
+        return static_cast<int32_t>(value);
+    }
+
+    // Cycles per input channel for a register tile on a two FMA port core: bounded by FMA
+    // throughput, by loads (weights plus broadcasts) and by the four cycle FMA latency
+    double getTileCost(int blocks, int pixels) {
+        return std::max({blocks * pixels / 2.0, (blocks + pixels) / 2.0, 4.0});
+    }
+
+    double getRowCost(const cpu::ConvParams& p, int blocks, int pixels) {
+        const auto tail = p.outWidth % pixels;
+        return p.outWidth / pixels * getTileCost(blocks, pixels) + (tail ? getTileCost(blocks, tail) : 0.0);
+    }
+
+    int getMaxPixels(int blocks) {
+        return (registerCount - 1 - blocks) / blocks;
+    }
+
+    int getBestPixels(const cpu::ConvParams& p, int blocks) {
+        int best = 1;
+        for (int pixels = 2; pixels <= getMaxPixels(blocks); ++pixels) {
+            if (getRowCost(p, blocks, pixels) <= getRowCost(p, blocks, best))
+                best = pixels;
+        }
+        return best;
+    }
+
+    // Register and memory layout of the generated code:
+    //   r8 src of the current pixel tile, r9 dst of the current pixel tile, r10 weights, r11 bias,
+    //   rbx/rbp src/weights at the current kernel row, r12/r13 src/weights at the current channel
+    //   block, r14 kernel row counter, r15 channel block counter, rax pixel tile counter,
+    //   rdx activation parameters, rsi channel sums of the row
+    struct ConvGenerator {
+        const cpu::ConvParams& p;
+        int blocks;
+        cpu::JitEmitter e;
+
+        int acc(int block, int pixel) const {
+            return block * getMaxPixels(blocks) + pixel;
+        }
+
+        int weight(int block) const {
+            return registerCount - 1 - blocks + block;
+        }
+
+        static int broadcast() {
+            return registerCount - 1;
+        }
+
+        void emitChannels(int pixels, int lanes) {
+            const auto weightBlock = static_cast<int64_t>(p.kernelH) * p.kernelW * p.inChannels * pixelBytes;
+            for (int kx = 0; kx < p.kernelW; ++kx) {
+                for (int l = 0; l < lanes; ++l) {
+                    for (int o = 0; o < blocks; ++o)
+                        e.vmovups(weight(o), Mem{Reg::r13, checked(o * weightBlock + (static_cast<int64_t>(kx) * p.inChannels + l) * pixelBytes)});
+                    for (int r = 0; r < pixels; ++r) {
+                        e.vbroadcastss(broadcast(), Mem{Reg::r12, checked((static_cast<int64_t>(r) * p.strideW + kx) * pixelBytes + l * floatBytes)});
+                        for (int o = 0; o < blocks; ++o)
+                            e.vfmadd231ps(acc(o, r), weight(o), broadcast());
+                    }
+                }
+            }
+        }
+
+        void emitTile(int pixels) {
+            for (int o = 0; o < blocks; ++o) {
+                for (int r = 0; r < pixels; ++r)
+                    e.vmovups(acc(o, r), Mem{Reg::r11, o * pixelBytes});
+            }
+
+            e.mov(Reg::rbx, Reg::r8);
+            e.mov(Reg::rbp, Reg::r10);
+            if (p.kernelH > 1)
+                e.mov(Reg::r14, p.kernelH);
+            const auto rowLoop = e.label();
+            e.mov(Reg::r12, Reg::rbx);
+            e.mov(Reg::r13, Reg::rbp);
+
+            const auto fullBlocks = p.inChannels / cpu::blockSize;
+            const auto remainingLanes = p.inChannels % cpu::blockSize;
+            const auto srcPlane = checked(static_cast<int64_t>(p.srcHeight) * p.srcWidth * pixelBytes);
+            if (fullBlocks > 0) {
+                if (fullBlocks > 1)
+                    e.mov(Reg::r15, fullBlocks);
+                const auto channelLoop = e.label();
+                emitChannels(pixels, cpu::blockSize);
+                if (fullBlocks > 1 || remainingLanes) {
+                    e.add(Reg::r12, srcPlane);
+                    e.add(Reg::r13, cpu::blockSize * pixelBytes);
+                }
+                if (fullBlocks > 1) {
+                    e.dec(Reg::r15);
+                    e.jnz(channelLoop);
+                }
+            }
+            if (remainingLanes)
+                emitChannels(pixels, remainingLanes);
+
+            if (p.kernelH > 1) {
+                e.add(Reg::rbx, checked(static_cast<int64_t>(p.srcWidth) * pixelBytes));
+                e.add(Reg::rbp, checked(static_cast<int64_t>(p.kernelW) * p.inChannels * pixelBytes));
+                e.dec(Reg::r14);
+                e.jnz(rowLoop);
+            }
+
+            emitActivation(pixels);
+            const auto dstPlane = static_cast<int64_t>(p.dstHeight) * p.dstWidth * pixelBytes;
+            for (int o = 0; o < blocks; ++o) {
+                for (int r = 0; r < pixels; ++r)
+                    e.vmovups(Mem{Reg::r9, checked(o * dstPlane + static_cast<int64_t>(r) * p.dstStrideX * pixelBytes)}, acc(o, r));
+            }
+            if (p.pooling)
+                emitPooling(pixels);
+        }
+
+        // Adds the stored tile to the channel sums of the row; rsi points at the sums of the first block
+        void emitPooling(int pixels) {
+            const auto sum = broadcast();
+            for (int o = 0; o < blocks; ++o) {
+                const Mem pool{Reg::rsi, checked(static_cast<int64_t>(o) * p.dstHeight * pixelBytes)};
+                e.vmovups(sum, pool);
+                for (int r = 0; r < pixels; ++r)
+                    e.vaddps(sum, sum, acc(o, r));
+                e.vmovups(pool, sum);
+            }
+        }
+
+        // The weight and broadcast registers are free once the accumulation is done;
+        // rdx points at the activation parameters
+        void emitActivation(int pixels) {
+            const auto first = broadcast();
+            const auto second = weight(0);
+            switch (p.activation) {
+                case cpu::Activation::Relu:
+                    e.vxorps(first, first, first);
+                    break;
+                case cpu::Activation::LeakyRelu:
+                    e.vbroadcastss(first, Mem{Reg::rdx, 0});
+                    break;
+                case cpu::Activation::Clip:
+                    e.vbroadcastss(first, Mem{Reg::rdx, 0});
+                    e.vbroadcastss(second, Mem{Reg::rdx, floatBytes});
+                    break;
+                default:
+                    return;
+            }
+
+            for (int o = 0; o < blocks; ++o) {
+                for (int r = 0; r < pixels; ++r) {
+                    const auto x = acc(o, r);
+                    if (p.activation == cpu::Activation::Relu) {
+                        e.vmaxps(x, x, first);
+                    } else if (p.activation == cpu::Activation::LeakyRelu) {
+                        // max(x, alpha * x) for slopes up to one, min(x, alpha * x) above
+                        e.vmulps(second, x, first);
+                        if (p.alpha <= 1.0f)
+                            e.vmaxps(x, x, second);
+                        else
+                            e.vminps(x, x, second);
+                    } else {
+                        e.vmaxps(x, x, first);
+                        e.vminps(x, x, second);
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> generate(int pixels) {
+            const Reg saved[] = {
+                Reg::rbx, Reg::rbp, Reg::r12, Reg::r13, Reg::r14, Reg::r15,
+#if defined(_WIN32) || defined(_WIN64)
+                Reg::rsi, Reg::rdi
+#endif
+            };
+            for (const auto reg : saved)
+                e.push(reg);
+#if defined(_WIN32) || defined(_WIN64)
+            // xmm6-xmm15 are callee-saved on Windows
+            constexpr int savedXmm = 10;
+            e.sub(Reg::rsp, savedXmm * 16 + 8);
+            for (int i = 0; i < savedXmm; ++i)
+                e.vmovupsXmm(Mem{Reg::rsp, i * 16}, 6 + i);
+            const auto args = Reg::rcx;
+#else
+            const auto args = Reg::rdi;
+#endif
+            e.mov(Reg::r8, Mem{args, offsetof(cpu::JitConvArgs, src)});
+            e.mov(Reg::r9, Mem{args, offsetof(cpu::JitConvArgs, dst)});
+            e.mov(Reg::r10, Mem{args, offsetof(cpu::JitConvArgs, weights)});
+            e.mov(Reg::r11, Mem{args, offsetof(cpu::JitConvArgs, bias)});
+            if (p.activation != cpu::Activation::None)
+                e.mov(Reg::rdx, Mem{args, offsetof(cpu::JitConvArgs, activation)});
+            if (p.pooling)
+                e.mov(Reg::rsi, Mem{args, offsetof(cpu::JitConvArgs, pool)});
+
+            const auto tiles = p.outWidth / pixels;
+            const auto tail = p.outWidth % pixels;
+            if (tiles > 0) {
+                if (tiles > 1)
+                    e.mov(Reg::rax, tiles);
+                const auto tileLoop = e.label();
+                emitTile(pixels);
+                if (tiles > 1 || tail) {
+                    e.add(Reg::r8, checked(static_cast<int64_t>(pixels) * p.strideW * pixelBytes));
+                    e.add(Reg::r9, checked(static_cast<int64_t>(pixels) * p.dstStrideX * pixelBytes));
+                }
+                if (tiles > 1) {
+                    e.dec(Reg::rax);
+                    e.jnz(tileLoop);
+                }
+            }
+            if (tail)
+                emitTile(tail);
+
+#if defined(_WIN32) || defined(_WIN64)
+            for (int i = 0; i < savedXmm; ++i)
+                e.vmovupsXmm(6 + i, Mem{Reg::rsp, i * 16});
+            e.add(Reg::rsp, savedXmm * 16 + 8);
+#endif
+            for (auto it = std::rbegin(saved); it != std::rend(saved); ++it)
+                e.pop(*it);
+            e.vzeroupper();
+            e.ret();
+            return e.getCode();
+        }
+    };
+}
+
+cpu::JitConvBlocking cpu::chooseConvJitBlocking(const ConvParams& params) {
+    const auto blockCount = getBlockCount(params.outChannels);
+    JitConvBlocking best;
+    auto bestCost = std::numeric_limits<double>::max();
+    for (int blocks = 1; blocks <= std::min(4, blockCount); ++blocks) {
+        const auto tailBlocks = blockCount % blocks;
+        const auto tailPixels = tailBlocks ? getBestPixels(params, tailBlocks) : 0;
+        const auto tailCost = tailBlocks ? getRowCost(params, tailBlocks, tailPixels) : 0.0;
+        for (int pixels = 1; pixels <= getMaxPixels(blocks); ++pixels) {
+            const auto cost = blockCount / blocks * getRowCost(params, blocks, pixels) + tailCost;
+            if (cost < bestCost || (cost == bestCost && blocks * pixels > best.blocks * best.pixels)) {
+                bestCost = cost;
+                best = {blocks, pixels, tailBlocks, tailPixels};
+            }
+        }
+    }
+    return best;
+}
+
+std::vector<uint8_t> cpu::generateConvJit(const ConvParams& params, int blocks, int pixels) {
+    if (blocks < 1 || pixels < 1 || pixels > getMaxPixels(blocks))
+        throw std::runtime_error("invalid register blocking");
+    if (!isFusableActivation(params.activation))
+        throw std::runtime_error("activation cannot be fused into generated code");
+    ConvGenerator generator{params, blocks, {}};
+    return generator.generate(std::min(pixels, params.outWidth));
+}
\ No newline at end of file
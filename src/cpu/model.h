@@ -0,0 +1,186 @@
+#ifndef WAIFU2X_TENSORRT_CPU_MODEL_H
+#define WAIFU2X_TENSORRT_CPU_MODEL_H
+
+#include "config.h"
+#include "graph.h"
+#include "kernels.h"
+#include "utilities/mmap.h"
+#include "utilities/threadpool.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cpu {
+    // Compiled model image, written once by build and mapped read-only by load:
+    // [ModelHeader][TensorDesc...][LayerDesc...][packed weights, 64 byte aligned][generated code]
+    constexpr char modelMagic[8] = {'W', '2', 'X', 'C', 'P', 'U', '\0', '\0'};
+    constexpr uint32_t modelVersion = 5;
+    constexpr size_t modelAlignment = 64;
+
+    enum class LayerType : int32_t {
+        Conv,
+        Activation,
+        SqueezeExcitation,
+        Add
+    };
+
+    struct ModelHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t cpuFeatures;
+        int32_t batchSize;
+        int32_t channels;
+        int32_t height;
+        int32_t width;
+        int32_t bandHeight; // input rows per pass of streamed execution, 0 for a fixed tile
+        int32_t inputTensor;
+        int32_t outputTensor;
+        uint32_t tensorCount;
+        uint32_t layerCount;
+        uint64_t tensorsOffset;
+        uint64_t layersOffset;
+        uint64_t weightsOffset;
+        uint64_t weightsSize;
+        uint64_t codeOffset;
+        uint64_t codeSize;
+        uint64_t arenaSize;
+    };
+
+    // Activation memory plan entry, offsets are in bytes into the arena. Streamed models keep a
+    // rolling buffer of height rows out of the rows of the whole frame.
+    struct TensorDesc {
+        int32_t channels;
+        int32_t height;
+        int32_t width;
+        int32_t rows;
+        uint64_t offset;
+        uint64_t size; // bytes per batch item
+    };
+
+    // Conv layers apply their activation before storing the output. SqueezeExcitation layers
+    // squeeze inChannels to outChannels, keep both FC layers in one weights block and write the
+    // per-channel scales to output instead of scaling their input. Add layers read input and
+    // input2 through their src offsets, which is how crops of skip connections are compiled.
+    struct LayerDesc {
+        LayerType type;
+        KernelType kernel;
+        Activation activation;
+        int32_t input;
+        int32_t output;
+        int32_t input2;
+
+        // Channel sums of every output row, [C / 8][H][8], accumulated for a SqueezeExcitation
+        // layer; the first producer of the tensor clears them. Unused tensor ids are -1.
+        int32_t poolTensor;
+        int32_t clearPool;
+        // Per-channel scales of a SqueezeExcitation layer applied while reading input and input2.
+        // Conv layers fold them into a copy of their weights in scratchTensor.
+        int32_t scaleTensor;
+        int32_t scale2Tensor;
+        int32_t scratchTensor;
+
+        int32_t inChannels;
+        int32_t outChannels;
+        int32_t kernelH;
+        int32_t kernelW;
+        int32_t strideH;
+        int32_t strideW;
+        int32_t srcOffsetY;
+        int32_t srcOffsetX;
+        int32_t src2OffsetY;
+        int32_t src2OffsetX;
+        int32_t outHeight;
+        int32_t outWidth;
+        int32_t dstOffsetY;
+        int32_t dstOffsetX;
+        int32_t dstStrideY;
+        int32_t dstStrideX;
+
+        float alpha;
+        float beta;
+        uint64_t weightsOffset; // bytes into the weights section
+        uint64_t biasOffset;
+
+        // Generated kernels, used when kernel is KernelType::Jit
+        int32_t jitBlocks;
+        int32_t jitPixels;
+        int32_t jitTailBlocks;
+        int32_t jitTailPixels;
+        uint64_t jitOffset; // bytes into the code section
+        uint64_t jitTailOffset;
+    };
+
+    [[nodiscard]] ConvParams getConvParams(const LayerDesc& layer, const TensorDesc& input, const TensorDesc& output);
+
+    struct StreamCallbacks {
+        std::function<void(int row0, int row1)> read;             // input rows
+        std::function<void(int layer, int row0, int row1)> run;   // output rows of a layer
+        std::function<void(int row0, int row1)> write;            // finished output rows
+        std::function<void(int tensor, int rows, int keep)> drop; // first rows of a buffer, keep follow them
+    };
+
+    // Row schedule of streamed execution: every pass reads up to bandHeight more input rows, runs
+    // each layer over all rows its inputs allow, writes the finished output rows and drops the rows
+    // no consumer needs anymore. Returns the most rows every tensor buffer had to hold, compile
+    // runs it without callbacks to size the buffers.
+    std::vector<int> scheduleStream(const LayerDesc* layers, int layerCount, const TensorDesc* tensors,
+        int tensorCount, int inputTensor, int outputTensor, int bandHeight, const StreamCallbacks& callbacks);
+
+    // Called from several threads at once with a row of a streamed input or output tensor, whose
+    // channel blocks are planeSize floats apart
+    using RowCallback = std::function<void(int row, float* data, size_t planeSize)>;
+
+    class Model {
+    public:
+        Model();
+        virtual ~Model();
+
+        // Lowers the graph for a fixed input shape: picks a kernel per layer, packs the
+        // weights into the blocked layout, generates code and plans the activation arena.
+        // A band height compiles for streamed execution over a whole frame of that shape.
+        static std::vector<char> compile(const Graph& graph, const BuildConfig& config, KernelType kernel);
+
+        void load(const std::string& path);
+        void load(std::vector<char> image);
+        // Faults in the pages of a mapped model, the arena is already touched by load
+        void prefault() const;
+        // The arena region of the input tensor is reused by later layers, so the input has
+        // to be written again before every run
+        void run(utils::ThreadPool& pool);
+        void runLayer(int index, utils::ThreadPool& pool);
+        // Runs a streamed model over the whole frame, every output pixel is computed once
+        void runStreamed(utils::ThreadPool& pool, const RowCallback& readRow, const RowCallback& writeRow);
+
+        [[nodiscard]] const ModelHeader& getHeader() const;
+        [[nodiscard]] const TensorDesc& getTensor(int index) const;
+        [[nodiscard]] const LayerDesc& getLayer(int index) const;
+        [[nodiscard]] float* getTensorData(int index, int batchIndex);
+
+    private:
+        void attach(const char* base, size_t size);
+        void runLayer(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool);
+        void runConv(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool);
+        void runActivation(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool);
+        void runSqueezeExcitation(const LayerDesc& layer, utils::ThreadPool& pool);
+        void runAdd(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool);
+        [[nodiscard]] float* getRow(int tensor, int batchIndex, int row);
+
+        struct ArenaDeleter {
+            void operator()(float* ptr) const;
+        };
+
+        utils::MappedFile file;
+        std::vector<char> image;
+        const ModelHeader* header = nullptr;
+        const TensorDesc* tensors = nullptr;
+        const LayerDesc* layers = nullptr;
+        const char* weights = nullptr;
+        utils::ExecutableMemory code;
+        std::unique_ptr<float, ArenaDeleter> arena;
+        std::vector<int> tensorBases; // first frame row held by the buffer of every tensor
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_MODEL_H
\ No newline at end of file
@@ -0,0 +1,634 @@
+#include "model.h"
+#include "helper.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+struct CompiledTensor {
+    cpu::TensorDesc desc{};
+    int firstLayer = std::numeric_limits<int>::max();
+    int lastLayer = -1;
+};
+
+// Value that is not materialized: a crop of a tensor, optionally scaled per channel by the
+// output of a SqueezeExcitation layer
+struct TensorView {
+    int tensor = -1;
+    int offsetY = 0;
+    int offsetX = 0;
+    int scale = -1;
+};
+
+struct ModelCompiler {
+    const cpu::Graph& graph;
+    const cpu::BuildConfig& config;
+    cpu::KernelType kernel;
+    std::map<std::string, cpu::Shape> shapes;
+    std::map<std::string, int> tensorIds;
+    std::map<std::string, TensorView> views;
+    std::vector<CompiledTensor> tensors;
+    std::vector<cpu::LayerDesc> layers;
+    std::vector<float> weights;
+    std::vector<uint8_t> code;
+
+    int addTensor(int channels, int height, int width) {
+        CompiledTensor tensor;
+        tensor.desc.channels = channels;
+        tensor.desc.height = height;
+        tensor.desc.width = width;
+        tensor.desc.rows = height;
+        tensor.desc.size = static_cast<uint64_t>(cpu::getBlockCount(channels)) * height * width
+            * cpu::blockSize * sizeof(float);
+        tensors.push_back(tensor);
+        return static_cast<int>(tensors.size()) - 1;
+    }
+
+    int getTensorId(const std::string& name) {
+        if (views.find(name) != views.end())
+            throw std::runtime_error("value \"" + name + "\" is cropped or scaled and can only be read by "
+                "Conv, ConvTranspose and Add");
+        const auto it = tensorIds.find(name);
+        if (it != tensorIds.end())
+            return it->second;
+
+        const auto& shape = shapes.at(name);
+        const auto id = addTensor(static_cast<int>(shape[1]), static_cast<int>(shape[2]), static_cast<int>(shape[3]));
+        tensorIds[name] = id;
+        return id;
+    }
+
+    TensorView getView(const std::string& name) {
+        const auto it = views.find(name);
+        return it != views.end() ? it->second : TensorView{getTensorId(name)};
+    }
+
+    const cpu::Tensor& getConstant(const cpu::Node& node, int index) const {
+        if (index >= node.inputs.size())
+            throw std::runtime_error("node \"" + node.name + "\" is missing input " + std::to_string(index));
+        const auto* constant = graph.findConstant(node.inputs[index]);
+        if (!constant || constant->type != cpu::DataType::Float)
+            throw std::runtime_error("input " + std::to_string(index) + " of node \"" + node.name
+                + "\" must be a float constant");
+        return *constant;
+    }
+
+    uint64_t appendWeights(const std::vector<float>& data) {
+        constexpr auto alignment = cpu::modelAlignment / sizeof(float);
+        weights.resize((weights.size() + alignment - 1) / alignment * alignment);
+        const auto offset = weights.size() * sizeof(float);
+        weights.insert(weights.end(), data.begin(), data.end());
+        return offset;
+    }
+
+    uint64_t appendBias(const cpu::Node& node, int outChannels) {
+        std::vector<float> bias(cpu::getBlockCount(outChannels) * cpu::blockSize, 0.0f);
+        if (node.inputs.size() > 2 && !node.inputs[2].empty()) {
+            const auto& b = getConstant(node, 2);
+            std::copy(b.floats.begin(), b.floats.end(), bias.begin());
+        }
+        return appendWeights(bias);
+    }
+
+    // Reads the first input through its view, the output is left to the caller
+    cpu::LayerDesc createLayer(cpu::LayerType type, const cpu::Node& node) {
+        cpu::LayerDesc layer{};
+        layer.type = type;
+        layer.kernel = kernel;
+        layer.activation = cpu::Activation::None;
+        const auto input = getView(node.inputs[0]);
+        layer.input = input.tensor;
+        layer.srcOffsetY = input.offsetY;
+        layer.srcOffsetX = input.offsetX;
+        layer.scaleTensor = input.scale;
+        layer.output = layer.input2 = -1;
+        layer.poolTensor = layer.scale2Tensor = layer.scratchTensor = -1;
+        layer.strideH = layer.strideW = 1;
+        layer.dstStrideY = layer.dstStrideX = 1;
+        return layer;
+    }
+
+    // Scaled inputs are folded into a per-batch copy of the weights before the conv runs
+    void addScratchWeights(cpu::LayerDesc& layer) {
+        if (layer.scaleTensor < 0)
+            return;
+        layer.scratchTensor = addTensor(0, 0, 0);
+        tensors[layer.scratchTensor].desc.size = static_cast<uint64_t>(cpu::getBlockCount(layer.outChannels))
+            * layer.inChannels * layer.kernelH * layer.kernelW * cpu::blockSize * sizeof(float);
+    }
+
+    static void checkConvAttributes(const cpu::Node& node) {
+        if (node.getInt("group", 1) != 1)
+            throw std::runtime_error("grouped convolution in node \"" + node.name + "\" is not supported");
+        for (const auto dilation : node.getInts("dilations", {1, 1})) {
+            if (dilation != 1)
+                throw std::runtime_error("dilated convolution in node \"" + node.name + "\" is not supported");
+        }
+        const auto autoPad = node.attributes.find("auto_pad");
+        if (autoPad != node.attributes.end() && autoPad->second.s != "NOTSET")
+            throw std::runtime_error("auto_pad in node \"" + node.name + "\" is not supported");
+    }
+
+    // Conv weights [OC][IC][KH][KW] -> [OC / 8][KH][KW][IC][8]
+    void addConv(const cpu::Node& node) {
+        checkConvAttributes(node);
+        for (const auto pad : node.getInts("pads", {0, 0, 0, 0})) {
+            if (pad != 0)
+                throw std::runtime_error("padded convolution in node \"" + node.name + "\" is not supported");
+        }
+
+        const auto& w = getConstant(node, 1);
+        const auto outChannels = static_cast<int>(w.dims[0]);
+        const auto inChannels = static_cast<int>(w.dims[1]);
+        const auto kernelH = static_cast<int>(w.dims[2]);
+        const auto kernelW = static_cast<int>(w.dims[3]);
+        const auto strides = node.getInts("strides", {1, 1});
+
+        std::vector<float> packed(static_cast<size_t>(cpu::getBlockCount(outChannels)) * inChannels
+            * kernelH * kernelW * cpu::blockSize, 0.0f);
+        for (int oc = 0; oc < outChannels; ++oc) {
+            for (int ic = 0; ic < inChannels; ++ic) {
+                for (int ky = 0; ky < kernelH; ++ky) {
+                    for (int kx = 0; kx < kernelW; ++kx) {
+                        const auto src = ((static_cast<size_t>(oc) * inChannels + ic) * kernelH + ky) * kernelW + kx;
+                        const auto dst = ((((static_cast<size_t>(oc / cpu::blockSize) * kernelH + ky)
+                            * kernelW + kx) * inChannels + ic) * cpu::blockSize) + oc % cpu::blockSize;
+                        packed[dst] = w.floats[src];
+                    }
+                }
+            }
+        }
+
+        auto layer = createLayer(cpu::LayerType::Conv, node);
+        layer.output = getTensorId(node.outputs[0]);
+        const auto& output = tensors[layer.output].desc;
+        layer.inChannels = inChannels;
+        layer.outChannels = outChannels;
+        layer.kernelH = kernelH;
+        layer.kernelW = kernelW;
+        layer.strideH = static_cast<int32_t>(strides[0]);
+        layer.strideW = static_cast<int32_t>(strides[1]);
+        layer.outHeight = output.height;
+        layer.outWidth = output.width;
+        layer.weightsOffset = appendWeights(packed);
+        layer.biasOffset = appendBias(node, outChannels);
+        setFusedActivation(layer, node);
+        addScratchWeights(layer);
+        layers.push_back(layer);
+    }
+
+    // A stride s transposed convolution is split into s * s phases, each of which is a plain
+    // convolution over the input writing every s-th output pixel. Weights [IC][OC][KH][KW].
+    void addConvTranspose(const cpu::Node& node) {
+        checkConvAttributes(node);
+        for (const auto padding : node.getInts("output_padding", {0, 0})) {
+            if (padding != 0)
+                throw std::runtime_error("output_padding in node \"" + node.name + "\" is not supported");
+        }
+
+        const auto& w = getConstant(node, 1);
+        const auto inChannels = static_cast<int>(w.dims[0]);
+        const auto outChannels = static_cast<int>(w.dims[1]);
+        const auto kernelH = static_cast<int>(w.dims[2]);
+        const auto kernelW = static_cast<int>(w.dims[3]);
+        const auto strides = node.getInts("strides", {1, 1});
+        const auto pads = node.getInts("pads", {0, 0, 0, 0});
+        const auto strideH = static_cast<int>(strides[0]);
+        const auto strideW = static_cast<int>(strides[1]);
+
+        const auto& input = shapes.at(node.inputs[0]);
+        const auto outputId = getTensorId(node.outputs[0]);
+        const auto output = tensors[outputId].desc;
+        const auto biasOffset = appendBias(node, outChannels);
+
+        // For output phase p, kernel tap k reads input q + (p + pad - k) / s
+        struct Phase {
+            int offset = std::numeric_limits<int>::max();
+            std::vector<int> taps;
+        };
+        auto getPhase = [](int phase, int pad, int stride, int kernelSize) {
+            Phase result;
+            for (int k = kernelSize - 1; k >= 0; --k) {
+                if ((phase + pad - k) % stride != 0)
+                    continue;
+                result.offset = std::min(result.offset, (phase + pad - k) / stride);
+                result.taps.push_back(k);
+            }
+            return result;
+        };
+
+        for (int py = 0; py < strideH; ++py) {
+            for (int px = 0; px < strideW; ++px) {
+                const auto phaseY = getPhase(py, static_cast<int>(pads[0]), strideH, kernelH);
+                const auto phaseX = getPhase(px, static_cast<int>(pads[1]), strideW, kernelW);
+                const auto outHeight = (output.height - py + strideH - 1) / strideH;
+                const auto outWidth = (output.width - px + strideW - 1) / strideW;
+                if (outHeight <= 0 || outWidth <= 0 || phaseY.taps.empty() || phaseX.taps.empty())
+                    throw std::runtime_error("node \"" + node.name + "\" has an empty output phase");
+
+                const auto tapsH = static_cast<int>(phaseY.taps.size());
+                const auto tapsW = static_cast<int>(phaseX.taps.size());
+                if (phaseY.offset < 0 || phaseX.offset < 0 ||
+                    phaseY.offset + outHeight - 1 + tapsH > input[2] ||
+                    phaseX.offset + outWidth - 1 + tapsW > input[3])
+                    throw std::runtime_error("padding of node \"" + node.name + "\" reads outside of its input");
+
+                std::vector<float> packed(static_cast<size_t>(cpu::getBlockCount(outChannels)) * inChannels
+                    * tapsH * tapsW * cpu::blockSize, 0.0f);
+                for (int oc = 0; oc < outChannels; ++oc) {
+                    for (int ic = 0; ic < inChannels; ++ic) {
+                        for (int ty = 0; ty < tapsH; ++ty) {
+                            for (int tx = 0; tx < tapsW; ++tx) {
+                                const auto src = ((static_cast<size_t>(ic) * outChannels + oc) * kernelH
+                                    + phaseY.taps[ty]) * kernelW + phaseX.taps[tx];
+                                const auto dst = ((((static_cast<size_t>(oc / cpu::blockSize) * tapsH + ty)
+                                    * tapsW + tx) * inChannels + ic) * cpu::blockSize) + oc % cpu::blockSize;
+                                packed[dst] = w.floats[src];
+                            }
+                        }
+                    }
+                }
+
+                auto layer = createLayer(cpu::LayerType::Conv, node);
+                layer.output = outputId;
+                layer.inChannels = inChannels;
+                layer.outChannels = outChannels;
+                layer.kernelH = tapsH;
+                layer.kernelW = tapsW;
+                layer.srcOffsetY += phaseY.offset;
+                layer.srcOffsetX += phaseX.offset;
+                layer.outHeight = outHeight;
+                layer.outWidth = outWidth;
+                layer.dstOffsetY = py;
+                layer.dstOffsetX = px;
+                layer.dstStrideY = strideH;
+                layer.dstStrideX = strideW;
+                layer.weightsOffset = appendWeights(packed);
+                layer.biasOffset = biasOffset;
+                setFusedActivation(layer, node);
+                addScratchWeights(layer);
+                layers.push_back(layer);
+            }
+        }
+    }
+
+    void addActivation(const cpu::Node& node) {
+        getTensorId(node.inputs[0]); // rejects views
+        auto layer = createLayer(cpu::LayerType::Activation, node);
+        layer.output = getTensorId(node.outputs[0]);
+        const auto& output = tensors[layer.output].desc;
+        layer.inChannels = layer.outChannels = output.channels;
+        layer.outHeight = output.height;
+        layer.outWidth = output.width;
+        if (node.op == "Relu") {
+            layer.activation = cpu::Activation::Relu;
+        } else if (node.op == "LeakyRelu") {
+            layer.activation = cpu::Activation::LeakyRelu;
+            layer.alpha = node.getFloat("alpha", 0.01f);
+        } else if (node.op == "Sigmoid") {
+            layer.activation = cpu::Activation::Sigmoid;
+        } else {
+            layer.activation = cpu::Activation::Clip;
+            layer.alpha = node.getFloat("min", std::numeric_limits<float>::lowest());
+            layer.beta = node.getFloat("max", std::numeric_limits<float>::max());
+            if (node.inputs.size() > 1 && !node.inputs[1].empty())
+                layer.alpha = getConstant(node, 1).floats.at(0);
+            if (node.inputs.size() > 2 && !node.inputs[2].empty())
+                layer.beta = getConstant(node, 2).floats.at(0);
+        }
+        layers.push_back(layer);
+    }
+
+    // Activation fused into a convolution or an Add by the graph optimizer
+    static void setFusedActivation(cpu::LayerDesc& layer, const cpu::Node& node) {
+        const auto it = node.attributes.find("activation");
+        if (it == node.attributes.end())
+            return;
+
+        const auto& params = node.attributes.at("activation_params").floats;
+        if (it->second.s == "Relu") {
+            layer.activation = cpu::Activation::Relu;
+        } else if (it->second.s == "LeakyRelu" && params.size() == 1) {
+            layer.activation = cpu::Activation::LeakyRelu;
+            layer.alpha = params[0];
+        } else if (it->second.s == "Clip" && params.size() == 2) {
+            layer.activation = cpu::Activation::Clip;
+            layer.alpha = params[0];
+            layer.beta = params[1];
+        } else {
+            throw std::runtime_error("unsupported fused activation \"" + it->second.s + "\" in node \""
+                + node.name + "\"");
+        }
+    }
+
+    // Slices and negative pads of H and W become views into their input
+    void addCrop(const cpu::Node& node) {
+        const auto& input = shapes.at(node.inputs[0]);
+        const auto& output = shapes.at(node.outputs[0]);
+        const auto offsets = cpu::getCropOffsets(graph, node, input);
+        if (input.size() != 4 || offsets[0] != 0 || offsets[1] != 0 || output[0] != input[0] || output[1] != input[1])
+            throw std::runtime_error("node \"" + node.name + "\" crops along batch or channels, which is not supported");
+
+        auto view = getView(node.inputs[0]);
+        view.offsetY += static_cast<int>(offsets[2]);
+        view.offsetX += static_cast<int>(offsets[3]);
+        views[node.outputs[0]] = view;
+    }
+
+    void addAdd(const cpu::Node& node) {
+        const auto& shape = shapes.at(node.outputs[0]);
+        if (node.inputs.size() != 2 || graph.findConstant(node.inputs[0]) || graph.findConstant(node.inputs[1]))
+            throw std::runtime_error("Add with a constant in node \"" + node.name + "\" is not supported");
+        if (shapes.at(node.inputs[0]) != shape || shapes.at(node.inputs[1]) != shape)
+            throw std::runtime_error("broadcasting Add in node \"" + node.name + "\" is not supported");
+
+        auto layer = createLayer(cpu::LayerType::Add, node);
+        const auto input2 = getView(node.inputs[1]);
+        layer.input2 = input2.tensor;
+        layer.src2OffsetY = input2.offsetY;
+        layer.src2OffsetX = input2.offsetX;
+        layer.scale2Tensor = input2.scale;
+        layer.output = getTensorId(node.outputs[0]);
+        layer.inChannels = layer.outChannels = static_cast<int32_t>(shape[1]);
+        layer.outHeight = static_cast<int32_t>(shape[2]);
+        layer.outWidth = static_cast<int32_t>(shape[3]);
+        setFusedActivation(layer, node);
+        layers.push_back(layer);
+    }
+
+    // FC weights [hidden][C][1][1] and [C][hidden][1][1] are kept in their original layout.
+    // The convs producing x accumulate its channel sums while storing it, and the consumers of
+    // the SE output read x scaled by the computed per-channel factors, so x is never rewritten.
+    void addSqueezeExcitation(const cpu::Node& node) {
+        const auto& w1 = getConstant(node, 1);
+        const auto& w2 = getConstant(node, 3);
+        const auto hidden = static_cast<int>(w1.dims[0]);
+        const auto channels = static_cast<int>(w1.dims[1]);
+        if (w2.dims[0] != channels || w2.dims[1] != hidden)
+            throw std::runtime_error("node \"" + node.name + "\" has mismatched FC weights");
+
+        std::vector<float> data(w1.floats);
+        auto appendFcBias = [&](int index, int size) {
+            if (node.inputs.size() > index && !node.inputs[index].empty())
+                data.insert(data.end(), getConstant(node, index).floats.begin(), getConstant(node, index).floats.end());
+            else
+                data.insert(data.end(), size, 0.0f);
+        };
+        appendFcBias(2, hidden);
+        data.insert(data.end(), w2.floats.begin(), w2.floats.end());
+        appendFcBias(4, channels);
+
+        const auto inputId = getTensorId(node.inputs[0]);
+        auto layer = createLayer(cpu::LayerType::SqueezeExcitation, node);
+        layer.output = addTensor(channels, 1, 1);
+        layer.inChannels = channels;
+        layer.outChannels = hidden;
+        layer.weightsOffset = appendWeights(data);
+
+        // Without conv producers, e.g. for the graph input, the layer reduces x itself
+        std::vector<cpu::LayerDesc*> producers;
+        for (auto& producer : layers) {
+            if (producer.output != inputId)
+                continue;
+            if (producer.type != cpu::LayerType::Conv || producer.poolTensor >= 0) {
+                producers.clear();
+                break;
+            }
+            producers.push_back(&producer);
+        }
+        if (!producers.empty()) {
+            layer.poolTensor = addTensor(channels, tensors[inputId].desc.height, 1);
+            for (auto* producer : producers)
+                producer->poolTensor = layer.poolTensor;
+            producers.front()->clearPool = 1;
+        }
+        layers.push_back(layer);
+        views[node.outputs[0]] = TensorView{inputId, 0, 0, layer.output};
+    }
+
+    uint64_t appendCode(const std::vector<uint8_t>& data) {
+        code.resize((code.size() + cpu::modelAlignment - 1) / cpu::modelAlignment * cpu::modelAlignment, 0xcc);
+        const auto offset = code.size();
+        code.insert(code.end(), data.begin(), data.end());
+        return offset;
+    }
+
+    // Generates a row kernel specialized to the shape and register blocking of every conv layer
+    void generateCode() {
+        for (auto& layer : layers) {
+            if (layer.type != cpu::LayerType::Conv || layer.kernel != cpu::KernelType::Jit)
+                continue;
+
+            const auto params = cpu::getConvParams(layer, tensors[layer.input].desc, tensors[layer.output].desc);
+            std::vector<uint8_t> function, tailFunction;
+            cpu::JitConvBlocking blocking{};
+            try {
+                blocking = cpu::chooseConvJitBlocking(params);
+                function = cpu::generateConvJit(params, blocking.blocks, blocking.pixels);
+                if (blocking.tailBlocks > 0)
+                    tailFunction = cpu::generateConvJit(params, blocking.tailBlocks, blocking.tailPixels);
+            } catch (const std::exception&) {
+                // Shapes whose offsets do not fit 32-bit displacements use the intrinsic kernels
+                layer.kernel = cpu::KernelType::Avx2;
+                continue;
+            }
+
+            layer.jitBlocks = blocking.blocks;
+            layer.jitPixels = blocking.pixels;
+            layer.jitTailBlocks = blocking.tailBlocks;
+            layer.jitTailPixels = blocking.tailPixels;
+            layer.jitOffset = appendCode(function);
+            if (!tailFunction.empty())
+                layer.jitTailOffset = appendCode(tailFunction);
+        }
+    }
+
+    // Streamed tensors are rolling buffers of the most rows the schedule keeps at once, all of
+    // which stay allocated for the whole run
+    uint64_t planStream(int inputId, int outputId) {
+        if (config.batchSize != 1)
+            throw std::runtime_error("streamed execution requires a batch size of 1");
+
+        std::vector<cpu::TensorDesc> descs;
+        for (const auto& tensor : tensors)
+            descs.push_back(tensor.desc);
+        const auto rows = cpu::scheduleStream(layers.data(), static_cast<int>(layers.size()), descs.data(),
+            static_cast<int>(descs.size()), inputId, outputId, config.bandHeight, {});
+
+        uint64_t arenaSize = 0;
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            auto& desc = tensors[i].desc;
+            desc.height = std::max(rows[i], 1);
+            desc.size = static_cast<uint64_t>(cpu::getBlockCount(desc.channels)) * desc.height * desc.width
+                * cpu::blockSize * sizeof(float);
+            desc.offset = arenaSize;
+            arenaSize += (desc.size + cpu::modelAlignment - 1) / cpu::modelAlignment * cpu::modelAlignment;
+        }
+        return arenaSize;
+    }
+
+    // Greedy best-fit placement of every tensor over its live range
+    uint64_t planMemory(int outputId) {
+        for (int i = 0; i < layers.size(); ++i) {
+            const auto& layer = layers[i];
+            for (const auto id : {layer.input, layer.input2, layer.output, layer.poolTensor,
+                                  layer.scaleTensor, layer.scale2Tensor, layer.scratchTensor}) {
+                if (id < 0)
+                    continue;
+                tensors[id].firstLayer = std::min(tensors[id].firstLayer, i);
+                tensors[id].lastLayer = std::max(tensors[id].lastLayer, i);
+            }
+        }
+        tensors[0].firstLayer = -1;
+        tensors[outputId].lastLayer = static_cast<int>(layers.size());
+
+        struct Block {
+            uint64_t offset;
+            uint64_t size;
+        };
+        std::vector<Block> freeBlocks;
+        uint64_t arenaSize = 0;
+
+        auto allocate = [&](uint64_t size) {
+            size = (size + cpu::modelAlignment - 1) / cpu::modelAlignment * cpu::modelAlignment;
+            auto best = freeBlocks.end();
+            for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+                if (it->size >= size && (best == freeBlocks.end() || it->size < best->size))
+                    best = it;
+            }
+            if (best == freeBlocks.end()) {
+                // Grow the arena, absorbing a free block at its end
+                if (!freeBlocks.empty() && freeBlocks.back().offset + freeBlocks.back().size == arenaSize) {
+                    const auto offset = freeBlocks.back().offset;
+                    freeBlocks.pop_back();
+                    arenaSize = offset + size;
+                    return offset;
+                }
+                const auto offset = arenaSize;
+                arenaSize += size;
+                return offset;
+            }
+            const auto offset = best->offset;
+            best->offset += size;
+            best->size -= size;
+            if (best->size == 0)
+                freeBlocks.erase(best);
+            return offset;
+        };
+
+        auto release = [&](uint64_t offset, uint64_t size) {
+            size = (size + cpu::modelAlignment - 1) / cpu::modelAlignment * cpu::modelAlignment;
+            auto it = std::lower_bound(freeBlocks.begin(), freeBlocks.end(), offset,
+                [](const Block& block, uint64_t value) { return block.offset < value; });
+            it = freeBlocks.insert(it, Block{offset, size});
+            if (it + 1 != freeBlocks.end() && it->offset + it->size == (it + 1)->offset) {
+                it->size += (it + 1)->size;
+                freeBlocks.erase(it + 1);
+            }
+            if (it != freeBlocks.begin() && (it - 1)->offset + (it - 1)->size == it->offset) {
+                (it - 1)->size += it->size;
+                freeBlocks.erase(it);
+            }
+        };
+
+        const auto batchSize = static_cast<uint64_t>(config.batchSize);
+        for (int i = -1; i < static_cast<int>(layers.size()); ++i) {
+            for (auto& tensor : tensors) {
+                if (tensor.firstLayer == i)
+                    tensor.desc.offset = allocate(tensor.desc.size * batchSize);
+            }
+            for (auto& tensor : tensors) {
+                if (tensor.firstLayer <= i && tensor.lastLayer == i)
+                    release(tensor.desc.offset, tensor.desc.size * batchSize);
+            }
+        }
+        return arenaSize;
+    }
+};
+
+std::vector<char> cpu::Model::compile(const Graph& graph, const BuildConfig& config, KernelType kernel) {
+    ModelCompiler compiler{
+        graph, config, kernel
+    };
+    compiler.shapes = inferShapes(graph, {config.batchSize, config.channels, config.height, config.width});
+
+    const auto inputId = compiler.getTensorId(graph.inputs[0].name);
+    for (const auto& node : graph.nodes) {
+        if (node.op == "Constant")
+            continue;
+        if (node.op == "Identity") {
+            const auto view = compiler.views.find(node.inputs[0]);
+            if (view != compiler.views.end())
+                compiler.views[node.outputs[0]] = view->second;
+            else
+                compiler.tensorIds[node.outputs[0]] = compiler.getTensorId(node.inputs[0]);
+            continue;
+        }
+
+        if (node.op == "Conv")
+            compiler.addConv(node);
+        else if (node.op == "ConvTranspose")
+            compiler.addConvTranspose(node);
+        else if (node.op == "Relu" || node.op == "LeakyRelu" || node.op == "Sigmoid" || node.op == "Clip")
+            compiler.addActivation(node);
+        else if (node.op == "SqueezeExcitation")
+            compiler.addSqueezeExcitation(node);
+        else if (node.op == "Slice" || node.op == "Pad")
+            compiler.addCrop(node);
+        else if (node.op == "Add")
+            compiler.addAdd(node);
+        else
+            throw std::runtime_error("unsupported op \"" + node.op + "\" in node \"" + node.name + "\"");
+    }
+    const auto outputId = compiler.getTensorId(graph.outputs[0].name);
+    if (outputId == inputId)
+        throw std::runtime_error("graph output is its input");
+
+    // Row buffers of streamed models are sized first, generated code bakes in their heights
+    uint64_t arenaSize = 0;
+    if (config.bandHeight > 0) {
+        arenaSize = compiler.planStream(inputId, outputId);
+        compiler.generateCode();
+    } else {
+        compiler.generateCode();
+        arenaSize = compiler.planMemory(outputId);
+    }
+
+    ModelHeader header{};
+    std::memcpy(header.magic, modelMagic, sizeof(modelMagic));
+    header.version = modelVersion;
+    header.cpuFeatures = getKernelFeatures(compiler.kernel);
+    header.batchSize = config.batchSize;
+    header.channels = config.channels;
+    header.height = config.height;
+    header.width = config.width;
+    header.bandHeight = config.bandHeight;
+    header.inputTensor = inputId;
+    header.outputTensor = outputId;
+    header.tensorCount = static_cast<uint32_t>(compiler.tensors.size());
+    header.layerCount = static_cast<uint32_t>(compiler.layers.size());
+    header.arenaSize = arenaSize;
+
+    auto align = [](uint64_t offset) {
+        return (offset + modelAlignment - 1) / modelAlignment * modelAlignment;
+    };
+    header.tensorsOffset = align(sizeof(ModelHeader));
+    header.layersOffset = align(header.tensorsOffset + header.tensorCount * sizeof(TensorDesc));
+    header.weightsOffset = align(header.layersOffset + header.layerCount * sizeof(LayerDesc));
+    header.weightsSize = compiler.weights.size() * sizeof(float);
+    header.codeOffset = align(header.weightsOffset + header.weightsSize);
+    header.codeSize = compiler.code.size();
+
+    std::vector<char> image(header.codeOffset + header.codeSize, 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    for (uint32_t i = 0; i < header.tensorCount; ++i) {
+        std::memcpy(image.data() + header.tensorsOffset + i * sizeof(TensorDesc),
+            &compiler.tensors[i].desc, sizeof(TensorDesc));
+    }
+    std::memcpy(image.data() + header.layersOffset, compiler.layers.data(),
+        header.layerCount * sizeof(LayerDesc));
+    std::memcpy(image.data() + header.weightsOffset, compiler.weights.data(), header.weightsSize);
+    if (header.codeSize > 0)
+        std::memcpy(image.data() + header.codeOffset, compiler.code.data(), header.codeSize);
+    return image;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "model.h"
+#include "helper.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+cpu::Model::Model() = default;
+cpu::Model::~Model() = default;
+
+void cpu::Model::ArenaDeleter::operator()(float* ptr) const {
+    ::operator delete(ptr, std::align_val_t(modelAlignment));
+}
+
+void cpu::Model::load(const std::string& path) {
+    image.clear();
+    file.open(path);
+    attach(static_cast<const char*>(file.data()), file.size());
+}
+
+// Models compiled at render time for the frame shape are never written to disk
+void cpu::Model::load(std::vector<char> compiledModel) {
+    file.close();
+    image = std::move(compiledModel);
+    attach(image.data(), image.size());
+}
+
+void cpu::Model::attach(const char* base, size_t size) {
+    header = nullptr;
+    tensors = nullptr;
+    layers = nullptr;
+    weights = nullptr;
+    code.release();
+    arena.reset();
+
+    if (size < sizeof(ModelHeader))
+        throw std::runtime_error("compiled model is truncated");
+
+    const auto* modelHeader = reinterpret_cast<const ModelHeader*>(base);
+    if (std::memcmp(modelHeader->magic, modelMagic, sizeof(modelMagic)) != 0)
+        throw std::runtime_error("file is not a compiled model");
+    if (modelHeader->version != modelVersion)
+        throw std::runtime_error("compiled model version " + std::to_string(modelHeader->version)
+            + " is not supported, rebuild the model");
+    if ((modelHeader->cpuFeatures & cpuGetFeatures()) != modelHeader->cpuFeatures)
+        throw std::runtime_error("compiled model requires cpu features \""
+            + cpuGetFeatureString(modelHeader->cpuFeatures) + "\"");
+    if (modelHeader->tensorsOffset + modelHeader->tensorCount * sizeof(TensorDesc) > size ||
+        modelHeader->layersOffset + modelHeader->layerCount * sizeof(LayerDesc) > size ||
+        modelHeader->weightsOffset + modelHeader->weightsSize > size ||
+        modelHeader->codeOffset + modelHeader->codeSize > size ||
+        modelHeader->inputTensor < 0 || modelHeader->inputTensor >= modelHeader->tensorCount ||
+        modelHeader->outputTensor < 0 || modelHeader->outputTensor >= modelHeader->tensorCount)
+        throw std::runtime_error("compiled model is corrupted");
+
+    header = modelHeader;
+    tensors = reinterpret_cast<const TensorDesc*>(base + header->tensorsOffset);
+    layers = reinterpret_cast<const LayerDesc*>(base + header->layersOffset);
+    weights = base + header->weightsOffset;
+    tensorBases.assign(header->tensorCount, 0);
+
+    // Generated kernels were produced at build time, only map them executable here
+    if (header->codeSize > 0)
+        code.assign(base + header->codeOffset, header->codeSize);
+
+    // Zeroing the arena keeps the padding lanes of partially filled channel blocks finite
+    auto* ptr = static_cast<float*>(::operator new(header->arenaSize, std::align_val_t(modelAlignment)));
+    std::memset(ptr, 0, header->arenaSize);
+    arena.reset(ptr);
+}
+
+void cpu::Model::prefault() const {
+    file.prefault();
+}
+
+const cpu::ModelHeader& cpu::Model::getHeader() const {
+    if (!header)
+        throw std::runtime_error("model is not loaded");
+    return *header;
+}
+
+const cpu::TensorDesc& cpu::Model::getTensor(int index) const {
+    if (!header || index < 0 || index >= header->tensorCount)
+        throw std::out_of_range("tensor index out of range");
+    return tensors[index];
+}
+
+const cpu::LayerDesc& cpu::Model::getLayer(int index) const {
+    if (!header || index < 0 || index >= header->layerCount)
+        throw std::out_of_range("layer index out of range");
+    return layers[index];
+}
+
+float* cpu::Model::getTensorData(int index, int batchIndex) {
+    const auto& tensor = getTensor(index);
+    return reinterpret_cast<float*>(reinterpret_cast<char*>(arena.get())
+        + tensor.offset + tensor.size * batchIndex);
+}
+
+float* cpu::Model::getRow(int tensor, int batchIndex, int row) {
+    const auto& desc = tensors[tensor];
+    return getTensorData(tensor, batchIndex) + static_cast<size_t>(row - tensorBases[tensor]) * desc.width * blockSize;
+}
\ No newline at end of file
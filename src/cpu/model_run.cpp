@@ -0,0 +1,287 @@
+#include "model.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+cpu::ConvParams cpu::getConvParams(const LayerDesc& layer, const TensorDesc& input, const TensorDesc& output) {
+    ConvParams params;
+    params.inChannels = layer.inChannels;
+    params.srcHeight = input.height;
+    params.srcWidth = input.width;
+    params.srcOffsetY = layer.srcOffsetY;
+    params.srcOffsetX = layer.srcOffsetX;
+    params.outChannels = layer.outChannels;
+    params.outHeight = layer.outHeight;
+    params.outWidth = layer.outWidth;
+    params.kernelH = layer.kernelH;
+    params.kernelW = layer.kernelW;
+    params.strideH = layer.strideH;
+    params.strideW = layer.strideW;
+    params.dstHeight = output.height;
+    params.dstWidth = output.width;
+    params.dstOffsetY = layer.dstOffsetY;
+    params.dstOffsetX = layer.dstOffsetX;
+    params.dstStrideY = layer.dstStrideY;
+    params.dstStrideX = layer.dstStrideX;
+    params.activation = layer.activation;
+    params.alpha = layer.alpha;
+    params.beta = layer.beta;
+    params.pooling = layer.poolTensor >= 0;
+    return params;
+}
+
+void cpu::Model::run(utils::ThreadPool& pool) {
+    if (!header)
+        throw std::runtime_error("model is not loaded");
+    if (header->bandHeight > 0)
+        throw std::runtime_error("model is compiled for streamed execution");
+
+    for (uint32_t i = 0; i < header->layerCount; ++i)
+        runLayer(static_cast<int>(i), pool);
+}
+
+void cpu::Model::runLayer(int index, utils::ThreadPool& pool) {
+    const auto& layer = getLayer(index);
+    runLayer(layer, 0, layer.outHeight, pool);
+}
+
+void cpu::Model::runLayer(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool) {
+    switch (layer.type) {
+        case LayerType::Conv:
+            runConv(layer, row0, row1, pool);
+            break;
+        case LayerType::Activation:
+            runActivation(layer, row0, row1, pool);
+            break;
+        case LayerType::SqueezeExcitation:
+            runSqueezeExcitation(layer, pool);
+            break;
+        case LayerType::Add:
+            runAdd(layer, row0, row1, pool);
+            break;
+        default:
+            throw std::runtime_error("compiled model contains an unknown layer type");
+    }
+}
+
+// Rows are frame rows, streamed buffers only hold the rows from their base on
+void cpu::Model::runConv(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool) {
+    auto params = getConvParams(layer, tensors[layer.input], tensors[layer.output]);
+    params.srcOffsetY -= tensorBases[layer.input];
+    params.dstOffsetY -= tensorBases[layer.output];
+    params.weights = reinterpret_cast<const float*>(weights + layer.weightsOffset);
+    params.bias = reinterpret_cast<const float*>(weights + layer.biasOffset);
+
+    const auto jit = layer.kernel == KernelType::Jit;
+    const auto conv = layer.kernel == KernelType::Avx2 ? convAvx2 : convGeneric;
+    const auto* codeBase = static_cast<const char*>(code.data());
+    const auto jitFunction = jit ? reinterpret_cast<JitConvFunction>(codeBase + layer.jitOffset) : nullptr;
+    const auto jitTailFunction = jit && layer.jitTailBlocks
+        ? reinterpret_cast<JitConvFunction>(codeBase + layer.jitTailOffset) : nullptr;
+
+    // Split into (batch, group of channel blocks, row chunk) tasks, aiming for several tasks per thread
+    const auto batchSize = header->batchSize;
+    const auto blockCount = getBlockCount(layer.outChannels);
+    const auto groupSize = jit ? layer.jitBlocks : 2;
+    const auto fullGroupCount = blockCount / groupSize;
+    const auto groupCount = (blockCount + groupSize - 1) / groupSize;
+    const auto taskTarget = pool.size() * 8;
+    const auto rowCount = row1 - row0;
+    const auto rowsPerTask = std::max(1, rowCount * groupCount * batchSize / taskTarget);
+    const auto chunkCount = (rowCount + rowsPerTask - 1) / rowsPerTask;
+
+    const float activationParams[2] = {layer.alpha, layer.beta};
+    const auto dstPlane = static_cast<size_t>(params.dstHeight) * params.dstWidth * blockSize;
+    const auto weightBlock = static_cast<size_t>(params.inChannels) * params.kernelH * params.kernelW * blockSize;
+
+    if (layer.clearPool) {
+        for (int batchIndex = 0; batchIndex < batchSize; ++batchIndex) {
+            auto* sums = getTensorData(layer.poolTensor, batchIndex);
+            std::fill(sums, sums + tensors[layer.poolTensor].size / sizeof(float), 0.0f);
+        }
+    }
+
+    // Scaling input channel ic is the same as scaling the weights reading it
+    if (layer.scaleTensor >= 0) {
+        pool.parallelFor(batchSize * blockCount, [&](int task) {
+            const auto block = task % blockCount;
+            const auto batchIndex = task / blockCount;
+            const auto* scale = getTensorData(layer.scaleTensor, batchIndex);
+            const auto* src = params.weights + block * weightBlock;
+            auto* dst = getTensorData(layer.scratchTensor, batchIndex) + block * weightBlock;
+            for (size_t i = 0; i < weightBlock / blockSize; ++i) {
+                const auto factor = scale[i % params.inChannels];
+                for (int l = 0; l < blockSize; ++l)
+                    dst[i * blockSize + l] = src[i * blockSize + l] * factor;
+            }
+        });
+    }
+
+    pool.parallelFor(batchSize * groupCount * chunkCount, [&](int task) {
+        const auto chunk = task % chunkCount;
+        const auto group = task / chunkCount % groupCount;
+        const auto batchIndex = task / chunkCount / groupCount;
+        const auto taskRow0 = row0 + chunk * rowsPerTask;
+        const auto taskRow1 = std::min(row1, taskRow0 + rowsPerTask);
+        const auto block = group * groupSize;
+        const auto* src = getTensorData(layer.input, batchIndex);
+        auto* dst = getTensorData(layer.output, batchIndex);
+        const auto* taskWeights = layer.scaleTensor >= 0 ? getTensorData(layer.scratchTensor, batchIndex) : params.weights;
+        auto* sums = params.pooling ? getTensorData(layer.poolTensor, batchIndex) : nullptr;
+
+        if (!jit) {
+            auto taskParams = params;
+            taskParams.src = src;
+            taskParams.dst = dst;
+            taskParams.weights = taskWeights;
+            taskParams.pool = sums;
+            conv(taskParams, block, std::min(blockCount, block + groupSize), taskRow0, taskRow1);
+            return;
+        }
+
+        const auto function = group < fullGroupCount ? jitFunction : jitTailFunction;
+        JitConvArgs args{};
+        args.weights = taskWeights + block * weightBlock;
+        args.bias = params.bias + block * blockSize;
+        args.activation = activationParams;
+        for (int y = taskRow0; y < taskRow1; ++y) {
+            const auto dy = static_cast<size_t>(params.dstOffsetY + y * params.dstStrideY);
+            args.src = src + (static_cast<size_t>(params.srcOffsetY + y * params.strideH) * params.srcWidth
+                + params.srcOffsetX) * blockSize;
+            args.dst = dst + block * dstPlane + (dy * params.dstWidth + params.dstOffsetX) * blockSize;
+            if (sums)
+                args.pool = sums + (block * params.dstHeight + dy) * blockSize;
+            function(&args);
+        }
+    });
+}
+
+void applyActivation(float* data, size_t count, cpu::Activation activation, float alpha, float beta) {
+    switch (activation) {
+        case cpu::Activation::None:
+            break;
+        case cpu::Activation::Relu:
+            for (size_t i = 0; i < count; ++i)
+                data[i] = std::max(data[i], 0.0f);
+            break;
+        case cpu::Activation::LeakyRelu:
+            for (size_t i = 0; i < count; ++i)
+                data[i] = data[i] < 0.0f ? data[i] * alpha : data[i];
+            break;
+        case cpu::Activation::Sigmoid:
+            for (size_t i = 0; i < count; ++i)
+                data[i] = 1.0f / (1.0f + std::exp(-data[i]));
+            break;
+        case cpu::Activation::Clip:
+            for (size_t i = 0; i < count; ++i)
+                data[i] = std::clamp(data[i], alpha, beta);
+            break;
+    }
+}
+
+void cpu::Model::runActivation(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool) {
+    const auto blockCount = getBlockCount(layer.outChannels);
+    const auto rowCount = row1 - row0;
+    const auto rowSize = static_cast<size_t>(layer.outWidth) * blockSize;
+    const auto srcPlane = static_cast<size_t>(tensors[layer.input].height) * rowSize;
+    const auto dstPlane = static_cast<size_t>(tensors[layer.output].height) * rowSize;
+
+    pool.parallelFor(header->batchSize * blockCount * rowCount, [&](int task) {
+        const auto y = row0 + task % rowCount;
+        const auto block = task / rowCount % blockCount;
+        const auto batchIndex = task / rowCount / blockCount;
+        const auto* src = getRow(layer.input, batchIndex, y) + block * srcPlane;
+        auto* dst = getRow(layer.output, batchIndex, y) + block * dstPlane;
+        std::copy(src, src + rowSize, dst);
+        applyActivation(dst, rowSize, layer.activation, layer.alpha, layer.beta);
+    });
+}
+
+// Squeeze to per-channel means, excite through FC + Relu and FC + Sigmoid and write the scales,
+// which the consumers apply while reading the input
+void cpu::Model::runSqueezeExcitation(const LayerDesc& layer, utils::ThreadPool& pool) {
+    const auto& tensor = tensors[layer.input];
+    const auto channels = layer.inChannels;
+    const auto hidden = layer.outChannels;
+    const auto blockCount = getBlockCount(channels);
+    const auto plane = static_cast<size_t>(tensor.height) * tensor.width;
+
+    // [hidden][channels], [hidden], [channels][hidden], [channels]
+    const auto* w1 = reinterpret_cast<const float*>(weights + layer.weightsOffset);
+    const auto* b1 = w1 + static_cast<size_t>(hidden) * channels;
+    const auto* w2 = b1 + hidden;
+    const auto* b2 = w2 + static_cast<size_t>(channels) * hidden;
+
+    pool.parallelFor(header->batchSize, [&](int batchIndex) {
+        // Row sums accumulated by the producing convs, or the input itself when there are none
+        const auto pooled = layer.poolTensor >= 0;
+        const auto* src = getTensorData(pooled ? layer.poolTensor : layer.input, batchIndex);
+        const auto rows = pooled ? static_cast<size_t>(tensor.height) : plane;
+
+        std::vector<float> mean(static_cast<size_t>(blockCount) * blockSize);
+        for (int block = 0; block < blockCount; ++block) {
+            const auto* data = src + block * rows * blockSize;
+            double sums[blockSize] = {};
+            for (size_t i = 0; i < rows; ++i) {
+                for (int l = 0; l < blockSize; ++l)
+                    sums[l] += data[i * blockSize + l];
+            }
+            for (int l = 0; l < blockSize; ++l)
+                mean[block * blockSize + l] = static_cast<float>(sums[l] / static_cast<double>(plane));
+        }
+
+        std::vector<float> excitation(hidden);
+        for (int h = 0; h < hidden; ++h) {
+            auto value = b1[h];
+            for (int c = 0; c < channels; ++c)
+                value += w1[static_cast<size_t>(h) * channels + c] * mean[c];
+            excitation[h] = std::max(value, 0.0f);
+        }
+
+        // Padding lanes keep a zero scale
+        auto* scale = getTensorData(layer.output, batchIndex);
+        std::fill(scale, scale + blockCount * blockSize, 0.0f);
+        for (int c = 0; c < channels; ++c) {
+            auto value = b2[c];
+            for (int h = 0; h < hidden; ++h)
+                value += w2[static_cast<size_t>(c) * hidden + h] * excitation[h];
+            scale[c] = 1.0f / (1.0f + std::exp(-value));
+        }
+    });
+}
+
+// Sums two views, each cropped by its src offsets and optionally scaled per channel
+void cpu::Model::runAdd(const LayerDesc& layer, int row0, int row1, utils::ThreadPool& pool) {
+    const auto blockCount = getBlockCount(layer.outChannels);
+    const auto rowCount = row1 - row0;
+    auto getPlane = [&](int tensor) {
+        return static_cast<size_t>(tensors[tensor].height) * tensors[tensor].width * blockSize;
+    };
+    const auto planeA = getPlane(layer.input);
+    const auto planeB = getPlane(layer.input2);
+    const auto dstPlane = getPlane(layer.output);
+    float ones[blockSize];
+    std::fill(ones, ones + blockSize, 1.0f);
+
+    pool.parallelFor(header->batchSize * blockCount * rowCount, [&](int task) {
+        const auto y = row0 + task % rowCount;
+        const auto block = task / rowCount % blockCount;
+        const auto batchIndex = task / rowCount / blockCount;
+        const auto* scaleA = layer.scaleTensor >= 0
+            ? getTensorData(layer.scaleTensor, batchIndex) + block * blockSize : ones;
+        const auto* scaleB = layer.scale2Tensor >= 0
+            ? getTensorData(layer.scale2Tensor, batchIndex) + block * blockSize : ones;
+        const auto* srcA = getRow(layer.input, batchIndex, layer.srcOffsetY + y) + block * planeA
+            + static_cast<size_t>(layer.srcOffsetX) * blockSize;
+        const auto* srcB = getRow(layer.input2, batchIndex, layer.src2OffsetY + y) + block * planeB
+            + static_cast<size_t>(layer.src2OffsetX) * blockSize;
+        auto* dst = getRow(layer.output, batchIndex, y) + block * dstPlane;
+
+        for (int x = 0; x < layer.outWidth; ++x) {
+            for (int l = 0; l < blockSize; ++l) {
+                const auto i = static_cast<size_t>(x) * blockSize + l;
+                dst[i] = activate(srcA[i] * scaleA[l] + srcB[i] * scaleB[l], layer.activation, layer.alpha, layer.beta);
+            }
+        }
+    });
+}
\ No newline at end of file
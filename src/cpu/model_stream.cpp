@@ -0,0 +1,149 @@
+#include "model.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Output row y of a layer reads rows [offset + y * stride, offset + y * stride + kernel) of tensor
+struct StreamInput {
+    int tensor;
+    int offset;
+    int stride;
+    int kernel;
+};
+
+std::vector<StreamInput> getStreamInputs(const cpu::LayerDesc& layer) {
+    switch (layer.type) {
+        case cpu::LayerType::Conv:
+            return {{layer.input, layer.srcOffsetY, layer.strideH, layer.kernelH}};
+        case cpu::LayerType::Activation:
+            return {{layer.input, 0, 1, 1}};
+        case cpu::LayerType::Add:
+            return {{layer.input, layer.srcOffsetY, 1, 1}, {layer.input2, layer.src2OffsetY, 1, 1}};
+        default:
+            throw std::runtime_error("SqueezeExcitation layers pool over the whole frame and cannot be streamed");
+    }
+}
+
+std::vector<int> cpu::scheduleStream(const LayerDesc* layers, int layerCount, const TensorDesc* tensors,
+    int tensorCount, int inputTensor, int outputTensor, int bandHeight, const StreamCallbacks& callbacks) {
+    std::vector<std::vector<StreamInput>> inputs(layerCount);
+    for (int i = 0; i < layerCount; ++i)
+        inputs[i] = getStreamInputs(layers[i]);
+
+    // Rows below ready are complete, phases of a transposed conv may have written up to written.
+    // Buffers hold the rows from base on.
+    std::vector<int> next(layerCount, 0);
+    std::vector<int> base(tensorCount, 0);
+    std::vector<int> ready(tensorCount, 0);
+    std::vector<int> written(tensorCount, 0);
+    std::vector<int> peak(tensorCount, 0);
+    int emitted = 0;
+
+    auto getFrontier = [&](int tensor) {
+        auto frontier = tensors[tensor].rows;
+        for (int i = 0; i < layerCount; ++i) {
+            if (layers[i].output == tensor && next[i] < layers[i].outHeight)
+                frontier = std::min(frontier, layers[i].dstOffsetY + next[i] * layers[i].dstStrideY);
+        }
+        return frontier;
+    };
+
+    while (emitted < tensors[outputTensor].rows) {
+        auto progress = false;
+        if (ready[inputTensor] < tensors[inputTensor].rows) {
+            const auto row1 = std::min(tensors[inputTensor].rows, ready[inputTensor] + bandHeight);
+            if (callbacks.read)
+                callbacks.read(ready[inputTensor], row1);
+            ready[inputTensor] = written[inputTensor] = row1;
+            progress = true;
+        }
+
+        for (int i = 0; i < layerCount; ++i) {
+            const auto& layer = layers[i];
+            auto row1 = layer.outHeight;
+            for (const auto& input : inputs[i]) {
+                const auto available = ready[input.tensor] - input.offset - input.kernel;
+                row1 = std::min(row1, available < 0 ? 0 : available / input.stride + 1);
+            }
+            if (row1 <= next[i])
+                continue;
+
+            if (callbacks.run)
+                callbacks.run(i, next[i], row1);
+            next[i] = row1;
+            written[layer.output] = std::max(written[layer.output], layer.dstOffsetY + (row1 - 1) * layer.dstStrideY + 1);
+            ready[layer.output] = getFrontier(layer.output);
+            progress = true;
+        }
+
+        if (ready[outputTensor] > emitted) {
+            if (callbacks.write)
+                callbacks.write(emitted, ready[outputTensor]);
+            emitted = ready[outputTensor];
+        }
+        if (!progress)
+            throw std::runtime_error("streamed schedule stalled");
+
+        // Drop the rows below the first one any unfinished consumer still reads
+        for (int tensor = 0; tensor < tensorCount; ++tensor) {
+            const auto end = std::max(ready[tensor], written[tensor]);
+            peak[tensor] = std::max(peak[tensor], end - base[tensor]);
+
+            auto needed = tensor == outputTensor ? emitted : ready[tensor];
+            for (int i = 0; i < layerCount; ++i) {
+                if (next[i] == layers[i].outHeight)
+                    continue;
+                for (const auto& input : inputs[i]) {
+                    if (input.tensor == tensor)
+                        needed = std::min(needed, input.offset + next[i] * input.stride);
+                }
+            }
+            needed = std::min(needed, ready[tensor]);
+            if (needed <= base[tensor])
+                continue;
+            if (callbacks.drop)
+                callbacks.drop(tensor, needed - base[tensor], end - needed);
+            base[tensor] = needed;
+        }
+    }
+    return peak;
+}
+
+void cpu::Model::runStreamed(utils::ThreadPool& pool, const RowCallback& readRow, const RowCallback& writeRow) {
+    if (!header)
+        throw std::runtime_error("model is not loaded");
+    if (header->bandHeight <= 0)
+        throw std::runtime_error("model is not compiled for streamed execution");
+
+    std::fill(tensorBases.begin(), tensorBases.end(), 0);
+    auto getPlaneSize = [&](int tensor) {
+        return static_cast<size_t>(tensors[tensor].height) * tensors[tensor].width * blockSize;
+    };
+
+    StreamCallbacks callbacks;
+    callbacks.read = [&](int row0, int row1) {
+        pool.parallelFor(row1 - row0, [&](int i) {
+            readRow(row0 + i, getRow(header->inputTensor, 0, row0 + i), getPlaneSize(header->inputTensor));
+        });
+    };
+    callbacks.run = [&](int index, int row0, int row1) {
+        runLayer(layers[index], row0, row1, pool);
+    };
+    callbacks.write = [&](int row0, int row1) {
+        pool.parallelFor(row1 - row0, [&](int i) {
+            writeRow(row0 + i, getRow(header->outputTensor, 0, row0 + i), getPlaneSize(header->outputTensor));
+        });
+    };
+    callbacks.drop = [&](int tensor, int rows, int keep) {
+        const auto rowSize = static_cast<size_t>(tensors[tensor].width) * blockSize;
+        const auto planeSize = getPlaneSize(tensor);
+        auto* data = getTensorData(tensor, 0);
+        for (int block = 0; block < getBlockCount(tensors[tensor].channels); ++block) {
+            auto* plane = data + block * planeSize;
+            std::memmove(plane, plane + rows * rowSize, keep * rowSize * sizeof(float));
+        }
+        tensorBases[tensor] += rows;
+    };
+    scheduleStream(layers, static_cast<int>(header->layerCount), tensors, static_cast<int>(header->tensorCount),
+        header->inputTensor, header->outputTensor, header->bandHeight, callbacks);
+}
\ No newline at end of file
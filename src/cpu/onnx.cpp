@@ -0,0 +1,359 @@
+#include "onnx.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+// Minimal protobuf wire format reader, enough to walk ModelProto without libprotobuf
+struct ProtoField {
+    uint32_t number = 0;
+    uint32_t wireType = 0;
+    uint64_t varint = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+class ProtoReader {
+public:
+    ProtoReader(const uint8_t* data, size_t size) : ptr(data), end(data + size) {}
+
+    [[nodiscard]] bool empty() const {
+        return ptr >= end;
+    }
+
+    bool next(ProtoField& field) {
+        if (empty())
+            return false;
+        const auto key = readVarint();
+        field.number = static_cast<uint32_t>(key >> 3);
+        field.wireType = static_cast<uint32_t>(key & 7);
+        field.varint = 0;
+        field.data = nullptr;
+        field.size = 0;
+        switch (field.wireType) {
+            case 0:
+                field.varint = readVarint();
+                break;
+            case 1:
+                field.data = take(8);
+                field.size = 8;
+                break;
+            case 2:
+                field.size = static_cast<size_t>(readVarint());
+                field.data = take(field.size);
+                break;
+            case 5:
+                field.data = take(4);
+                field.size = 4;
+                break;
+            default:
+                throw std::runtime_error("unsupported protobuf wire type " + std::to_string(field.wireType));
+        }
+        return true;
+    }
+
+    uint64_t readVarint() {
+        uint64_t result = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (ptr >= end)
+                throw std::runtime_error("truncated protobuf varint");
+            const auto byte = *ptr++;
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return result;
+        }
+        throw std::runtime_error("malformed protobuf varint");
+    }
+
+private:
+    const uint8_t* take(size_t size) {
+        if (static_cast<size_t>(end - ptr) < size)
+            throw std::runtime_error("truncated protobuf field");
+        const auto* data = ptr;
+        ptr += size;
+        return data;
+    }
+
+    const uint8_t* ptr;
+    const uint8_t* end;
+};
+
+std::string protoString(const ProtoField& field) {
+    return {reinterpret_cast<const char*>(field.data), field.size};
+}
+
+float protoFloat(const ProtoField& field) {
+    float value;
+    std::memcpy(&value, field.data, sizeof(float));
+    return value;
+}
+
+void readProtoInts(const ProtoField& field, std::vector<int64_t>& values) {
+    if (field.wireType == 0) {
+        values.push_back(static_cast<int64_t>(field.varint));
+        return;
+    }
+    ProtoReader packed(field.data, field.size);
+    while (!packed.empty())
+        values.push_back(static_cast<int64_t>(packed.readVarint()));
+}
+
+void readProtoFloats(const ProtoField& field, std::vector<float>& values) {
+    if (field.wireType == 5) {
+        values.push_back(protoFloat(field));
+        return;
+    }
+    const auto count = field.size / sizeof(float);
+    const auto offset = values.size();
+    values.resize(offset + count);
+    std::memcpy(values.data() + offset, field.data, count * sizeof(float));
+}
+
+// TensorProto.DataType
+constexpr int onnxFloat = 1;
+constexpr int onnxInt32 = 6;
+constexpr int onnxInt64 = 7;
+constexpr int onnxDouble = 11;
+
+cpu::Tensor parseTensor(const uint8_t* data, size_t size, std::string* name) {
+    cpu::Tensor tensor;
+    int dataType = onnxFloat;
+    const uint8_t* rawData = nullptr;
+    size_t rawSize = 0;
+    std::vector<int64_t> intData;
+
+    ProtoReader reader(data, size);
+    ProtoField field;
+    while (reader.next(field)) {
+        switch (field.number) {
+            case 1: // dims
+                readProtoInts(field, tensor.dims);
+                break;
+            case 2: // data_type
+                dataType = static_cast<int>(field.varint);
+                break;
+            case 4: // float_data
+                readProtoFloats(field, tensor.floats);
+                break;
+            case 5: // int32_data
+            case 7: // int64_data
+                readProtoInts(field, intData);
+                break;
+            case 8: // name
+                if (name)
+                    *name = protoString(field);
+                break;
+            case 9: // raw_data
+                rawData = field.data;
+                rawSize = field.size;
+                break;
+            case 14: // data_location
+                if (field.varint != 0)
+                    throw std::runtime_error("external tensor data is not supported");
+                break;
+            default:
+                break;
+        }
+    }
+
+    switch (dataType) {
+        case onnxFloat:
+            tensor.type = cpu::DataType::Float;
+            if (rawData) {
+                tensor.floats.resize(rawSize / sizeof(float));
+                std::memcpy(tensor.floats.data(), rawData, tensor.floats.size() * sizeof(float));
+            }
+            break;
+        case onnxDouble:
+            tensor.type = cpu::DataType::Float;
+            if (rawData) {
+                std::vector<double> doubles(rawSize / sizeof(double));
+                std::memcpy(doubles.data(), rawData, doubles.size() * sizeof(double));
+                tensor.floats.assign(doubles.begin(), doubles.end());
+            }
+            break;
+        case onnxInt32:
+            tensor.type = cpu::DataType::Int64;
+            if (rawData) {
+                std::vector<int32_t> ints(rawSize / sizeof(int32_t));
+                std::memcpy(ints.data(), rawData, ints.size() * sizeof(int32_t));
+                tensor.ints.assign(ints.begin(), ints.end());
+            } else {
+                tensor.ints = std::move(intData);
+            }
+            break;
+        case onnxInt64:
+            tensor.type = cpu::DataType::Int64;
+            if (rawData) {
+                tensor.ints.resize(rawSize / sizeof(int64_t));
+                std::memcpy(tensor.ints.data(), rawData, tensor.ints.size() * sizeof(int64_t));
+            } else {
+                tensor.ints = std::move(intData);
+            }
+            break;
+        default:
+            throw std::runtime_error("unsupported tensor data type " + std::to_string(dataType));
+    }
+
+    const auto count = tensor.type == cpu::DataType::Float ? tensor.floats.size() : tensor.ints.size();
+    if (static_cast<int64_t>(count) != tensor.size())
+        throw std::runtime_error("tensor data does not match its dimensions");
+    return tensor;
+}
+
+cpu::Attribute parseAttribute(const uint8_t* data, size_t size, std::string& name) {
+    cpu::Attribute attribute;
+    ProtoReader reader(data, size);
+    ProtoField field;
+    while (reader.next(field)) {
+        switch (field.number) {
+            case 1: // name
+                name = protoString(field);
+                break;
+            case 2: // f
+                attribute.f = protoFloat(field);
+                break;
+            case 3: // i
+                attribute.i = static_cast<int64_t>(field.varint);
+                break;
+            case 4: // s
+                attribute.s = protoString(field);
+                break;
+            case 5: // t
+                attribute.t = parseTensor(field.data, field.size, nullptr);
+                break;
+            case 7: // floats
+                readProtoFloats(field, attribute.floats);
+                break;
+            case 8: // ints
+                readProtoInts(field, attribute.ints);
+                break;
+            default:
+                break;
+        }
+    }
+    return attribute;
+}
+
+cpu::Node parseNode(const uint8_t* data, size_t size) {
+    cpu::Node node;
+    ProtoReader reader(data, size);
+    ProtoField field;
+    while (reader.next(field)) {
+        switch (field.number) {
+            case 1: // input
+                node.inputs.push_back(protoString(field));
+                break;
+            case 2: // output
+                node.outputs.push_back(protoString(field));
+                break;
+            case 3: // name
+                node.name = protoString(field);
+                break;
+            case 4: // op_type
+                node.op = protoString(field);
+                break;
+            case 5: { // attribute
+                std::string name;
+                auto attribute = parseAttribute(field.data, field.size, name);
+                node.attributes[name] = std::move(attribute);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (node.name.empty() && !node.outputs.empty())
+        node.name = node.outputs[0];
+    return node;
+}
+
+cpu::ValueInfo parseValueInfo(const uint8_t* data, size_t size) {
+    cpu::ValueInfo info;
+    ProtoReader reader(data, size);
+    ProtoField field;
+    while (reader.next(field)) {
+        if (field.number == 1) {
+            info.name = protoString(field);
+        } else if (field.number == 2) {
+            // TypeProto.tensor_type.shape.dim
+            ProtoReader typeReader(field.data, field.size);
+            ProtoField typeField;
+            while (typeReader.next(typeField)) {
+                if (typeField.number != 1)
+                    continue;
+                ProtoReader tensorReader(typeField.data, typeField.size);
+                ProtoField tensorField;
+                while (tensorReader.next(tensorField)) {
+                    if (tensorField.number != 2)
+                        continue;
+                    ProtoReader shapeReader(tensorField.data, tensorField.size);
+                    ProtoField shapeField;
+                    while (shapeReader.next(shapeField)) {
+                        if (shapeField.number != 1)
+                            continue;
+                        int64_t dim = -1;
+                        ProtoReader dimReader(shapeField.data, shapeField.size);
+                        ProtoField dimField;
+                        while (dimReader.next(dimField)) {
+                            if (dimField.number == 1)
+                                dim = static_cast<int64_t>(dimField.varint);
+                        }
+                        info.dims.push_back(dim);
+                    }
+                }
+            }
+        }
+    }
+    return info;
+}
+
+cpu::Graph cpu::parseOnnx(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        throw std::runtime_error("could not open model \"" + path + "\"");
+    std::vector<uint8_t> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+
+    Graph graph;
+    bool hasGraph = false;
+    ProtoReader modelReader(buffer.data(), buffer.size());
+    ProtoField modelField;
+    while (modelReader.next(modelField)) {
+        if (modelField.number != 7) // graph
+            continue;
+        hasGraph = true;
+
+        ProtoReader graphReader(modelField.data, modelField.size);
+        ProtoField field;
+        while (graphReader.next(field)) {
+            switch (field.number) {
+                case 1: // node
+                    graph.nodes.push_back(parseNode(field.data, field.size));
+                    break;
+                case 5: { // initializer
+                    std::string name;
+                    auto tensor = parseTensor(field.data, field.size, &name);
+                    graph.initializers[name] = std::move(tensor);
+                    break;
+                }
+                case 11: // input
+                    graph.inputs.push_back(parseValueInfo(field.data, field.size));
+                    break;
+                case 12: // output
+                    graph.outputs.push_back(parseValueInfo(field.data, field.size));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    if (!hasGraph)
+        throw std::runtime_error("model \"" + path + "\" has no graph");
+
+    // Older exporters list initializers as graph inputs as well
+    std::erase_if(graph.inputs, [&](const ValueInfo& input) {
+        return graph.initializers.find(input.name) != graph.initializers.end();
+    });
+    return graph;
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef WAIFU2X_TENSORRT_CPU_ONNX_H
+#define WAIFU2X_TENSORRT_CPU_ONNX_H
+
+#include "graph.h"
+#include <string>
+
+namespace cpu {
+    // Reads the subset of the ONNX protobuf schema produced by models/export_onnx.py
+    Graph parseOnnx(const std::string& path);
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_ONNX_H
\ No newline at end of file
@@ -0,0 +1,534 @@
+#include "optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+int64_t getElementCount(const cpu::Shape& shape) {
+    int64_t count = 1;
+    for (const auto dim : shape)
+        count *= dim;
+    return count;
+}
+
+// Strides of shape right-aligned to rank, zero along broadcast dimensions
+std::vector<int64_t> getBroadcastStrides(const cpu::Shape& shape, size_t rank) {
+    std::vector<int64_t> strides(rank, 0);
+    int64_t stride = 1;
+    for (size_t i = 0; i < shape.size(); ++i) {
+        const auto axis = shape.size() - 1 - i;
+        strides[rank - 1 - i] = shape[axis] == 1 ? 0 : stride;
+        stride *= shape[axis];
+    }
+    return strides;
+}
+
+double getValue(const cpu::Tensor& tensor, int64_t index) {
+    return tensor.type == cpu::DataType::Float
+        ? static_cast<double>(tensor.floats[index]) : static_cast<double>(tensor.ints[index]);
+}
+
+void setValue(cpu::Tensor& tensor, int64_t index, double value) {
+    if (tensor.type == cpu::DataType::Float)
+        tensor.floats[index] = static_cast<float>(value);
+    else
+        tensor.ints[index] = static_cast<int64_t>(value);
+}
+
+cpu::Tensor createTensor(cpu::DataType type, const cpu::Shape& dims) {
+    cpu::Tensor tensor;
+    tensor.type = type;
+    tensor.dims = dims;
+    if (type == cpu::DataType::Float)
+        tensor.floats.resize(getElementCount(dims));
+    else
+        tensor.ints.resize(getElementCount(dims));
+    return tensor;
+}
+
+cpu::Tensor evaluateBinary(const std::string& op, const cpu::Tensor& a, const cpu::Tensor& b) {
+    const auto type = a.type == cpu::DataType::Int64 && b.type == cpu::DataType::Int64
+        ? cpu::DataType::Int64 : cpu::DataType::Float;
+    auto y = createTensor(type, cpu::broadcastShapes(a.dims, b.dims));
+    const auto rank = y.dims.size();
+    const auto stridesA = getBroadcastStrides(a.dims, rank);
+    const auto stridesB = getBroadcastStrides(b.dims, rank);
+
+    std::vector<int64_t> index(rank, 0);
+    for (int64_t i = 0; i < y.size(); ++i) {
+        int64_t ia = 0, ib = 0;
+        for (size_t d = 0; d < rank; ++d) {
+            ia += index[d] * stridesA[d];
+            ib += index[d] * stridesB[d];
+        }
+        const auto va = getValue(a, ia);
+        const auto vb = getValue(b, ib);
+        if (op == "Add")
+            setValue(y, i, va + vb);
+        else if (op == "Sub")
+            setValue(y, i, va - vb);
+        else if (op == "Mul")
+            setValue(y, i, va * vb);
+        else if (type == cpu::DataType::Int64)
+            setValue(y, i, static_cast<double>(static_cast<int64_t>(va) / static_cast<int64_t>(vb)));
+        else
+            setValue(y, i, va / vb);
+
+        for (auto d = static_cast<int64_t>(rank) - 1; d >= 0 && ++index[d] == y.dims[d]; --d)
+            index[d] = 0;
+    }
+    return y;
+}
+
+struct GraphOptimizer {
+    cpu::Graph& graph;
+    std::map<std::string, cpu::Shape> shapes;
+    cpu::OptimizationReport report;
+
+    [[nodiscard]] bool isConstant(const std::string& name) const {
+        return !name.empty() && graph.findConstant(name);
+    }
+
+    // Integer constant at an input of a node, null when the input is missing or computed
+    [[nodiscard]] const std::vector<int64_t>* findConstantInts(const cpu::Node& node, size_t index) const {
+        if (index >= node.inputs.size() || !isConstant(node.inputs[index]))
+            return nullptr;
+        const auto* constant = graph.findConstant(node.inputs[index]);
+        return constant->type == cpu::DataType::Int64 ? &constant->ints : nullptr;
+    }
+
+    [[nodiscard]] int countUses(const std::string& name) const {
+        int uses = 0;
+        for (const auto& node : graph.nodes) {
+            if (!node.op.empty())
+                uses += static_cast<int>(std::count(node.inputs.begin(), node.inputs.end(), name));
+        }
+        for (const auto& output : graph.outputs)
+            uses += output.name == name;
+        return uses;
+    }
+
+    cpu::Node* findProducer(const std::string& name) {
+        for (auto& node : graph.nodes) {
+            if (!node.op.empty() && !node.outputs.empty() && node.outputs[0] == name)
+                return &node;
+        }
+        return nullptr;
+    }
+
+    std::vector<cpu::Node*> findConsumers(const std::string& name) {
+        std::vector<cpu::Node*> consumers;
+        for (auto& node : graph.nodes) {
+            if (!node.op.empty() && std::find(node.inputs.begin(), node.inputs.end(), name) != node.inputs.end())
+                consumers.push_back(&node);
+        }
+        return consumers;
+    }
+
+    // The only consumer of a value that is not a graph output
+    cpu::Node* findSingleConsumer(const std::string& name) {
+        const auto consumers = findConsumers(name);
+        return consumers.size() == 1 && countUses(name) == 1 ? consumers[0] : nullptr;
+    }
+
+    void replaceUses(const std::string& from, const std::string& to) {
+        for (auto& node : graph.nodes)
+            std::replace(node.inputs.begin(), node.inputs.end(), from, to);
+        for (auto& output : graph.outputs) {
+            if (output.name == from)
+                output.name = to;
+        }
+    }
+
+    // Nodes are removed by clearing their op and erased at the end of each pass
+    void removeNodes() {
+        graph.nodes.erase(std::remove_if(graph.nodes.begin(), graph.nodes.end(),
+            [](const cpu::Node& node) { return node.op.empty(); }), graph.nodes.end());
+    }
+
+    [[nodiscard]] cpu::GraphStats getStats(const cpu::Graph& target) const {
+        cpu::GraphStats stats;
+        auto getBytes = [&](const std::string& name) -> uint64_t {
+            if (name.empty())
+                return 0;
+            if (const auto* constant = target.findConstant(name))
+                return constant->size() * (constant->type == cpu::DataType::Float ? sizeof(float) : sizeof(int64_t));
+            const auto it = shapes.find(name);
+            return it == shapes.end() ? 0 : getElementCount(it->second) * sizeof(float);
+        };
+        for (const auto& node : target.nodes) {
+            if (node.op == "Constant")
+                continue;
+            ++stats.ops;
+            for (const auto& input : node.inputs)
+                stats.traffic += getBytes(input);
+            stats.traffic += getBytes(node.outputs[0]);
+        }
+        return stats;
+    }
+
+    void hoistConstants() {
+        for (auto& node : graph.nodes) {
+            if (node.op != "Constant" || node.outputs.empty())
+                continue;
+            const auto value = node.attributes.find("value");
+            if (value == node.attributes.end())
+                continue;
+            graph.initializers[node.outputs[0]] = value->second.t;
+            node.op.clear();
+        }
+        removeNodes();
+    }
+
+    [[nodiscard]] bool canFold(const cpu::Node& node) const {
+        static const std::set<std::string> foldable = {
+            "Identity", "Cast", "Shape", "Reshape", "Flatten", "Squeeze", "Unsqueeze",
+            "Gather", "Concat", "Add", "Sub", "Mul", "Div", "Sqrt"
+        };
+        if (foldable.find(node.op) == foldable.end())
+            return false;
+        if (node.op == "Shape")
+            return isConstant(node.inputs[0]) || shapes.find(node.inputs[0]) != shapes.end();
+        return std::all_of(node.inputs.begin(), node.inputs.end(),
+            [&](const std::string& input) { return input.empty() || isConstant(input); });
+    }
+
+    cpu::Tensor evaluate(const cpu::Node& node) {
+        if (node.op == "Shape") {
+            const auto* constant = graph.findConstant(node.inputs[0]);
+            const auto& dims = constant ? constant->dims : shapes.at(node.inputs[0]);
+            auto y = createTensor(cpu::DataType::Int64, {static_cast<int64_t>(dims.size())});
+            y.ints = dims;
+            return y;
+        }
+
+        const auto& x = *graph.findConstant(node.inputs[0]);
+        if (node.op == "Identity" || node.op == "Reshape" || node.op == "Flatten" ||
+            node.op == "Squeeze" || node.op == "Unsqueeze") {
+            auto y = x;
+            y.dims = cpu::inferShape(graph, node, shapes);
+            return y;
+        }
+        if (node.op == "Cast") {
+            const auto to = node.getInt("to", 1);
+            if (to != 1 && to != 6 && to != 7)
+                throw std::runtime_error("cast of constant \"" + node.inputs[0] + "\" to type "
+                    + std::to_string(to) + " is not supported");
+            auto y = createTensor(to == 1 ? cpu::DataType::Float : cpu::DataType::Int64, x.dims);
+            for (int64_t i = 0; i < x.size(); ++i)
+                setValue(y, i, to == 1 ? getValue(x, i) : std::trunc(getValue(x, i)));
+            return y;
+        }
+        if (node.op == "Sqrt") {
+            auto y = createTensor(cpu::DataType::Float, x.dims);
+            for (int64_t i = 0; i < x.size(); ++i)
+                y.floats[i] = static_cast<float>(std::sqrt(getValue(x, i)));
+            return y;
+        }
+        if (node.op == "Gather" || node.op == "Concat") {
+            const auto dims = cpu::inferShape(graph, node, shapes);
+            const auto rank = static_cast<int64_t>(x.dims.size());
+            auto axis = node.getInt("axis", 0);
+            if (axis < 0)
+                axis += rank;
+            int64_t outer = 1, inner = 1;
+            for (int64_t d = 0; d < axis; ++d)
+                outer *= x.dims[d];
+            for (int64_t d = axis + 1; d < rank; ++d)
+                inner *= x.dims[d];
+
+            auto y = createTensor(x.type, dims);
+            int64_t offset = 0;
+            auto copy = [&](const cpu::Tensor& src, int64_t begin, int64_t count) {
+                for (int64_t i = 0; i < count; ++i)
+                    setValue(y, offset++, getValue(src, begin + i));
+            };
+            for (int64_t o = 0; o < outer; ++o) {
+                if (node.op == "Gather") {
+                    for (auto index : graph.findConstant(node.inputs[1])->ints) {
+                        if (index < 0)
+                            index += x.dims[axis];
+                        copy(x, (o * x.dims[axis] + index) * inner, inner);
+                    }
+                } else {
+                    for (const auto& input : node.inputs) {
+                        const auto& src = *graph.findConstant(input);
+                        copy(src, o * src.dims[axis] * inner, src.dims[axis] * inner);
+                    }
+                }
+            }
+            return y;
+        }
+        return evaluateBinary(node.op, x, *graph.findConstant(node.inputs[1]));
+    }
+
+    // Also records the shape of every value, folded or not
+    void foldConstants(const cpu::Shape& inputShape) {
+        shapes[graph.inputs[0].name] = inputShape;
+        for (auto& node : graph.nodes) {
+            if (canFold(node)) {
+                auto value = evaluate(node);
+                shapes[node.outputs[0]] = value.dims;
+                graph.initializers[node.outputs[0]] = std::move(value);
+                node.op.clear();
+                ++report.folded;
+                continue;
+            }
+            shapes[node.outputs[0]] = cpu::inferShape(graph, node, shapes);
+        }
+        removeNodes();
+    }
+
+    [[nodiscard]] bool isNoOp(const cpu::Node& node) const {
+        if (node.op == "Identity" || node.op == "Dropout")
+            return true;
+        if (node.op == "Cast" && node.getInt("to", 1) != 1)
+            return false;
+        if (node.op != "Reshape" && node.op != "Flatten" && node.op != "Squeeze" && node.op != "Unsqueeze" &&
+            node.op != "Expand" && node.op != "Slice" && node.op != "Pad" && node.op != "Cast")
+            return false;
+        // Besides the unchanged shape, the constants must say the node copies its input: slices
+        // start at 0 with unit steps and pads are all 0
+        if (node.op == "Slice") {
+            const auto* starts = findConstantInts(node, 1);
+            const auto* steps = findConstantInts(node, 4);
+            const auto hasSteps = node.inputs.size() > 4 && !node.inputs[4].empty();
+            if (!starts || std::any_of(starts->begin(), starts->end(), [](int64_t start) { return start != 0; }) ||
+                (hasSteps && (!steps || std::any_of(steps->begin(), steps->end(), [](int64_t step) { return step != 1; }))))
+                return false;
+        } else if (node.op == "Pad") {
+            // Attribute before opset 11, constant input after
+            const auto attributePads = node.getInts("pads", {});
+            const auto* pads = node.hasAttribute("pads") ? &attributePads : findConstantInts(node, 1);
+            if (!pads || std::any_of(pads->begin(), pads->end(), [](int64_t pad) { return pad != 0; }))
+                return false;
+        }
+        const auto input = shapes.find(node.inputs[0]);
+        return input != shapes.end() && input->second == shapes.at(node.outputs[0]);
+    }
+
+    // An Expand that only feeds elementwise ops which broadcast to the same shape anyway
+    bool isRedundantExpand(const cpu::Node& node) {
+        if (node.op != "Expand")
+            return false;
+        const auto consumers = findConsumers(node.outputs[0]);
+        return !consumers.empty() && countUses(node.outputs[0]) == static_cast<int>(consumers.size()) &&
+            std::all_of(consumers.begin(), consumers.end(), [&](const cpu::Node* consumer) {
+                return (consumer->op == "Add" || consumer->op == "Sub" || consumer->op == "Mul" || consumer->op == "Div") &&
+                    shapes.at(consumer->outputs[0]) == shapes.at(node.outputs[0]);
+            });
+    }
+
+    void eliminateNoOps() {
+        for (auto& node : graph.nodes) {
+            if (isConstant(node.inputs[0]) || (!isNoOp(node) && !isRedundantExpand(node)))
+                continue;
+            replaceUses(node.outputs[0], node.inputs[0]);
+            node.op.clear();
+            ++report.eliminated;
+        }
+        removeNodes();
+    }
+
+    [[nodiscard]] bool isPointwiseConv(const cpu::Node* node) const {
+        if (!node || node->op != "Conv" || node->getInt("group", 1) != 1 || !isConstant(node->inputs[1]))
+            return false;
+        const auto& dims = graph.findConstant(node->inputs[1])->dims;
+        return dims.size() == 4 && dims[2] == 1 && dims[3] == 1 &&
+            node->getInts("pads", {0, 0, 0, 0}) == std::vector<int64_t>{0, 0, 0, 0} &&
+            node->getInts("strides", {1, 1}) == std::vector<int64_t>{1, 1};
+    }
+
+    [[nodiscard]] bool isGlobalPool(const cpu::Node* node) const {
+        if (!node)
+            return false;
+        if (node->op == "GlobalAveragePool")
+            return true;
+        if (node->op != "ReduceMean" || node->getInt("keepdims", 1) == 0)
+            return false;
+        const auto it = shapes.find(node->inputs[0]);
+        return it != shapes.end() && it->second.size() == 4 && shapes.at(node->outputs[0]) ==
+            cpu::Shape{it->second[0], it->second[1], 1, 1};
+    }
+
+    // x * sigmoid(conv(relu(conv(mean(x))))) as exported from nunif's SEBlock
+    void fuseSqueezeExcitation() {
+        for (auto& node : graph.nodes) {
+            if (node.op != "Mul" || node.inputs.size() != 2)
+                continue;
+            for (int i = 0; i < 2; ++i) {
+                const auto& x = node.inputs[i];
+                auto* sigmoid = findProducer(node.inputs[1 - i]);
+                if (!sigmoid || sigmoid->op != "Sigmoid" || !findSingleConsumer(sigmoid->outputs[0]))
+                    continue;
+                auto* excite = findProducer(sigmoid->inputs[0]);
+                if (!isPointwiseConv(excite) || !findSingleConsumer(excite->outputs[0]))
+                    continue;
+                auto* relu = findProducer(excite->inputs[0]);
+                if (!relu || relu->op != "Relu" || !findSingleConsumer(relu->outputs[0]))
+                    continue;
+                auto* squeeze = findProducer(relu->inputs[0]);
+                if (!isPointwiseConv(squeeze) || !findSingleConsumer(squeeze->outputs[0]))
+                    continue;
+                auto* pool = findProducer(squeeze->inputs[0]);
+                if (!isGlobalPool(pool) || pool->inputs[0] != x || !findSingleConsumer(pool->outputs[0]) ||
+                    shapes.at(x) != shapes.at(node.outputs[0]))
+                    continue;
+
+                node.op = "SqueezeExcitation";
+                node.inputs = {
+                    x,
+                    squeeze->inputs[1], squeeze->inputs.size() > 2 ? squeeze->inputs[2] : "",
+                    excite->inputs[1], excite->inputs.size() > 2 ? excite->inputs[2] : ""
+                };
+                node.attributes.clear();
+                for (auto* fused : {sigmoid, excite, relu, squeeze, pool})
+                    fused->op.clear();
+                report.fused += 5;
+                break;
+            }
+        }
+        removeNodes();
+    }
+
+    [[nodiscard]] std::string getUniqueName(const std::string& base) const {
+        auto name = base;
+        for (int i = 1; graph.initializers.count(name) || shapes.count(name); ++i)
+            name = base + "_" + std::to_string(i);
+        return name;
+    }
+
+    [[nodiscard]] static int getOutputChannels(const cpu::Node& node, const cpu::Tensor& weights) {
+        return static_cast<int>(node.op == "Conv" ? weights.dims[0] : weights.dims[1] * node.getInt("group", 1));
+    }
+
+    // conv(x) + c and conv(x) - c with a per-channel constant c
+    void fuseBiases() {
+        for (auto& node : graph.nodes) {
+            if ((node.op != "Conv" && node.op != "ConvTranspose") || node.hasAttribute("activation") ||
+                !isConstant(node.inputs[1]))
+                continue;
+            auto* add = findSingleConsumer(node.outputs[0]);
+            if (!add || (add->op != "Add" && add->op != "Sub") || add->inputs.size() != 2)
+                continue;
+            const auto constantIndex = add->inputs[0] == node.outputs[0] ? 1 : 0;
+            if ((add->op == "Sub" && constantIndex == 0) || !isConstant(add->inputs[constantIndex]))
+                continue;
+
+            const auto& c = *graph.findConstant(add->inputs[constantIndex]);
+            const auto channels = getOutputChannels(node, *graph.findConstant(node.inputs[1]));
+            auto dims = c.dims;
+            while (dims.size() < 4)
+                dims.insert(dims.begin(), 1);
+            if (c.type != cpu::DataType::Float || dims != cpu::Shape{1, channels, 1, 1})
+                continue;
+
+            std::vector<float> bias(channels, 0.0f);
+            if (node.inputs.size() > 2 && !node.inputs[2].empty())
+                bias = graph.findConstant(node.inputs[2])->floats;
+            for (int i = 0; i < channels; ++i)
+                bias[i] += add->op == "Add" ? c.floats[i] : -c.floats[i];
+
+            const auto name = getUniqueName(node.name + "_fused_bias");
+            auto& tensor = graph.initializers[name];
+            tensor.type = cpu::DataType::Float;
+            tensor.dims = {channels};
+            tensor.floats = std::move(bias);
+            node.inputs.resize(3);
+            node.inputs[2] = name;
+            node.outputs[0] = add->outputs[0];
+            add->op.clear();
+            ++report.fused;
+        }
+        removeNodes();
+    }
+
+    // Only piecewise linear activations, which the kernels apply before storing. Adds of two
+    // values, e.g. the final skip connection of CUNet followed by a clip, take them as well.
+    void fuseActivations() {
+        for (auto& node : graph.nodes) {
+            const auto isAdd = node.op == "Add" && node.inputs.size() == 2 &&
+                !isConstant(node.inputs[0]) && !isConstant(node.inputs[1]);
+            if ((node.op != "Conv" && node.op != "ConvTranspose" && !isAdd) || node.hasAttribute("activation"))
+                continue;
+            auto* activation = findSingleConsumer(node.outputs[0]);
+            if (!activation || activation->inputs[0] != node.outputs[0])
+                continue;
+
+            std::vector<float> params;
+            if (activation->op == "LeakyRelu") {
+                params = {activation->getFloat("alpha", 0.01f)};
+            } else if (activation->op == "Clip") {
+                params = {
+                    activation->getFloat("min", std::numeric_limits<float>::lowest()),
+                    activation->getFloat("max", std::numeric_limits<float>::max())
+                };
+                for (int i = 1; i <= 2 && i < activation->inputs.size(); ++i) {
+                    if (activation->inputs[i].empty())
+                        continue;
+                    const auto* bound = graph.findConstant(activation->inputs[i]);
+                    if (!bound || bound->type != cpu::DataType::Float || bound->floats.empty())
+                        params.clear();
+                    else if (!params.empty())
+                        params[i - 1] = bound->floats[0];
+                }
+                if (params.empty())
+                    continue;
+            } else if (activation->op != "Relu") {
+                continue;
+            }
+
+            node.attributes["activation"].s = activation->op;
+            node.attributes["activation_params"].floats = params;
+            node.outputs[0] = activation->outputs[0];
+            activation->op.clear();
+            ++report.fused;
+        }
+        removeNodes();
+    }
+
+    void removeDeadNodes() {
+        for (auto removed = true; removed;) {
+            removed = false;
+            for (auto& node : graph.nodes) {
+                if (countUses(node.outputs[0]) == 0) {
+                    node.op.clear();
+                    ++report.eliminated;
+                    removed = true;
+                }
+            }
+            removeNodes();
+        }
+
+        std::set<std::string> used;
+        for (const auto& node : graph.nodes)
+            used.insert(node.inputs.begin(), node.inputs.end());
+        for (auto it = graph.initializers.begin(); it != graph.initializers.end();) {
+            if (used.count(it->first))
+                ++it;
+            else
+                it = graph.initializers.erase(it);
+        }
+    }
+};
+
+cpu::OptimizationReport cpu::optimizeGraph(Graph& graph, const Shape& inputShape) {
+    if (graph.inputs.size() != 1 || graph.outputs.size() != 1)
+        throw std::runtime_error("graph must have exactly one input and one output");
+
+    // Folding records the shape of every value, so the original graph is measured afterwards
+    const auto original = graph;
+    GraphOptimizer optimizer{graph, {}, {}};
+    optimizer.hoistConstants();
+    optimizer.foldConstants(inputShape);
+    optimizer.report.before = optimizer.getStats(original);
+
+    optimizer.eliminateNoOps();
+    optimizer.fuseSqueezeExcitation();
+    optimizer.fuseBiases();
+    optimizer.fuseActivations();
+    optimizer.removeDeadNodes();
+    optimizer.report.after = optimizer.getStats(graph);
+    return optimizer.report;
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef WAIFU2X_TENSORRT_CPU_OPTIMIZER_H
+#define WAIFU2X_TENSORRT_CPU_OPTIMIZER_H
+
+#include "graph.h"
+#include <cstdint>
+
+namespace cpu {
+    struct GraphStats {
+        int ops = 0;
+        uint64_t traffic = 0; // estimated bytes read and written by one run
+    };
+
+    struct OptimizationReport {
+        GraphStats before;
+        GraphStats after;
+        int folded = 0;
+        int eliminated = 0;
+        int fused = 0;
+    };
+
+    // Rewrites the graph for a fixed input shape: folds constant subgraphs, removes no-op
+    // reshapes, slices and pads, and fuses SE blocks, biases and activations into single ops.
+    // Fused convolutions carry "activation" and "activation_params" attributes, fused SE blocks
+    // become SqueezeExcitation nodes with inputs (x, w1, b1, w2, b2).
+    OptimizationReport optimizeGraph(Graph& graph, const Shape& inputShape);
+}
+
+#endif //WAIFU2X_TENSORRT_CPU_OPTIMIZER_H
\ No newline at end of file
@@ -1,14 +1,40 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <filesystem>
+#include <future>
+#include <numeric>
+#include <queue>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include <CLI/CLI.hpp>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include "cpu/benchmark.h"
+#include "cpu/cost.h"
+#include "cpu/img2img.h"
+#ifdef WAIFU2X_WITH_TENSORRT
 #include "tensorrt/img2img.h"
-#include "tensorrt/img2img.h"
+#endif
+#include "utilities/atlas.h"
+#include "utilities/baseline.h"
+#include "utilities/cascade.h"
+#include "utilities/counters.h"
+#include "utilities/dispatcher.h"
+#include "utilities/duplicates.h"
+#include "utilities/hash.h"
+#include "utilities/motion.h"
 #include "utilities/path.h"
+#include "utilities/profile.h"
+#include "utilities/threadpool.h"
+#include "utilities/time.h"
+#include "utilities/workers.h"
+#include "videoio/animation.h"
+#include "videoio/capture.h"
+#include "videoio/renditions.h"
 
 int main(int argc, char *argv[]) {
+    const auto startTime = std::chrono::steady_clock::now();
     auto console = spdlog::stdout_color_mt("console");
     console->set_level(spdlog::level::info);
     console->set_pattern("[%H:%M:%S.%e] [%^%l%$] %v");
@@ -34,6 +60,11 @@ int main(int argc, char *argv[]) {
         ->check(CLI::IsMember(modelChoices))
         ->required();
 
+    std::string cascadeModel;
+    app.add_option("--cascade", cascadeModel)
+        ->description("Set a heavier model to render the tiles with the most detail again")
+        ->check(CLI::IsMember(modelChoices));
+
     int scale;
     const auto scaleChoices = {
         1, 2, 4
@@ -52,11 +83,10 @@ int main(int argc, char *argv[]) {
         ->check(CLI::IsMember(noiseChoices))
         ->required();
 
-    int batchSize;
+    int batchSize = 0;
     app.add_option("--batchSize", batchSize)
-        ->description("Set the batch size")
-        ->check(CLI::PositiveNumber)
-        ->required();
+        ->description("Set the batch size, required without --profile")
+        ->check(CLI::PositiveNumber);
 
     int tileSize;
     const auto tileSizeChoices = {
@@ -67,6 +97,7 @@ int main(int argc, char *argv[]) {
         ->check(CLI::IsMember(tileSizeChoices))
         ->required();
 
+#ifdef WAIFU2X_WITH_TENSORRT
     int deviceId = 0;
     app.add_option("--device", deviceId)
         ->description("Set the GPU device ID")
@@ -83,13 +114,65 @@ int main(int argc, char *argv[]) {
         ->default_val(precision)
         ->transform(CLI::CheckedTransformer(precisionMap, CLI::ignore_case));
 
+    std::string backend = "tensorrt";
+    const auto backendChoices = {
+        "tensorrt", "cpu", "hybrid"
+    };
+#else
+    // Built without the TensorRT backend
+    std::string backend = "cpu";
+    const auto backendChoices = {
+        "cpu"
+    };
+#endif
+    app.add_option("--backend", backend)
+        ->description("Set the inference backend")
+        ->default_val(backend)
+        ->check(CLI::IsMember(backendChoices));
+
+    int threads = 0;
+    app.add_option("--threads", threads)
+        ->description("Set the number of CPU threads, 0 uses all (cpu backend only)")
+        ->default_val(threads)
+        ->check(CLI::NonNegativeNumber);
+
+    int instances = 1;
+    app.add_option("--instances", instances)
+        ->description("Split the tiles of a frame across this many CPU backend instances, sharing the threads (cpu and hybrid backends only)")
+        ->default_val(instances)
+        ->check(CLI::PositiveNumber);
+
+    int workers = 0;
+    app.add_option("--workers", workers)
+        ->description("Render the input files in this many forked processes sharing the loaded model (cpu backend only)")
+        ->default_val(workers)
+        ->check(CLI::NonNegativeNumber);
+
+    int maxRestarts = 3;
+    app.add_option("--max-restarts", maxRestarts)
+        ->description("Set how often a crashed worker process is forked again")
+        ->default_val(maxRestarts)
+        ->check(CLI::NonNegativeNumber);
+
+    std::string profile;
+    const std::map<std::string, utils::ExecutionProfile> profileMap = {
+        {"latency", utils::ExecutionProfile::Latency},
+        {"throughput", utils::ExecutionProfile::Throughput},
+        {"balanced", utils::ExecutionProfile::Balanced}
+    };
+    app.add_option("--profile", profile)
+        ->description("Set the batch size, workers, threads and video frames in flight the options not given default to")
+        ->check(CLI::IsMember(profileMap));
+
+    // Video frames streamed through the TensorRT engine at a time, set by the profile
+    int framesInFlight = 2;
+
     auto render = app.add_subcommand("render", "Render image(s)/video(s)");
 
-    // std::vector<std::filesystem::path> inputPaths;
-    // render->add_option("-i, --input", inputPaths)
-    //     ->description("Set the input paths")
-    //     ->check(CLI::ExistingPath)
-    //     ->required();
+    std::vector<std::filesystem::path> inputPaths;
+    render->add_option("-i, --input", inputPaths)
+        ->description("Set the input paths, renders the camera when empty")
+        ->check(CLI::ExistingPath);
 
     bool recursive = false;
     render->add_flag("--recursive", recursive)
@@ -109,11 +192,66 @@ int main(int argc, char *argv[]) {
         ->default_val(blend)
         ->check(CLI::IsMember(blendChoices));
 
+    bool atlas = false;
+    render->add_flag("--atlas", atlas)
+        ->description("Pack input images smaller than a tile into shared tiles");
+
+    std::filesystem::path duplicateIndexPath;
+    render->add_option("--duplicate-index", duplicateIndexPath)
+        ->description("Flag input images that are near-duplicates of images in this index, and add the rendered ones to it");
+
+    utils::DuplicateConfig duplicateConfig;
+    render->add_option("--duplicate-distance", duplicateConfig.maxDistance)
+        ->description("Set the number of differing bits of the perceptual hashes up to which images are near-duplicates")
+        ->default_val(duplicateConfig.maxDistance)
+        ->check(CLI::Range(0, 64));
+
+    bool reuseDuplicates = false;
+    render->add_flag("--reuse-duplicates", reuseDuplicates)
+        ->description("Render near-duplicates from the output of the image they duplicate when it aligns to them");
+
     bool tta = false;
     render->add_flag("--tta", tta)
         ->description("Enable test-time augmentation")
         ->default_val(tta);
 
+    bool wholeFrame = false;
+    render->add_flag("--whole-frame", wholeFrame)
+        ->description("Stream whole frames through the model instead of tiling them (cpu backend only)")
+        ->default_val(wholeFrame);
+
+    int warmup = 0;
+    render->add_option("--warmup", warmup)
+        ->description("Run this many blank batches when loading the model and report their latency")
+        ->default_val(warmup)
+        ->check(CLI::NonNegativeNumber);
+
+    bool counters = false;
+    render->add_flag("--counters", counters)
+        ->description("Report the hardware counters of every pipeline stage per tile (cpu backend only)")
+        ->default_val(counters);
+
+    double cascadeFraction = 0.25;
+    render->add_option("--cascade-fraction", cascadeFraction)
+        ->description("Set the share of the tiles the cascade model renders again")
+        ->default_val(cascadeFraction)
+        ->check(CLI::Range(0.0, 1.0));
+
+    double cascadeThreshold = -1.0;
+    render->add_option("--cascade-threshold", cascadeThreshold)
+        ->description("Render the tiles whose detail score is above this again instead of a share of them")
+        ->check(CLI::NonNegativeNumber);
+
+    bool motionReuse = false;
+    render->add_flag("--motion-reuse", motionReuse)
+        ->description("Shift the previous output along with pans and render only the tiles that changed (videos and camera only)");
+
+    int motionThreshold = 2;
+    render->add_option("--motion-threshold", motionThreshold)
+        ->description("Set the largest pixel difference of a tile to the shifted previous frame that still reuses it")
+        ->default_val(motionThreshold)
+        ->check(CLI::Range(0, 255));
+
     std::string codec = "libx264";
     render->add_option("--codec", codec)
         ->description("Set the codec (video only)")
@@ -130,14 +268,120 @@ int main(int argc, char *argv[]) {
         ->default_val(crf)
         ->check(CLI::Range(0, 51));
 
+    std::string preset;
+    const auto presetChoices = {
+        "ultrafast", "superfast", "veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow"
+    };
+    render->add_option("--preset", preset)
+        ->description("Set the encoder preset, the slowest one segments are encoded with (video only)");
+
+    std::string fastestPreset;
+    render->add_option("--fastest-preset", fastestPreset)
+        ->description("Set the fastest preset segments switch to while the encoders cannot keep up with the render (video only)")
+        ->check(CLI::IsMember(presetChoices));
+
+    int segmentFrames = 0;
+    render->add_option("--segment-frames", segmentFrames)
+        ->description("Encode the video in segments of this many frames by parallel encoders, 0 encodes it in one piece (video only)")
+        ->default_val(segmentFrames)
+        ->check(CLI::NonNegativeNumber);
+
+    int maxEncoders = 2;
+    render->add_option("--max-encoders", maxEncoders)
+        ->description("Set the number of segments encoded at the same time (video only)")
+        ->default_val(maxEncoders)
+        ->check(CLI::PositiveNumber);
+
+    std::vector<int> renditionHeights;
+    render->add_option("--rendition", renditionHeights)
+        ->description("Also write the video downscaled to these heights, from the same render (video only)")
+        ->check(CLI::PositiveNumber);
+
     auto build = app.add_subcommand("build", "Build model");
 
+    auto benchmark = app.add_subcommand("benchmark", "Benchmark the CPU kernels layer by layer");
+
+    int iterations = 10;
+    benchmark->add_option("--iterations", iterations)
+        ->description("Set the number of timed runs per kernel")
+        ->default_val(iterations)
+        ->check(CLI::PositiveNumber);
+
+    bool benchmarkHashes = false;
+    benchmark->add_flag("--hashes", benchmarkHashes)
+        ->description("Benchmark the hashes instead of the kernels");
+
+    benchmark->add_flag("--counters", counters)
+        ->description("Report the hardware counters of every layer");
+
+    std::string saveBaselineName;
+    benchmark->add_option("--save-baseline", saveBaselineName)
+        ->description("Record the run as a baseline of this host under this name");
+
+    std::string baselineName;
+    benchmark->add_option("--baseline", baselineName)
+        ->description("Compare the run against the baseline of this host under this name, failing when a metric regressed");
+
+    std::filesystem::path baselineDirectory = "baselines";
+    benchmark->add_option("--baseline-dir", baselineDirectory)
+        ->description("Set the directory baselines are kept in")
+        ->default_val(baselineDirectory);
+
+    utils::RegressionConfig regressionConfig;
+    benchmark->add_option("--regression-threshold", regressionConfig.threshold)
+        ->description("Set the relative change for the worse beyond which a metric regressed")
+        ->default_val(regressionConfig.threshold)
+        ->check(CLI::NonNegativeNumber);
+
+    auto modelInfo = app.add_subcommand("model-info", "Estimate the compute and memory cost of a tile");
+
+    bool perNode = false;
+    modelInfo->add_flag("--nodes", perNode)
+        ->description("Print the cost of every node");
+
     try {
         app.parse((argc), (argv));
-        if (model == "cunet/art" && scale == 4)
+        // Options given explicitly take precedence over the profile, workers only where they are supported
+        if (!profile.empty()) {
+            const auto profileConfig = utils::getProfileConfig(profileMap.at(profile),
+                static_cast<int>(std::thread::hardware_concurrency()));
+            if (app.count("--batchSize") == 0)
+                batchSize = profileConfig.batchSize;
+            const auto forking = backend == "cpu" && instances == 1 && !inputPaths.empty() && duplicateIndexPath.empty();
+            if (app.count("--workers") == 0 && forking && profileConfig.workers > 0) {
+                workers = profileConfig.workers;
+                if (app.count("--threads") == 0)
+                    threads = profileConfig.threads;
+            }
+            framesInFlight = profileConfig.framesInFlight;
+        }
+        if (batchSize == 0)
+            throw std::runtime_error("--batchSize is required without --profile.");
+        if ((model == "cunet/art" || cascadeModel == "cunet/art") && scale == 4)
             throw std::runtime_error("cunet/art does not support scale factor 4.");
         if (noise == -1 && scale == 1)
             throw std::runtime_error("Noise level -1 does not support scale factor 1.");
+        if (instances > 1 && backend == "tensorrt")
+            throw std::runtime_error("--instances needs the cpu or hybrid backend.");
+        if ((backend == "hybrid" || instances > 1) && (tta || wholeFrame))
+            throw std::runtime_error("Tiles split across backends do not support --tta and --whole-frame.");
+        if (!cascadeModel.empty() && (backend == "hybrid" || instances > 1 || tta || wholeFrame))
+            throw std::runtime_error("--cascade does not support the hybrid backend, --instances, --tta and --whole-frame.");
+        if (atlas && (backend == "hybrid" || instances > 1 || !cascadeModel.empty() || tta || wholeFrame))
+            throw std::runtime_error("--atlas does not support the hybrid backend, --instances, --cascade, --tta and --whole-frame.");
+        // Only upconv_7 is plain convolutions, cunet pools whole tiles and swin_unet attends past the crop
+        if (atlas && !model.starts_with("upconv_7/"))
+            throw std::runtime_error("--atlas needs an upconv_7 model.");
+        if (motionReuse && (backend == "hybrid" || instances > 1 || !cascadeModel.empty() || tta || wholeFrame))
+            throw std::runtime_error("--motion-reuse does not support the hybrid backend, --instances, --cascade, --tta and --whole-frame.");
+        if (workers > 0 && (backend != "cpu" || instances > 1 || inputPaths.empty() || !duplicateIndexPath.empty()))
+            throw std::runtime_error("--workers needs the cpu backend and input files, and does not support --instances and --duplicate-index.");
+        if (counters && render->parsed() && (backend != "cpu" || instances > 1 || !cascadeModel.empty()))
+            throw std::runtime_error("--counters needs the cpu backend, and does not support --instances and --cascade.");
+        if (benchmarkHashes && (!saveBaselineName.empty() || !baselineName.empty()))
+            throw std::runtime_error("--save-baseline and --baseline only track the kernels, not --hashes.");
+        if (!fastestPreset.empty() && (segmentFrames == 0 || std::find(presetChoices.begin(), presetChoices.end(), preset) == presetChoices.end()))
+            throw std::runtime_error("--fastest-preset needs --segment-frames and one of the x264 presets as --preset.");
     }
     catch (const CLI::ParseError& e) {
         return app.exit(e);
@@ -146,14 +390,40 @@ int main(int argc, char *argv[]) {
         std::cerr << e.what();
         exit(-1);
     };
+    const auto parseMilliseconds = utils::getElapsedMilliseconds(startTime, std::chrono::steady_clock::now());
     // endregion
 
+#ifdef WAIFU2X_WITH_TENSORRT
     trt::Img2Img engine;
+#endif
+    cpu::Img2Img cpuEngine;
 
-    const auto modelPath = "models/" + model + "/"
-        + (noise == -1 ? "" : "noise" + std::to_string(noise) + "_")
-        + (scale == 1 ? "" : "scale" + std::to_string(scale) + "x")
-        + ".onnx";
+    // Tiles of a frame are spread over every backend added to the dispatcher, the TensorRT engine
+    // first so that it keeps running on the main thread
+    const auto dispatching = backend == "hybrid" || instances > 1;
+    utils::TileDispatcher dispatcher;
+    std::vector<std::unique_ptr<cpu::Img2Img>> cpuInstances;
+
+    // The cascade model runs on the same backend and tile size as the main model
+    const auto cascading = !cascadeModel.empty();
+#ifdef WAIFU2X_WITH_TENSORRT
+    trt::Img2Img heavyEngine;
+#endif
+    cpu::Img2Img heavyCpuEngine;
+    utils::TileCascade cascade;
+    const utils::CascadeConfig cascadeConfig {
+        .fraction = cascadeFraction,
+        .threshold = cascadeThreshold
+    };
+
+    auto getModelPath = [&](const std::string& name) {
+        return "models/" + name + "/"
+            + (noise == -1 ? "" : "noise" + std::to_string(noise) + "_")
+            + (scale == 1 ? "" : "scale" + std::to_string(scale) + "x")
+            + ".onnx";
+    };
+    const auto modelPath = getModelPath(model);
+    const auto heavyModelPath = cascading ? getModelPath(cascadeModel) : std::string();
     std::replace(model.begin(), model.end(), '/', '_');
     const auto suffix = "(" + model + ")"
         + (noise == -1 ? "" : "(noise" + std::to_string(noise) + ")")
@@ -161,25 +431,653 @@ int main(int argc, char *argv[]) {
         + (tta ? "(tta)" : "");
 
     if (render->parsed()) {
-        trt::RenderConfig config {
-            .deviceId = deviceId,
-            .precision = precision,
-            .batchSize = batchSize,
-            .channels = 3,
-            .height = tileSize,
-            .width = tileSize,
-            .scaling = scale,
-            .overlap = cv::Point2d(blend, blend),
-            .tta = tta
+        auto logWarmup = [&](const std::string& name, const utils::WarmupResult& result) {
+            if (result.batches > 0) {
+                console->info("Warmed up {} with {} batches: first {:.2f} ms, then {:.2f} ms.", name, result.batches,
+                    result.coldMilliseconds, result.warmMilliseconds);
+            }
+        };
+
+        // A stage bound by memory shows a low IPC along with a high bandwidth, one bound by compute a high IPC
+        auto logCounters = [&]() {
+            const auto& stageCounters = cpuEngine.getStageCounters();
+            if (!counters || stageCounters.tiles == 0 || stageCounters[utils::Stage::Convolution].cycles == 0.0)
+                return;
+            const auto tiles = static_cast<double>(stageCounters.tiles);
+            console->info("Hardware counters per tile over {} tiles:", stageCounters.tiles);
+            for (int i = 0; i < utils::stageCount; ++i) {
+                const auto stage = static_cast<utils::Stage>(i);
+                const auto& sample = stageCounters[stage];
+                console->info("{:>12}: {:8.3f} ms, {:12.0f} cycles, IPC {:4.2f}, {:10.0f} LLC misses ({:5.1f}% of references), "
+                    "{:6.2f} GB/s", utils::getStageName(stage), sample.milliseconds / tiles, sample.cycles / tiles,
+                    sample.getIpc(), sample.cacheMisses / tiles,
+                    sample.cacheReferences > 0.0 ? 100.0 * sample.cacheMisses / sample.cacheReferences : 0.0,
+                    sample.getGigabytesPerSecond());
+            }
+        };
+
+        // Backends load on their own thread while the inputs are found, decoded and probed
+        double loadMilliseconds = 0.0;
+        auto loadBackends = [&]() {
+            const auto loadStart = std::chrono::steady_clock::now();
+            if (dispatching) {
+#ifdef WAIFU2X_WITH_TENSORRT
+                if (backend == "hybrid") {
+                    trt::RenderConfig config {
+                        .deviceId = deviceId,
+                        .precision = precision,
+                        .batchSize = batchSize,
+                        .channels = 3,
+                        .height = tileSize,
+                        .width = tileSize,
+                        .scaling = scale,
+                        .overlap = cv::Point2d(blend, blend),
+                        .warmup = warmup
+                    };
+
+                    if (!engine.load(modelPath, config))
+                        return false;
+                    logWarmup("tensorrt", engine.getWarmupResult());
+                    dispatcher.addBackend(&engine);
+                }
+#endif
+
+                const auto totalThreads = threads > 0
+                    ? threads : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+                for (int i = 0; i < instances; ++i) {
+                    cpu::RenderConfig config {
+                        .threads = std::max(1, totalThreads / instances),
+                        .batchSize = batchSize,
+                        .channels = 3,
+                        .height = tileSize,
+                        .width = tileSize,
+                        .scaling = scale,
+                        .overlap = cv::Point2d(blend, blend),
+                        .warmup = warmup
+                    };
+
+                    auto& instance = cpuInstances.emplace_back(std::make_unique<cpu::Img2Img>());
+                    if (!instance->load(modelPath, config))
+                        return false;
+                    logWarmup("cpu instance " + std::to_string(i), instance->getWarmupResult());
+                    dispatcher.addBackend(instance.get());
+                }
+            } else if (backend == "cpu") {
+                cpu::RenderConfig config {
+                    .threads = threads,
+                    .batchSize = batchSize,
+                    .channels = 3,
+                    .height = tileSize,
+                    .width = tileSize,
+                    .scaling = scale,
+                    .overlap = cv::Point2d(blend, blend),
+                    .tta = tta,
+                    .wholeFrame = wholeFrame,
+                    .warmup = warmup,
+                    .counters = counters
+                };
+
+                if (!cpuEngine.load(modelPath, config))
+                    return false;
+                logWarmup("cpu", cpuEngine.getWarmupResult());
+                if (cascading) {
+                    if (!heavyCpuEngine.load(heavyModelPath, config))
+                        return false;
+                    logWarmup("cpu cascade", heavyCpuEngine.getWarmupResult());
+                    cascade.addCheapBackend(&cpuEngine);
+                    cascade.setHeavyBackend(&heavyCpuEngine);
+                }
+#ifdef WAIFU2X_WITH_TENSORRT
+            } else {
+                trt::RenderConfig config {
+                    .deviceId = deviceId,
+                    .precision = precision,
+                    .batchSize = batchSize,
+                    .channels = 3,
+                    .height = tileSize,
+                    .width = tileSize,
+                    .scaling = scale,
+                    .overlap = cv::Point2d(blend, blend),
+                    .tta = tta,
+                    .warmup = warmup,
+                    .framesInFlight = framesInFlight
+                };
+
+                if (!engine.load(modelPath, config))
+                    return false;
+                logWarmup("tensorrt", engine.getWarmupResult());
+                if (cascading) {
+                    if (!heavyEngine.load(heavyModelPath, config))
+                        return false;
+                    logWarmup("tensorrt cascade", heavyEngine.getWarmupResult());
+                    cascade.addCheapBackend(&engine);
+                    cascade.setHeavyBackend(&heavyEngine);
+                }
+#endif
+            }
+            loadMilliseconds = utils::getElapsedMilliseconds(loadStart, std::chrono::steady_clock::now());
+            return true;
         };
+        auto loading = std::async(std::launch::async, loadBackends);
+
+        // Image files are decoded in parallel, near-duplicates of images rendered by earlier jobs, or earlier in this
+        // one, are flagged and can be rendered from their output instead
+        const auto prepareStart = std::chrono::steady_clock::now();
+        std::vector<std::filesystem::path> imagePaths;
+        std::vector<std::filesystem::path> animationPaths;
+        std::vector<std::filesystem::path> videoPaths;
+        std::vector<cv::Mat> images;
+        std::vector<cv::Mat> outputs;
+        std::vector<int> remaining;
+        utils::DuplicateIndex duplicateIndex;
+        const auto duplicateModel = model + " scale " + std::to_string(scale) + " noise " + std::to_string(noise);
+        std::vector<uint64_t> hashes;
+        std::vector<int> duplicates;
+        std::vector<int> batchOriginals;
+        std::vector<cv::Mat> cachedOutputs;
+
+        // Probes a video and starts its decoder and encoders, returns the writer of the full-size output
+        auto openVideo = [&](const std::filesystem::path& path, VideoCapture& capture, RenditionWriter& writer) {
+            const auto directory = outputDirectory.empty() ? path.parent_path() : outputDirectory;
+            const auto outputPath = directory / (path.stem().string() + suffix + path.extension().string());
+            capture.open(path.string());
+            const auto outputSize = cv::Size2i(capture.getFrameSize().width * scale, capture.getFrameSize().height * scale);
+            auto addRendition = [&](const cv::Size2i& size, const std::filesystem::path& renditionPath) -> VideoWriter& {
+                return writer.addRendition()
+                    .setFrameSize(size)
+                    .setFrameRate(capture.getFrameRate())
+                    .setOutputFile(renditionPath.string())
+                    .setCodec(codec)
+                    .setPixelFormat(pixelFormat)
+                    .setConstantRateFactor(crf)
+                    .setPreset(preset)
+                    .setFastestPreset(fastestPreset)
+                    .setSegmentFrames(segmentFrames)
+                    .setMaxEncoders(maxEncoders);
+            };
+            auto* outputWriter = &addRendition(outputSize, outputPath);
+
+            // Smaller renditions keep the aspect ratio at an even width for chroma subsampling
+            for (const auto height : renditionHeights) {
+                if (height >= outputSize.height) {
+                    console->info("Skipping rendition {}p, it is not smaller than the {}p output", height, outputSize.height);
+                    continue;
+                }
+                const auto width = 2 * static_cast<int>(std::lround(0.5 * height * outputSize.width / outputSize.height));
+                addRendition(cv::Size2i(std::max(2, width), height), directory / (path.stem().string() + suffix
+                    + "(" + std::to_string(height) + "p)" + path.extension().string()));
+            }
+            writer.open();
+            return outputWriter;
+        };
+
+        auto decodeImages = [&]() {
+            images.assign(imagePaths.size(), cv::Mat());
+            if (images.size() > 1) {
+                utils::ThreadPool decoders;
+                decoders.parallelFor(static_cast<int>(images.size()), [&](int i) {
+                    images[i] = cv::imread(imagePaths[i].string(), cv::IMREAD_COLOR);
+                });
+            } else if (!images.empty()) {
+                images[0] = cv::imread(imagePaths[0].string(), cv::IMREAD_COLOR);
+            }
+            for (size_t i = 0; i < images.size(); ++i) {
+                if (images[i].empty()) {
+                    console->error("Unable to read image \"{}\"", imagePaths[i].string());
+                    return false;
+                }
+            }
+
+            outputs.assign(images.size(), cv::Mat());
+            remaining.resize(images.size());
+            std::iota(remaining.begin(), remaining.end(), 0);
+            hashes.assign(images.size(), 0);
+            batchOriginals.assign(images.size(), -1);
+            cachedOutputs.assign(images.size(), cv::Mat());
+            return true;
+        };
+
+        // The first video is opened ahead, so its first frames are decoded while the model loads
+        VideoCapture firstCapture;
+        RenditionWriter firstWriter;
+        VideoWriter* firstOutputWriter = nullptr;
+        cv::VideoCapture camera;
+
+        if (!inputPaths.empty()) {
+            imagePaths = utils::findFilesByExtension(inputPaths,
+                {".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp"}, recursive);
+            imagePaths.erase(std::remove_if(imagePaths.begin(), imagePaths.end(),
+                [](const auto& path) { return AnimationReader::isAnimated(path.string()); }), imagePaths.end());
+            if (workers == 0 && !decodeImages())
+                return -1;
+            if (!duplicateIndexPath.empty()) {
+                try {
+                    duplicateIndex.load(duplicateIndexPath.string());
+                }
+                catch (const std::exception& e) {
+                    console->error("Unable to read duplicate index \"{}\": {}.", duplicateIndexPath.string(), e.what());
+                    return -1;
+                }
+
+                // Near-duplicates are only matched against images without a match of their own, so that they
+                // are reported against the original rather than against another near-duplicate of it
+                remaining.clear();
+                std::vector<int> originals;
+                for (int i = 0; i < static_cast<int>(images.size()); ++i) {
+                    hashes[i] = utils::getPerceptualHash(images[i]);
+                    std::string original;
+                    int distance = 0;
+                    if (const auto* entry = duplicateIndex.find(hashes[i], duplicateModel, duplicateConfig)) {
+                        original = entry->source;
+                        distance = utils::getHashDistance(hashes[i], entry->hash);
+                        if (reuseDuplicates)
+                            cachedOutputs[i] = cv::imread(entry->output, cv::IMREAD_COLOR);
+                    } else {
+                        for (const auto j : originals) {
+                            distance = utils::getHashDistance(hashes[i], hashes[j]);
+                            if (distance <= duplicateConfig.maxDistance) {
+                                original = imagePaths[j].string();
+                                batchOriginals[i] = j;
+                                break;
+                            }
+                        }
+                    }
+
+                    if (original.empty()) {
+                        remaining.push_back(i);
+                        originals.push_back(i);
+                        continue;
+                    }
+                    console->info("\"{}\" is a near-duplicate of \"{}\" ({} bits differ)", imagePaths[i].string(), original, distance);
+                    if (reuseDuplicates)
+                        duplicates.push_back(i);
+                    else
+                        remaining.push_back(i);
+                }
+            }
+
+            animationPaths = utils::findFilesByExtension(inputPaths, {".gif", ".png", ".webp"}, recursive);
+            animationPaths.erase(std::remove_if(animationPaths.begin(), animationPaths.end(),
+                [](const auto& path) { return !AnimationReader::isAnimated(path.string()); }), animationPaths.end());
+            videoPaths = utils::findFilesByExtension(inputPaths,
+                {".mp4", ".mkv", ".avi", ".mov", ".webm"}, recursive);
+            if (!videoPaths.empty() && workers == 0) {
+                try {
+                    firstOutputWriter = openVideo(videoPaths.front(), firstCapture, firstWriter);
+                }
+                catch (const std::exception&) {
+                    // Opened again and reported when the video is reached
+                    firstWriter.release();
+                    firstCapture.release();
+                }
+            }
+        } else {
+            camera.open(0);
+            camera.set(cv::CAP_PROP_FRAME_WIDTH, 640);
+            camera.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
+        }
+        const auto prepareMilliseconds = utils::getElapsedMilliseconds(prepareStart, std::chrono::steady_clock::now());
+
+        const auto waitStart = std::chrono::steady_clock::now();
+        if (!loading.get())
+            return -1;
+        const auto waitMilliseconds = utils::getElapsedMilliseconds(waitStart, std::chrono::steady_clock::now());
+        console->info("Started in {:.1f} ms: arguments {:.1f} ms, model load {:.1f} ms alongside inputs {:.1f} ms, "
+            "{:.1f} ms spent waiting for the model", utils::getElapsedMilliseconds(startTime, std::chrono::steady_clock::now()),
+            parseMilliseconds, loadMilliseconds, prepareMilliseconds, waitMilliseconds);
 
-        if (!engine.load(modelPath, config))
+#ifdef WAIFU2X_WITH_TENSORRT
+        // The device is current per thread, and the engine was loaded on another one
+        if (backend != "cpu" && cudaSetDevice(deviceId) != cudaSuccess) {
+            console->error("Unable to select GPU device {}", deviceId);
             return -1;
+        }
+#endif
+
+        // Pre-forked workers share the mapped model and its generated code, each adds only the activations it
+        // writes. Worker i renders every workers-th image, animation and video starting at the i-th.
+        if (workers > 0) {
+            cpuEngine.stopThreads();
+            heavyCpuEngine.stopThreads();
+            const utils::WorkerConfig workerConfig {
+                .workers = workers,
+                .maxRestarts = maxRestarts
+            };
+            utils::WorkerReport workerReport;
+            int workerIndex;
+            try {
+                workerIndex = utils::forkWorkers(workerConfig, workerReport, [&](const utils::WorkerExit& exit) {
+                    if (exit.signal == 0)
+                        console->error("Worker {} failed with exit code {}", exit.worker, exit.exitCode);
+                    else if (exit.restarted)
+                        console->warn("Worker {} was killed by signal {}, restarting it", exit.worker, exit.signal);
+                    else
+                        console->error("Worker {} was killed by signal {} too often, giving up its share", exit.worker, exit.signal);
+                });
+            }
+            catch (const std::exception& e) {
+                console->error("Unable to start workers: {}.", e.what());
+                return -1;
+            }
+            if (workerIndex < 0) {
+                console->info("{} workers finished, {} restarts, {} failed", workers, workerReport.restarts, workerReport.failed);
+                return workerReport.failed > 0 ? -1 : 0;
+            }
+
+            console->set_pattern("[%H:%M:%S.%e] [%^%l%$] [worker " + std::to_string(workerIndex) + "] %v");
+            cpuEngine.startThreads();
+            if (cascading)
+                heavyCpuEngine.startThreads();
+            auto takeShare = [&](std::vector<std::filesystem::path>& paths) {
+                std::vector<std::filesystem::path> share;
+                for (size_t i = workerIndex; i < paths.size(); i += workers)
+                    share.push_back(paths[i]);
+                paths = std::move(share);
+            };
+            takeShare(imagePaths);
+            takeShare(animationPaths);
+            takeShare(videoPaths);
+            if (!decodeImages())
+                return -1;
+        }
+
+        // Counted on the thread that renders, the one that loaded the model has exited
+        if (counters)
+            cpuEngine.openCounters();
+
+        // Latency of every image and frame rendered, and their output pixels for the throughput
+        const auto renderStart = std::chrono::steady_clock::now();
+        std::vector<double> renderMilliseconds;
+        double renderedPixels = 0.0;
+        auto recordRender = [&](std::chrono::steady_clock::time_point t0, const cv::Mat& output) {
+            renderMilliseconds.push_back(utils::getElapsedMilliseconds(t0, std::chrono::steady_clock::now()));
+            renderedPixels += static_cast<double>(output.total());
+        };
+        auto logThroughput = [&]() {
+            if (renderMilliseconds.empty())
+                return;
+            const auto seconds = utils::getElapsedMilliseconds(renderStart, std::chrono::steady_clock::now()) / 1000.0;
+            console->info("Rendered {} images and frames in {:.2f} s{}: {:.2f} per second, {:.2f} MPix/s, "
+                "latency median {:.1f} ms, p99 {:.1f} ms", renderMilliseconds.size(), seconds,
+                profile.empty() ? "" : " (" + profile + " profile)", static_cast<double>(renderMilliseconds.size()) / seconds,
+                renderedPixels / seconds / 1e6, utils::getPercentile(renderMilliseconds, 50.0),
+                utils::getPercentile(renderMilliseconds, 99.0));
+        };
 
-        cv::VideoCapture cap(0);
-        cap.set(cv::CAP_PROP_FRAME_WIDTH, 640);
-        cap.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
-        if (!cap.isOpened()) {
+        auto renderImage = [&](const cv::Mat& src, cv::Mat& dst) {
+            const auto t0 = std::chrono::steady_clock::now();
+            if (dispatching) {
+                try {
+                    dispatcher.render(src, dst, scale, cv::Point2d(blend, blend));
+                }
+                catch (const std::exception& e) {
+                    console->error("Render failed: {}.", e.what());
+                    return false;
+                }
+            } else if (cascading) {
+                utils::CascadeReport report;
+                try {
+                    report = cascade.render(src, dst, scale, cv::Point2d(blend, blend), cascadeConfig);
+                }
+                catch (const std::exception& e) {
+                    console->error("Render failed: {}.", e.what());
+                    return false;
+                }
+                console->info("Cascade: {}/{} tiles rendered again, {:.1f}% faster than {} alone "
+                    "({:.3f}s cheap, {:.3f}s heavy, {:.3f}s scoring and blending), "
+                    "PSNR of {} against it {:.2f} dB, max difference {:.3f}", report.heavyTileCount, report.tileCount,
+                    100.0 * report.getSavings(), cascadeModel, report.cheapSeconds, report.heavySeconds,
+                    report.overheadSeconds, model, report.psnr, report.maxDifference);
+            } else {
+#ifdef WAIFU2X_WITH_TENSORRT
+                const auto rendered = backend == "cpu"
+                    ? cpuEngine.render(src, dst)
+                    : engine.render(src, dst);
+#else
+                const auto rendered = cpuEngine.render(src, dst);
+#endif
+                if (!rendered)
+                    return false;
+            }
+            recordRender(t0, dst);
+            return true;
+        };
+
+        // Tiles outside of the dispatcher and the cascade are rendered by the single backend
+#ifdef WAIFU2X_WITH_TENSORRT
+        auto& tileBackend = backend == "cpu"
+            ? static_cast<utils::TileBackend&>(cpuEngine) : static_cast<utils::TileBackend&>(engine);
+#else
+        auto& tileBackend = static_cast<utils::TileBackend&>(cpuEngine);
+#endif
+
+        // Video frames stream through the engine several at a time, finishing and downloading one overlaps the tiles of
+        // the next. Returns whether outputFrame holds the oldest frame in flight, an empty frame flushes one.
+        const auto streaming = backend == "tensorrt" && !dispatching && !cascading && !motionReuse && framesInFlight > 1;
+        std::queue<std::chrono::steady_clock::time_point> submitTimes;
+        auto streamFrame = [&](const cv::Mat& frame, cv::Mat& outputFrame) {
+#ifdef WAIFU2X_WITH_TENSORRT
+            if (!frame.empty()) {
+                if (!engine.submitFrame(frame))
+                    throw std::runtime_error("could not submit frame");
+                submitTimes.push(std::chrono::steady_clock::now());
+                if (static_cast<int>(submitTimes.size()) < framesInFlight)
+                    return false;
+            } else if (submitTimes.empty()) {
+                return false;
+            }
+            if (!engine.receiveFrame(outputFrame))
+                throw std::runtime_error("could not receive frame");
+            recordRender(submitTimes.front(), outputFrame);
+            submitTimes.pop();
+            return true;
+#else
+            return false;
+#endif
+        };
+
+        // Consecutive video and camera frames can reuse the tiles of the previous output
+        utils::MotionReuse reuse;
+        reuse.setBackend(&tileBackend);
+        const utils::MotionConfig motionConfig {
+            .threshold = motionThreshold
+        };
+        utils::MotionReport motionReport;
+
+        // Batch mode renders image files, images smaller than a tile can share tiles in an atlas
+        if (!inputPaths.empty()) {
+            if (atlas) {
+                std::vector<cv::Mat> atlasImages;
+                for (const auto index : remaining)
+                    atlasImages.push_back(images[index]);
+                std::vector<cv::Mat> atlasOutputs(atlasImages.size());
+                std::vector<int> unpacked;
+                try {
+                    unpacked = utils::renderAtlas(tileBackend, atlasImages, atlasOutputs, scale);
+                }
+                catch (const std::exception& e) {
+                    console->error("Atlas render failed: {}.", e.what());
+                    return -1;
+                }
+                console->info("Packed {} of {} images into shared tiles", atlasImages.size() - unpacked.size(), atlasImages.size());
+                for (size_t i = 0; i < atlasImages.size(); ++i)
+                    outputs[remaining[i]] = atlasOutputs[i];
+                for (auto& index : unpacked)
+                    index = remaining[index];
+                remaining = unpacked;
+            }
+            for (const auto index : remaining) {
+                if (!renderImage(images[index], outputs[index]))
+                    return -1;
+            }
+
+            // The output of the original is fitted to the duplicate, which is rendered after all when it does not fit
+            for (const auto index : duplicates) {
+                const auto& cachedOutput = batchOriginals[index] >= 0 ? outputs[batchOriginals[index]] : cachedOutputs[index];
+                const auto psnr = utils::alignDuplicate(images[index], cachedOutput, scale, outputs[index], duplicateConfig);
+                if (!outputs[index].empty()) {
+                    console->info("Reused the output of the original for \"{}\" (PSNR {:.2f} dB)", imagePaths[index].string(), psnr);
+                    continue;
+                }
+                console->info("Rendering \"{}\", the output of the original does not align to it (PSNR {:.2f} dB)",
+                    imagePaths[index].string(), psnr);
+                if (!renderImage(images[index], outputs[index]))
+                    return -1;
+                remaining.push_back(index);
+            }
+
+            for (size_t i = 0; i < imagePaths.size(); ++i) {
+                const auto& path = imagePaths[i];
+                const auto directory = outputDirectory.empty() ? path.parent_path() : outputDirectory;
+                const auto outputPath = directory / (path.stem().string() + suffix + path.extension().string());
+                bool written = false;
+                cpuEngine.measureStage(utils::Stage::Encode, [&] { written = cv::imwrite(outputPath.string(), outputs[i]); });
+                if (!written) {
+                    console->error("Unable to write image \"{}\"", outputPath.string());
+                    return -1;
+                }
+                if (!duplicateIndexPath.empty() && std::find(remaining.begin(), remaining.end(), static_cast<int>(i)) != remaining.end()) {
+                    duplicateIndex.add({
+                        .hash = hashes[i],
+                        .source = std::filesystem::absolute(path).string(),
+                        .output = std::filesystem::absolute(outputPath).string(),
+                        .size = images[i].size(),
+                        .model = duplicateModel
+                    });
+                }
+            }
+            if (!duplicateIndexPath.empty()) {
+                try {
+                    duplicateIndex.save(duplicateIndexPath.string());
+                }
+                catch (const std::exception& e) {
+                    console->error("Unable to write duplicate index \"{}\": {}.", duplicateIndexPath.string(), e.what());
+                    return -1;
+                }
+            }
+
+            // Animated images keep the upscaled canvas, every frame only renders the tiles its update rectangle touches
+            const auto updating = !dispatching && !cascading && !tta && !wholeFrame;
+            const utils::MotionConfig animationConfig {
+                .refreshInterval = 0
+            };
+            for (const auto& path : animationPaths) {
+                const auto directory = outputDirectory.empty() ? path.parent_path() : outputDirectory;
+                const auto outputPath = directory / (path.stem().string() + suffix + path.extension().string());
+                AnimationReader reader;
+                VideoWriter writer;
+                utils::ChangeMap changes;
+                int renderedTileCount = 0;
+                int tileCount = 0;
+                try {
+                    reader.open(path.string());
+                    writer.setFrameSize(cv::Size2i(reader.getFrameSize().width * scale, reader.getFrameSize().height * scale))
+                        .setFrameRate(reader.getFrameRate())
+                        .setOutputFile(outputPath.string())
+                        .setLoopCount(reader.getLoopCount());
+                    if (path.extension() == ".gif") {
+                        // One palette for the whole animation, only the changed rectangle of a frame is dithered again
+                        writer.setFilter("split[a][b];[a]palettegen=stats_mode=diff[p];[b][p]paletteuse=diff_mode=rectangle");
+                    } else if (path.extension() == ".png") {
+                        writer.setFormat("apng");
+                    } else {
+                        writer.setCodec("libwebp_anim");
+                    }
+                    writer.open();
+
+                    reuse.reset();
+                    cv::Mat frame;
+                    cv::Mat outputFrame;
+                    while (reader.read(frame, changes)) {
+                        if (updating) {
+                            const auto t0 = std::chrono::steady_clock::now();
+                            motionReport = reuse.render(frame, outputFrame, scale, cv::Point2d(blend, blend), animationConfig, &changes);
+                            recordRender(t0, outputFrame);
+                            renderedTileCount += motionReport.renderedTileCount;
+                            tileCount += motionReport.tileCount;
+                        } else if (!renderImage(frame, outputFrame)) {
+                            return -1;
+                        }
+
+                        // Frames shown longer are repeated at the common frame rate
+                        cpuEngine.measureStage(utils::Stage::Encode, [&] {
+                            for (int i = 0; i < reader.getFrameDelay(); ++i)
+                                writer.write(outputFrame);
+                        });
+                    }
+                    writer.close();
+                }
+                catch (const std::exception& e) {
+                    console->error("Animation render of \"{}\" failed: {}.", path.string(), e.what());
+                    return -1;
+                }
+                if (updating && tileCount > 0) {
+                    console->info("Rendered {} of {} tiles of \"{}\" ({:.1f}%)", renderedTileCount, tileCount,
+                        path.string(), 100.0 * renderedTileCount / tileCount);
+                }
+            }
+
+            // Videos are decoded frame by frame, the decoder tells which blocks changed when it runs in-process
+            for (size_t videoIndex = 0; videoIndex < videoPaths.size(); ++videoIndex) {
+                const auto& path = videoPaths[videoIndex];
+                const auto directory = outputDirectory.empty() ? path.parent_path() : outputDirectory;
+                const auto outputPath = directory / (path.stem().string() + suffix + path.extension().string());
+                const auto opened = videoIndex == 0 && firstOutputWriter;
+                VideoCapture nextCapture;
+                RenditionWriter nextWriter;
+                auto& capture = opened ? firstCapture : nextCapture;
+                auto& writer = opened ? firstWriter : nextWriter;
+                VideoWriter* outputWriter = opened ? firstOutputWriter : nullptr;
+                utils::ChangeMap changes;
+                int renderedTileCount = 0;
+                int tileCount = 0;
+                try {
+                    if (!opened)
+                        outputWriter = openVideo(path, capture, writer);
+
+                    reuse.reset();
+                    cv::Mat frame;
+                    cv::Mat outputFrame;
+                    while (capture.read(frame, changes)) {
+                        if (streaming) {
+                            if (!streamFrame(frame, outputFrame))
+                                continue;
+                        } else if (motionReuse) {
+                            const auto t0 = std::chrono::steady_clock::now();
+                            motionReport = reuse.render(frame, outputFrame, scale, cv::Point2d(blend, blend), motionConfig, &changes);
+                            recordRender(t0, outputFrame);
+                            renderedTileCount += motionReport.renderedTileCount;
+                            tileCount += motionReport.tileCount;
+                        } else if (!renderImage(frame, outputFrame)) {
+                            return -1;
+                        }
+                        cpuEngine.measureStage(utils::Stage::Encode, [&] { writer.write(outputFrame); });
+                    }
+                    while (streaming && streamFrame(cv::Mat(), outputFrame))
+                        cpuEngine.measureStage(utils::Stage::Encode, [&] { writer.write(outputFrame); });
+                    writer.close();
+                }
+                catch (const std::exception& e) {
+                    console->error("Video render of \"{}\" failed: {}.", path.string(), e.what());
+                    return -1;
+                }
+                if (motionReuse && tileCount > 0) {
+                    console->info("Rendered {} of {} tiles of \"{}\" ({:.1f}%)", renderedTileCount, tileCount,
+                        path.string(), 100.0 * renderedTileCount / tileCount);
+                }
+                if (segmentFrames > 0 && outputWriter) {
+                    std::string presets;
+                    for (const auto& segmentPreset : outputWriter->getSegmentPresets())
+                        presets += (presets.empty() ? "" : ", ") + (segmentPreset.empty() ? "default" : segmentPreset);
+                    console->info("Encoded \"{}\" in segments with presets: {}", outputPath.string(), presets);
+                }
+            }
+            logThroughput();
+            logCounters();
+            return 0;
+        }
+
+        if (!camera.isOpened()) {
             console->error("Unable to open camera");
             return -1;
         }
@@ -189,7 +1087,7 @@ int main(int argc, char *argv[]) {
         double fps = 0.0;
         double tick_frequency = cv::getTickFrequency();
         while (true) {
-            cap >> frame;
+            camera >> frame;
             if (frame.empty()) {
                 console->error("Empty frame captured");
                 break;
@@ -197,8 +1095,17 @@ int main(int argc, char *argv[]) {
 
             outputFrame.create(frame.rows * scale, frame.cols * scale, frame.type());
             int64 frame_tick = cv::getTickCount();
-            if (!engine.render(frame, outputFrame))
+            if (motionReuse) {
+                try {
+                    motionReport = reuse.render(frame, outputFrame, scale, cv::Point2d(blend, blend), motionConfig);
+                }
+                catch (const std::exception& e) {
+                    console->error("Render failed: {}.", e.what());
+                    return -1;
+                }
+            } else if (!renderImage(frame, outputFrame)) {
                 return -1;
+            }
             int64 end_tick = cv::getTickCount();
             double frame_time = (end_tick - frame_tick) / tick_frequency;
             fps = 1.0 / frame_time;
@@ -208,32 +1115,178 @@ int main(int argc, char *argv[]) {
 
             // Display FPS on frame
             putText(outputFrame, "FPS: " + std::to_string(fps), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255), 2);
+            if (motionReuse) {
+                putText(outputFrame, "Shift: " + std::to_string(motionReport.shift.x) + "," + std::to_string(motionReport.shift.y)
+                    + " Tiles: " + std::to_string(motionReport.renderedTileCount) + "/" + std::to_string(motionReport.tileCount),
+                    cv::Point(10, 65), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255), 2);
+            }
             cv::imshow("Original Scaled", scaledFrame);
 
             cv::imshow("Output", outputFrame);
             if (cv::waitKey(1) == 27) // Exit on ESC key
                 break;
         }
-        cap.release();
-    } else if (build->parsed()) {
-        trt::BuildConfig config {
-            .deviceId = deviceId,
-            .precision = precision,
-            .minBatchSize = batchSize,
-            .optBatchSize = batchSize,
-            .maxBatchSize = batchSize,
-            .minChannels = 3,
-            .optChannels = 3,
-            .maxChannels = 3,
-            .minWidth = tileSize,
-            .optWidth = tileSize,
-            .maxWidth = tileSize,
-            .minHeight = tileSize,
-            .optHeight = tileSize,
-            .maxHeight = tileSize,
+        camera.release();
+    } else if (benchmark->parsed() && benchmarkHashes) {
+        constexpr size_t hashBytes = 64 << 20;
+        for (const auto& hash : utils::benchmarkHashes(hashBytes, iterations))
+            console->info("{:>14}: {:6.2f} GB/s", hash.name, hash.gigabytesPerSecond);
+    } else if (benchmark->parsed()) {
+        cpu::BuildConfig config {
+            .batchSize = batchSize,
+            .channels = 3,
+            .height = tileSize,
+            .width = tileSize
+        };
+        cpu::BenchmarkResult result;
+        try {
+            result = cpu::benchmarkKernels(modelPath, config, threads, iterations, counters);
+        }
+        catch (const std::exception& e) {
+            console->error("Benchmark failed: {}.", e.what());
+            return -1;
+        }
+
+        const auto& baseline = result.kernels.front();
+        for (size_t i = 0; i < result.layers.size(); ++i) {
+            std::string line = fmt::format("{:>3} {:<40}", i, result.layers[i]);
+            for (const auto& kernel : result.kernels) {
+                line += fmt::format(" {:>8}: {:8.3f} ms", cpu::getKernelName(kernel.kernel), kernel.layerMilliseconds[i]);
+                if (!kernel.layerCounters.empty()) {
+                    line += fmt::format(" IPC {:4.2f} {:6.2f} GB/s", kernel.layerCounters[i].getIpc(),
+                        kernel.layerCounters[i].getGigabytesPerSecond());
+                }
+            }
+            console->info(line);
+        }
+        for (const auto& kernel : result.kernels) {
+            console->info("{:>8}: {:9.3f} ms, {:5.2f}x generic, max error {:.2e}", cpu::getKernelName(kernel.kernel),
+                kernel.totalMilliseconds, baseline.totalMilliseconds / kernel.totalMilliseconds, kernel.maxError);
+        }
+
+        // Baselines are kept per host and compared on the same configuration only
+        const auto metrics = cpu::getBenchmarkMetrics(result);
+        const auto host = cpu::getHostFingerprint();
+        const auto benchmarkConfig = fmt::format("{} batch {} tile {} threads {}", modelPath, batchSize, tileSize, threads);
+        if (!saveBaselineName.empty()) {
+            const auto path = utils::getBaselinePath(baselineDirectory.string(), saveBaselineName, host);
+            try {
+                std::filesystem::create_directories(baselineDirectory);
+                utils::BenchmarkBaseline {
+                    .name = saveBaselineName,
+                    .host = host,
+                    .config = benchmarkConfig,
+                    .metrics = metrics
+                }.save(path);
+            }
+            catch (const std::exception& e) {
+                console->error("Unable to record baseline: {}.", e.what());
+                return -1;
+            }
+            console->info("Recorded baseline \"{}\"", path);
+        }
+        if (!baselineName.empty()) {
+            const auto path = utils::getBaselinePath(baselineDirectory.string(), baselineName, host);
+            utils::BenchmarkBaseline recorded;
+            try {
+                recorded.load(path);
+            }
+            catch (const std::exception& e) {
+                console->error("Unable to read baseline: {}.", e.what());
+                return -1;
+            }
+            if (recorded.config != benchmarkConfig) {
+                console->error("Baseline \"{}\" was recorded for {}, not {}", path, recorded.config, benchmarkConfig);
+                return -1;
+            }
+
+            int regressions = 0;
+            for (const auto& comparison : utils::compareBaseline(recorded, metrics, regressionConfig)) {
+                const auto message = fmt::format("{:>24}: {:10.3f} -> {:10.3f} ({:5.1f}% {}, p = {:.4f})", comparison.name,
+                    comparison.baseline, comparison.current, 100.0 * std::abs(comparison.change),
+                    comparison.change > 0.0 ? "worse" : "better", comparison.pValue);
+                if (comparison.regressed) {
+                    console->error("{} regressed", message);
+                    ++regressions;
+                } else {
+                    console->info(message);
+                }
+            }
+            if (regressions > 0) {
+                console->error("{} metrics regressed against baseline \"{}\"", regressions, path);
+                return -1;
+            }
+        }
+    } else if (modelInfo->parsed()) {
+        cpu::BuildConfig config {
+            .batchSize = batchSize,
+            .channels = 3,
+            .height = tileSize,
+            .width = tileSize
         };
-        if (!engine.build(modelPath, config))
+        cpu::ModelCost cost;
+        try {
+            cost = cpu::estimateCost(modelPath, config);
+        }
+        catch (const std::exception& e) {
+            console->error("Cost estimation failed: {}.", e.what());
             return -1;
+        }
+
+        auto formatShape = [](const cpu::Shape& shape) {
+            std::string text;
+            for (const auto dim : shape)
+                text += (text.empty() ? "" : "x") + std::to_string(dim);
+            return text;
+        };
+        constexpr double mebibyte = 1024.0 * 1024.0;
+        if (perNode) {
+            for (size_t i = 0; i < cost.nodes.size(); ++i) {
+                const auto& node = cost.nodes[i];
+                console->info("{:>3} {:<20} {:<18} {:10.3f} GMAC {:9.2f} MiB", i, node.op, formatShape(node.outputShape),
+                    static_cast<double>(node.macs) / 1e9, static_cast<double>(node.activationBytes) / mebibyte);
+            }
+        }
+        console->info("Input {}, output {}", formatShape(cost.inputShape), formatShape(cost.outputShape));
+        console->info("Compute: {:.3f} GMAC, {:.0f} MAC per output pixel", static_cast<double>(cost.macs) / 1e9,
+            cost.getMacsPerOutputPixel());
+        console->info("Weights: {:.2f} MiB", static_cast<double>(cost.weightBytes) / mebibyte);
+        console->info("Activation traffic: {:.2f} MiB", static_cast<double>(cost.activationBytes) / mebibyte);
+        console->info("Peak activation memory: {:.2f} MiB", static_cast<double>(cost.peakMemory) / mebibyte);
+    } else if (build->parsed()) {
+        // The hybrid backend renders with both the engine and the compiled CPU model
+        if (backend != "tensorrt") {
+            cpu::BuildConfig config {
+                .batchSize = batchSize,
+                .channels = 3,
+                .height = tileSize,
+                .width = tileSize
+            };
+            if (!cpuEngine.build(modelPath, config) || (cascading && !cpuEngine.build(heavyModelPath, config)))
+                return -1;
+        }
+#ifdef WAIFU2X_WITH_TENSORRT
+        if (backend != "cpu") {
+            trt::BuildConfig config {
+                .deviceId = deviceId,
+                .precision = precision,
+                .minBatchSize = batchSize,
+                .optBatchSize = batchSize,
+                .maxBatchSize = batchSize,
+                .minChannels = 3,
+                .optChannels = 3,
+                .maxChannels = 3,
+                .minWidth = tileSize,
+                .optWidth = tileSize,
+                .maxWidth = tileSize,
+                .minHeight = tileSize,
+                .optHeight = tileSize,
+                .maxHeight = tileSize,
+            };
+            if (!engine.build(modelPath, config) || (cascading && !engine.build(heavyModelPath, config)))
+                return -1;
+        }
+#endif
     }
 
     return 0;
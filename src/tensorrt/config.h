@@ -40,6 +40,8 @@ namespace trt {
         int scaling = 4;
         cv::Point2d overlap = cv::Point2d(0.0625, 0.0625);
         bool tta = false;
+        int warmup = 0;         // synthetic batches run by load, so the first render is not slower
+        int framesInFlight = 2; // frames streamed through the engine at a time, see Img2Img::submitFrame
     };
 }
 
@@ -3,26 +3,56 @@
 
 #include "config.h"
 #include "logger.h"
+#include "utilities/dispatcher.h"
+#include "utilities/time.h"
 #include <NvInfer.h>
 #include <opencv2/core/cuda.hpp>
+#include <array>
 #include <memory>
 #include <queue>
 #include <string>
 #include <vector>
 
 namespace trt {
-    class Img2Img {
+    class Img2Img : public utils::TileBackend {
     public:
         Img2Img();
         virtual ~Img2Img();
         bool build(const std::string& path, const BuildConfig& config);
         bool load(const std::string& path, const RenderConfig& config);
         bool render(const cv::Mat& src, cv::Mat& dst);
+
+        // Streams frames with up to framesInFlight of the config in flight. submitFrame enqueues the tiles
+        // of a frame and returns without waiting for them, receiveFrame waits for the oldest frame
+        // submitted. Finishing and downloading a frame overlaps the tiles of the next one.
+        bool submitFrame(const cv::Mat& src);
+        bool receiveFrame(cv::Mat& dst);
+
         void setMessageCallback(MessageCallback callback);
         void setProgressCallback(ProgressCallback callback);
+        // Latency of the warm-up batches of the last load
+        [[nodiscard]] const utils::WarmupResult& getWarmupResult() const;
+
+        // Tiles of the loaded engine for a TileDispatcher, without test-time augmentation
+        [[nodiscard]] int getBatchSize() const override;
+        [[nodiscard]] cv::Size2i getInputTileSize() const override;
+        [[nodiscard]] cv::Size2i getOutputTileSize() const override;
+        bool inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) override;
 
     private:
+        // Accumulator and staging buffers of a streamed frame, finished on a stream of its own
+        struct FrameSlot {
+            cv::cuda::HostMem uploadBuffer{cv::cuda::HostMem::PAGE_LOCKED};
+            cv::cuda::HostMem downloadBuffer{cv::cuda::HostMem::PAGE_LOCKED};
+            cv::cuda::GpuMat input;
+            cv::cuda::GpuMat output;
+            cv::cuda::GpuMat finished;
+            cv::cuda::Stream stream;
+            cv::cuda::Event rendered;
+        };
+
         bool infer(const std::vector<cv::cuda::GpuMat>& inputs, std::vector<cv::cuda::GpuMat>& outputs);
+        bool renderTiles(const cv::cuda::GpuMat& src, cv::cuda::GpuMat& dst);
 
         // Engine
         Logger logger;
@@ -34,11 +64,18 @@ namespace trt {
         cv::cuda::Stream stream;
         std::vector<std::pair<void*, size_t>> buffers;
         RenderConfig renderConfig;
+        utils::WarmupResult warmupResult;
         cv::cuda::GpuMat input;
         cv::cuda::GpuMat output;
+        cv::cuda::GpuMat inputBlob;                      // planar 8-bit batch, converted into the input tensor
+        std::vector<cv::cuda::GpuMat> outputTileBuffers; // tiles of a batch merged from the output tensor
         nvinfer1::Dims inputTensorShape{};
         nvinfer1::Dims outputTensorShape{};
 
+        // Tiling
+        std::vector<cv::cuda::GpuMat> paddedInputTiles;
+        cv::cuda::GpuMat blankInputTile;
+
         // Blending
         std::array<cv::cuda::GpuMat, 4> weights;
 
@@ -47,6 +84,11 @@ namespace trt {
         cv::cuda::GpuMat ttaOutputTile;
         cv::cuda::GpuMat tmpInputMat;
         cv::cuda::GpuMat tmpOutputMat;
+
+        // Streaming
+        std::vector<FrameSlot> frameSlots;
+        int submittedFrames = 0;
+        int receivedFrames = 0;
     };
 }
 
@@ -15,4 +15,20 @@ void trt::Img2Img::setMessageCallback(MessageCallback callback) {
 
 void trt::Img2Img::setProgressCallback(trt::ProgressCallback callback) {
     logger.setProgressCallback(std::move(callback));
+}
+
+int trt::Img2Img::getBatchSize() const {
+    return renderConfig.batchSize;
+}
+
+cv::Size2i trt::Img2Img::getInputTileSize() const {
+    return {inputTensorShape.d[3], inputTensorShape.d[2]};
+}
+
+cv::Size2i trt::Img2Img::getOutputTileSize() const {
+    return {outputTensorShape.d[3], outputTensorShape.d[2]};
+}
+
+const utils::WarmupResult& trt::Img2Img::getWarmupResult() const {
+    return warmupResult;
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 #include "img2img.h"
 #include <opencv2/core/cuda_stream_accessor.hpp>
 #include <opencv2/cudaarithm.hpp>
+#include <opencv2/cudaimgproc.hpp>
 
-cv::cuda::GpuMat blobFromImages(const std::vector<cv::cuda::GpuMat>& images, cv::cuda::Stream& stream) {
-    cv::cuda::GpuMat blob(static_cast<int>(images.size()), images[0].channels() * images[0].rows * images[0].cols, CV_8U);
-
+// Splits the images into the planar 8-bit blob and converts it straight into the float tensor. Both
+// are allocated by load, an allocation per batch would free the previous one with cudaFree, which
+// waits for the whole device, frames finishing on other streams included.
+void blobFromImages(const std::vector<cv::cuda::GpuMat>& images, cv::cuda::GpuMat& blob, void* tensorPtr,
+    cv::cuda::Stream& stream) {
     size_t width = images[0].cols * images[0].rows;
     for (auto i = 0; i < images.size(); ++i) {
         std::vector<cv::cuda::GpuMat> channels {
@@ -16,17 +19,14 @@ cv::cuda::GpuMat blobFromImages(const std::vector<cv::cuda::GpuMat>& images, cv:
         cv::cuda::split(images[i], channels, stream);
     }
 
-    blob.convertTo(blob, CV_32FC3, 1.0 / 255.0, stream);
-    return blob;
+    cv::cuda::GpuMat tensor(blob.rows, blob.cols, CV_32F, tensorPtr);
+    blob.convertTo(tensor, CV_32F, 1.0 / 255.0, stream);
 }
 
-std::vector<cv::cuda::GpuMat> imagesFromBlob(void* blobPtr, nvinfer1::Dims32 shape, cv::cuda::Stream& stream) {
-    std::vector<cv::cuda::GpuMat> images(shape.d[0]);
-
+// Merges the planar output tensor into the images, which load allocated for every tile of a batch
+void imagesFromBlob(void* blobPtr, nvinfer1::Dims32 shape, std::vector<cv::cuda::GpuMat>& images, cv::cuda::Stream& stream) {
     size_t width = shape.d[2] * shape.d[3];
     for (auto i = 0; i < images.size(); ++i) {
-        images[i].create(shape.d[2], shape.d[3], CV_32FC3);
-
         std::vector<cv::cuda::GpuMat> channels {
             cv::cuda::GpuMat(shape.d[2], shape.d[3], CV_32F, static_cast<float*>(blobPtr) + 0 * width + shape.d[1] * width * i),
             cv::cuda::GpuMat(shape.d[2], shape.d[3], CV_32F, static_cast<float*>(blobPtr) + 1 * width + shape.d[1] * width * i),
@@ -35,7 +35,6 @@ std::vector<cv::cuda::GpuMat> imagesFromBlob(void* blobPtr, nvinfer1::Dims32 sha
 
         cv::cuda::merge(channels, images[i], stream);
     }
-    return images;
 }
 
 bool trt::Img2Img::infer(const std::vector<cv::cuda::GpuMat>& inputs, std::vector<cv::cuda::GpuMat>& outputs) try {
@@ -69,12 +68,8 @@ bool trt::Img2Img::infer(const std::vector<cv::cuda::GpuMat>& inputs, std::vecto
 
     const auto& cudaStream = cudaGetCudaStream(stream);
 
-    // Preprocess input
-    auto blob = blobFromImages(inputs, stream);
-
-    // Copy blob to input tensor buffer
-    cudaAssert(cudaMemcpyAsync(buffers[0].first, blob.ptr<void>(),
-        buffers[0].second, cudaMemcpyDeviceToDevice, cudaStream));
+    // Preprocess input into the input tensor buffer
+    blobFromImages(inputs, inputBlob, buffers[0].first, stream);
 
     // Enqueue inference
     if (!context->enqueueV3(cudaStream)) {
@@ -82,8 +77,9 @@ bool trt::Img2Img::infer(const std::vector<cv::cuda::GpuMat>& inputs, std::vecto
         return false;
     }
 
-    // Postprocess output
-    outputs = imagesFromBlob(buffers[1].first, outputTensorShape, stream);
+    // Postprocess output, the tiles are overwritten by the next batch enqueued on the stream
+    imagesFromBlob(buffers[1].first, outputTensorShape, outputTileBuffers, stream);
+    outputs = outputTileBuffers;
 
     return true;
 }
@@ -91,3 +87,30 @@ catch (const std::exception& e) {
     logger.LOG(error, "Engine inference failed unexpectedly: " + std::string(e.what()) + ".");
     return false;
 }
+
+
+// The engine runs on RGB tiles, render converts the whole frame instead of every tile
+bool trt::Img2Img::inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) try {
+    std::vector<cv::cuda::GpuMat> inputTiles(inputs.size());
+    for (auto i = 0; i < inputs.size(); ++i) {
+        inputTiles[i].upload(inputs[i], stream);
+        cv::cuda::cvtColor(inputTiles[i], inputTiles[i], cv::COLOR_BGR2RGB, 0, stream);
+    }
+
+    std::vector<cv::cuda::GpuMat> outputTiles;
+    if (!infer(inputTiles, outputTiles))
+        return false;
+
+    outputs.resize(outputTiles.size());
+    for (auto i = 0; i < outputTiles.size(); ++i) {
+        cv::cuda::cvtColor(outputTiles[i], outputTiles[i], cv::COLOR_RGB2BGR, 0, stream);
+        outputTiles[i].download(outputs[i], stream);
+    }
+    stream.waitForCompletion();
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(error, "Engine inference failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <nlohmann/json.hpp>
 #include <opencv2/core/cuda_stream_accessor.hpp>
 #include <opencv2/cudaarithm.hpp>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 
@@ -268,6 +269,20 @@ bool trt::Img2Img::load(const std::string& modelPath, const trt::RenderConfig& c
         createTileWeights(weights, scaledOutputOverlap, outputTileSize, stream);
     }
 
+    // Per-batch buffers are allocated once, freeing them would synchronize the device
+    inputBlob.create(renderConfig.batchSize, renderConfig.channels * inputTileSize.area(), CV_8U);
+    outputTileBuffers.resize(renderConfig.batchSize);
+    for (auto& outputTileBuffer : outputTileBuffers) {
+        outputTileBuffer.create(outputTileSize, CV_32FC3);
+    }
+
+    paddedInputTiles.resize(renderConfig.batchSize);
+    for (auto& paddedInputTile : paddedInputTiles) {
+        paddedInputTile.create(inputTileSize, CV_8UC3);
+    }
+    blankInputTile.create(inputTileSize, CV_8UC3);
+    blankInputTile.setTo(cv::Scalar(0, 0, 0), stream);
+
     if (renderConfig.tta) {
         ttaInputTiles.resize(renderConfig.batchSize);
         for (auto& ttaInputTile : ttaInputTiles) {
@@ -283,6 +298,29 @@ bool trt::Img2Img::load(const std::string& modelPath, const trt::RenderConfig& c
         tmpOutputMat.release();
     }
 
+    frameSlots.clear();
+    frameSlots.resize(std::max(1, renderConfig.framesInFlight));
+    submittedFrames = 0;
+    receivedFrames = 0;
+
+    // Warm up, the first batch initializes the kernels and the lazily loaded modules, the buffers it
+    // runs on were all allocated above
+    warmupResult = utils::WarmupResult();
+    if (config.warmup > 0) {
+        std::vector<cv::cuda::GpuMat> inputTiles(config.batchSize, blankInputTile);
+        std::vector<cv::cuda::GpuMat> outputTiles;
+        const auto inferBlank = [&] {
+            if (!infer(inputTiles, outputTiles))
+                return false;
+            stream.waitForCompletion();
+            return true;
+        };
+        if (!utils::measureWarmup(config.warmup, inferBlank, warmupResult)) {
+            logger.LOG(error, "Warm-up inference failed.");
+            return false;
+        }
+    }
+
     return true;
 }
 catch (const std::exception& e) {
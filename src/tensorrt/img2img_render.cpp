@@ -1,71 +1,14 @@
 #include "img2img.h"
+#include "utilities/tiling.h"
 #include "utilities/time.h"
 #include <opencv2/cudaarithm.hpp>
 #include <opencv2/cudawarping.hpp>
 #include <opencv2/cudaimgproc.hpp>
 
-std::tuple<const int, std::vector<cv::Rect2i>, std::vector<cv::Rect2i>>
-calculateTiles(const cv::Rect2i& inputRect, const cv::Rect2i& outputRect,
-    const cv::Size2i& inputTileSize, const cv::Size2i& outputTileSize,
-    int scaling, const cv::Point2d& overlap) {
-    const auto scaledOutputTileSize = cv::Size2i(
-        inputTileSize.width * scaling,
-        inputTileSize.width * scaling
-    );
-
-    const auto scaledInputTileSize = cv::Size2i(
-        static_cast<int>(std::lround(static_cast<double>(outputTileSize.width) / scaledOutputTileSize.width * inputTileSize.width)),
-        static_cast<int>(std::lround(static_cast<double>(outputTileSize.height) / scaledOutputTileSize.height * inputTileSize.height))
-    );
-
-    const auto inputOverlap = cv::Point2i(
-        static_cast<int>(std::lround(inputTileSize.width * overlap.x)),
-        static_cast<int>(std::lround(inputTileSize.height * overlap.y))
-    );
-
-    const auto scaledOutputOverlap = cv::Point2i(
-        static_cast<int>(std::lround(scaledOutputTileSize.width * overlap.x)),
-        static_cast<int>(std::lround(scaledOutputTileSize.height * overlap.y))
-    );
-
-    const auto tiling = cv::Point2i(
-        static_cast<int>(std::lround(std::ceil(static_cast<double>(inputRect.width - inputOverlap.x) / (scaledInputTileSize.width - inputOverlap.x)))),
-        static_cast<int>(std::lround(std::ceil(static_cast<double>(inputRect.height - inputOverlap.y) / (scaledInputTileSize.height - inputOverlap.y))))
-    );
-
-    const auto tileCount = tiling.x * tiling.y;
-
-    std::vector<cv::Rect2i> inputTileRects;
-    std::vector<cv::Rect2i> outputTileRects;
-    inputTileRects.reserve(tileCount);
-    outputTileRects.reserve(tileCount);
-
-    for (auto i = 0; i < tiling.x; ++i) {
-        for (auto j = 0; j < tiling.y; ++j) {
-            // offset_border + offset_scaled_tile - offset_overlap
-            inputTileRects.emplace_back(
-                -((inputTileSize.width - scaledInputTileSize.width) / 2) + (i * scaledInputTileSize.width) - (i * inputOverlap.x),
-                -((inputTileSize.height - scaledInputTileSize.height) / 2) + (j * scaledInputTileSize.height) - (j * inputOverlap.y),
-                inputTileSize.width,
-                inputTileSize.height
-            );
-
-            // offset_tile - offset_overlap
-            const auto x = i * outputTileSize.width - (i * scaledOutputOverlap.x);
-            const auto y = j * outputTileSize.height - (j * scaledOutputOverlap.y);
-            outputTileRects.emplace_back(
-                x,
-                y,
-                x + outputTileSize.width > outputRect.width ? outputRect.width - x : outputTileSize.width,
-                y + outputTileSize.height > outputRect.height ? outputRect.height - y : outputTileSize.height
-            );
-        }
-    }
-
-    return std::make_tuple(tileCount, inputTileRects, outputTileRects);
-}
-
-cv::cuda::GpuMat padRoi(const cv::cuda::GpuMat& input, const cv::Rect2i& roi, cv::cuda::Stream& stream) {
+// Interior tiles are views into the input, edge tiles are padded into the buffer, which keeps
+// its allocation across tiles
+cv::cuda::GpuMat padRoi(const cv::cuda::GpuMat& input, const cv::Rect2i& roi,
+    cv::cuda::GpuMat& buffer, cv::cuda::Stream& stream) {
     int tl_x = roi.x;
     int tl_y = roi.y;
     int br_x = roi.x + roi.width;
@@ -95,10 +38,9 @@ cv::cuda::GpuMat padRoi(const cv::cuda::GpuMat& input, const cv::Rect2i& roi, cv
             bottom = br_y - input.rows;
         }
 
-        cv::cuda::GpuMat output;
         cv::cuda::copyMakeBorder(input(cv::Rect2i(tl_x, tl_y, width, height)),
-            output, top, bottom, left, right, cv::BORDER_REPLICATE, cv::Scalar(), stream);
-        return output;
+            buffer, top, bottom, left, right, cv::BORDER_REPLICATE, cv::Scalar(), stream);
+        return buffer;
     } else {
         return input(cv::Rect2i(tl_x, tl_y, width, height));
     }
@@ -120,55 +62,45 @@ void applyWeights(const cv::cuda::GpuMat& src, cv::cuda::GpuMat& dst,
         cv::cuda::multiply(src, weights[2], dst, 1, -1, stream);
 }
 
-enum Augmentation {
-    None,
-    FlipHorizontal,
-    FlipVertical,
-    Rotate90,
-    Rotate180,
-    Rotate270,
-    FlipHorizontalRotate90,
-    FlipVerticalRotate90
-};
 
 void applyAugmentation(const cv::cuda::GpuMat& src, cv::cuda::GpuMat& dst, const cv::Size2i& dstSize,
     cv::cuda::GpuMat& tmp, int augmentationIndex, cv::cuda::Stream& stream) {
     switch (augmentationIndex) {
         default:
-        case Augmentation::None:
+        case utils::Augmentation::None:
             src.copyTo(dst, stream);
             break;
 
-        case Augmentation::FlipHorizontal:
+        case utils::Augmentation::FlipHorizontal:
             cv::cuda::flip(src, dst, 0, stream);
             break;
 
-        case Augmentation::FlipVertical:
+        case utils::Augmentation::FlipVertical:
             cv::cuda::flip(src, dst, 1, stream);
             break;
 
-        case Augmentation::Rotate90:
+        case utils::Augmentation::Rotate90:
             cv::cuda::rotate(src, dst, dstSize, 90,
                 0, dstSize.height - 1, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::Rotate180:
+        case utils::Augmentation::Rotate180:
             cv::cuda::rotate(src, dst, dstSize, 180,
                 dstSize.width - 1, dstSize.height - 1, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::Rotate270:
+        case utils::Augmentation::Rotate270:
             cv::cuda::rotate(src, dst, dstSize, 270,
                 dstSize.width - 1, 0, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::FlipHorizontalRotate90:
+        case utils::Augmentation::FlipHorizontalRotate90:
             cv::cuda::flip(src, tmp, 0, stream);
             cv::cuda::rotate(tmp, dst, dstSize, 90,
                 0, dstSize.height - 1, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::FlipVerticalRotate90:
+        case utils::Augmentation::FlipVerticalRotate90:
             cv::cuda::flip(src, tmp, 1, stream);
             cv::cuda::rotate(tmp, dst, dstSize, 90,
                 0, dstSize.height - 1, cv::INTER_NEAREST, stream);
@@ -180,40 +112,40 @@ void reverseAugmentation(const cv::cuda::GpuMat& src, cv::cuda::GpuMat& dst, con
     cv::cuda::GpuMat& tmp, int augmentationIndex, cv::cuda::Stream& stream) {
     switch (augmentationIndex) {
         default:
-        case Augmentation::None:
+        case utils::Augmentation::None:
             src.copyTo(dst, stream);
             break;
 
-        case Augmentation::FlipHorizontal:
+        case utils::Augmentation::FlipHorizontal:
             cv::cuda::flip(src, dst, 0, stream);
             break;
 
-        case Augmentation::FlipVertical:
+        case utils::Augmentation::FlipVertical:
             cv::cuda::flip(src, dst, 1, stream);
             break;
 
-        case Augmentation::Rotate90:
+        case utils::Augmentation::Rotate90:
             cv::cuda::rotate(src, dst, dstSize, 270,
                 dstSize.width - 1, 0, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::Rotate180:
+        case utils::Augmentation::Rotate180:
             cv::cuda::rotate(src, dst, dstSize, 180,
                 dstSize.width - 1, dstSize.height - 1, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::Rotate270:
+        case utils::Augmentation::Rotate270:
             cv::cuda::rotate(src, dst, dstSize, 90,
                 0, dstSize.height - 1, cv::INTER_NEAREST, stream);
             break;
 
-        case Augmentation::FlipHorizontalRotate90:
+        case utils::Augmentation::FlipHorizontalRotate90:
             cv::cuda::rotate(src, tmp, dstSize, 270,
                 dstSize.width - 1, 0, cv::INTER_NEAREST, stream);
             cv::cuda::flip(tmp, dst, 0, stream);
             break;
 
-        case Augmentation::FlipVerticalRotate90:
+        case utils::Augmentation::FlipVerticalRotate90:
             cv::cuda::rotate(src, tmp, dstSize, 270,
                 dstSize.width - 1, 0, cv::INTER_NEAREST, stream);
             cv::cuda::flip(tmp, dst, 1, stream);
@@ -221,21 +153,20 @@ void reverseAugmentation(const cv::cuda::GpuMat& src, cv::cuda::GpuMat& dst, con
     }
 }
 
-bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
+// Accumulates the tiles of the RGB frame src into dst, enqueued on the stream of the engine
+bool trt::Img2Img::renderTiles(const cv::cuda::GpuMat& src, cv::cuda::GpuMat& dst) {
     // Allocate output
-    input.upload(src, stream);
-    cv::cuda::cvtColor(input, input, cv::COLOR_BGR2RGB, 0, stream);
-    output.create(input.rows * renderConfig.scaling, input.cols * renderConfig.scaling, CV_32FC3);
-    output.setTo(cv::Scalar(0, 0, 0), stream);
+    dst.create(src.rows * renderConfig.scaling, src.cols * renderConfig.scaling, CV_32FC3);
+    dst.setTo(cv::Scalar(0, 0, 0), stream);
 
     // Calculate tiles
-    const auto inputRect = cv::Rect2i(0, 0, input.cols, input.rows);
-    const auto outputRect = cv::Rect2i(0, 0, output.cols, output.rows);
+    const auto inputRect = cv::Rect2i(0, 0, src.cols, src.rows);
+    const auto outputRect = cv::Rect2i(0, 0, dst.cols, dst.rows);
     const auto inputTileSize = cv::Size2i(inputTensorShape.d[3], inputTensorShape.d[2]);
     const auto outputTileSize = cv::Size2i(outputTensorShape.d[3], outputTensorShape.d[2]);
     const auto scaling = renderConfig.scaling;
     const auto overlap = renderConfig.overlap;
-    auto [tileCount, inputTileRects, outputTileRects] = calculateTiles(
+    auto [tileCount, inputTileRects, outputTileRects] = utils::calculateTiles(
         inputRect, outputRect, inputTileSize, outputTileSize, scaling, overlap
     );
 
@@ -266,8 +197,8 @@ bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
 
         // Preprocess batch
         if (tileIndex < tileCount) {
-            const auto inputTile = padRoi(input, inputTileRects[tileIndex], stream);
-            if (tta && augmentationIndex != Augmentation::None) {
+            const auto inputTile = padRoi(src, inputTileRects[tileIndex], paddedInputTiles[batchIndex], stream);
+            if (tta && augmentationIndex != utils::Augmentation::None) {
                 auto& ttaInputTile = ttaInputTiles[batchIndex];
                 applyAugmentation(inputTile, ttaInputTile, inputTileSize,
                     tmpInputMat, augmentationIndex, stream);
@@ -276,7 +207,7 @@ bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
                 inputTiles[batchIndex] = inputTile;
             }
         } else {
-            inputTiles[batchIndex] = cv::cuda::GpuMat(inputTileSize, CV_32FC3, cv::Scalar(0, 0, 0));
+            inputTiles[batchIndex] = blankInputTile;
         }
 
         // Check if batch is full
@@ -301,7 +232,7 @@ bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
 
             // Postprocess TTA
             if (tta) {
-                if (augmentationIndex == Augmentation::None) {
+                if (augmentationIndex == utils::Augmentation::None) {
                     ttaOutputTile.setTo(cv::Scalar(0, 0, 0), stream);
                     cv::cuda::add(ttaOutputTile, *outputTile, ttaOutputTile, cv::noArray(), -1, stream);
                 } else {
@@ -325,7 +256,7 @@ bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
 
             // Add tile to output
             cv::cuda::add((*outputTile)(cv::Rect2i(0, 0, outputTileRect.width, outputTileRect.height)),
-                output(outputTileRect), output(outputTileRect), cv::noArray(), -1, stream);
+                dst(outputTileRect), dst(outputTileRect), cv::noArray(), -1, stream);
         }
 
         // Log progress
@@ -334,6 +265,15 @@ bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
         logger.log(stepIndex / batchSize + 1, batchCount, 1000.0 / elapsed);
     }
 
+    return true;
+}
+
+bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
+    input.upload(src, stream);
+    cv::cuda::cvtColor(input, input, cv::COLOR_BGR2RGB, 0, stream);
+    if (!renderTiles(input, output))
+        return false;
+
     // Postprocess output
     output.convertTo(output, CV_8UC3, 255.0, stream);
     cv::cuda::cvtColor(output, output, cv::COLOR_RGB2BGR, 0, stream);
@@ -345,4 +285,66 @@ bool trt::Img2Img::render(const cv::Mat& src, cv::Mat& dst) try {
 catch (const std::exception& e) {
     logger.LOG(error, "Render failed unexpectedly: " + std::string(e.what()) + ".");
     return false;
+}
+
+bool trt::Img2Img::submitFrame(const cv::Mat& src) try {
+    if (frameSlots.empty()) {
+        logger.LOG(error, "Engine not loaded, load a model before streaming frames.");
+        return false;
+    }
+
+    if (submittedFrames - receivedFrames == static_cast<int>(frameSlots.size())) {
+        logger.LOG(error, "Every frame slot is in flight, receive a frame first.");
+        return false;
+    }
+
+    // The frame last in the slot was received, so nothing reads from it anymore.
+    // The frame is staged in page-locked memory, so that the upload does not block the host.
+    auto& slot = frameSlots[submittedFrames % frameSlots.size()];
+    slot.uploadBuffer.create(src.rows, src.cols, src.type());
+    auto staged = slot.uploadBuffer.createMatHeader();
+    src.copyTo(staged);
+    slot.input.upload(slot.uploadBuffer, stream);
+    cv::cuda::cvtColor(slot.input, slot.input, cv::COLOR_BGR2RGB, 0, stream);
+    if (!renderTiles(slot.input, slot.output))
+        return false;
+
+    // Finished on the stream of the slot, while the stream of the engine moves on to the next frame
+    slot.rendered.record(stream);
+    slot.stream.waitEvent(slot.rendered);
+    slot.output.convertTo(slot.finished, CV_8UC3, 255.0, slot.stream);
+    cv::cuda::cvtColor(slot.finished, slot.finished, cv::COLOR_RGB2BGR, 0, slot.stream);
+    slot.downloadBuffer.create(slot.finished.rows, slot.finished.cols, slot.finished.type());
+    slot.finished.download(slot.downloadBuffer, slot.stream);
+    ++submittedFrames;
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(error, "Frame submission failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
+}
+
+bool trt::Img2Img::receiveFrame(cv::Mat& dst) try {
+    if (frameSlots.empty()) {
+        logger.LOG(error, "Engine not loaded, load a model before streaming frames.");
+        return false;
+    }
+
+    if (receivedFrames == submittedFrames) {
+        logger.LOG(error, "No frame is in flight.");
+        return false;
+    }
+
+    // The slot is only given up once its frame is out, a failed wait leaves it to be received again
+    auto& slot = frameSlots[receivedFrames % frameSlots.size()];
+    slot.stream.waitForCompletion();
+    slot.downloadBuffer.createMatHeader().copyTo(dst);
+    ++receivedFrames;
+
+    return true;
+}
+catch (const std::exception& e) {
+    logger.LOG(error, "Frame reception failed unexpectedly: " + std::string(e.what()) + ".");
+    return false;
 }
\ No newline at end of file
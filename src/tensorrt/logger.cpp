@@ -21,6 +21,7 @@ void trt::Logger::log(trt::Severity severity, const std::string& message, const
         messageCallback(severity, "[" + function + "@" + std::to_string(line) + "] " + message);
 }
 
+#ifdef WAIFU2X_WITH_TENSORRT
 void trt::Logger::log(nvinfer1::ILogger::Severity severity, const char* msg) noexcept {
     switch (severity) {
         case Severity::kINTERNAL_ERROR:
@@ -40,6 +41,7 @@ void trt::Logger::log(nvinfer1::ILogger::Severity severity, const char* msg) noe
             break;
     }
 }
+#endif
 
 void trt::Logger::log(int current, int total, double speed) {
     if (progressCallback)
@@ -1,10 +1,13 @@
 #ifndef WAIFU2X_TENSORRT_TRT_LOGGER_H
 #define WAIFU2X_TENSORRT_TRT_LOGGER_H
 
-#include <NvInferRuntimeBase.h>
 #include <functional>
 #include <string>
 
+#ifdef WAIFU2X_WITH_TENSORRT
+#include <NvInferRuntimeBase.h>
+#endif
+
 #define LOG(severity, message) log(severity, message, __FUNCTION__, __LINE__)
 
 namespace trt {
@@ -20,17 +23,25 @@ namespace trt {
     using MessageCallback = std::function<void(trt::Severity, const std::string&)>;
     using ProgressCallback = std::function<void(int, int, double)>;
 
-    class Logger : public nvinfer1::ILogger {
+    // Forwards the messages of the backends to a callback, and those of TensorRT when it is built with
+    // the TensorRT backend. The CPU backend uses it on its own.
+    class Logger
+#ifdef WAIFU2X_WITH_TENSORRT
+        : public nvinfer1::ILogger
+#endif
+    {
     public:
         Logger();
-        ~Logger() override;
+        virtual ~Logger();
 
         void setMessageCallback(MessageCallback callback);
         void setProgressCallback(ProgressCallback callback);
 
         void log(trt::Severity severity, const std::string& message);
         void log(trt::Severity severity, const std::string& message, const std::string& function, int line);
+#ifdef WAIFU2X_WITH_TENSORRT
         void log(ILogger::Severity severity, const char* msg) noexcept override;
+#endif
         void log(int current, int total, double speed);
 
     private:
@@ -0,0 +1,122 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_ATLAS_H
+#define WAIFU2X_TENSORRT_UTILS_ATLAS_H
+
+#include "dispatcher.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace utils {
+    struct AtlasEntry {
+        int image;
+        int tile;
+        cv::Rect2i rect; // image and its margin within the input tile
+    };
+
+    struct AtlasPlan {
+        int tileCount = 0;
+        std::vector<AtlasEntry> entries;
+        std::vector<int> unpacked; // images that do not fit into a tile with their margin
+    };
+
+    // Shelf packing: images sorted by height fill shelves left to right, a shelf that is full
+    // opens the next one below it and a tile that is full opens the next tile
+    [[maybe_unused]]
+    static inline AtlasPlan packAtlas(const std::vector<cv::Size2i>& sizes, const cv::Size2i& tileSize, int margin) {
+        AtlasPlan plan;
+        std::vector<int> order(sizes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return sizes[a].height > sizes[b].height; });
+
+        int shelfX = 0;
+        int shelfY = 0;
+        int shelfHeight = 0;
+        for (const auto image : order) {
+            const auto width = sizes[image].width + 2 * margin;
+            const auto height = sizes[image].height + 2 * margin;
+            if (width > tileSize.width || height > tileSize.height) {
+                plan.unpacked.push_back(image);
+                continue;
+            }
+
+            if (plan.tileCount == 0) {
+                plan.tileCount = 1;
+            } else if (shelfX + width > tileSize.width) {
+                shelfX = 0;
+                shelfY += shelfHeight;
+                shelfHeight = 0;
+            }
+            if (shelfY + height > tileSize.height) {
+                ++plan.tileCount;
+                shelfX = 0;
+                shelfY = 0;
+                shelfHeight = 0;
+            }
+
+            plan.entries.push_back({image, plan.tileCount - 1, cv::Rect2i(shelfX, shelfY, width, height)});
+            shelfX += width;
+            shelfHeight = std::max(shelfHeight, height);
+        }
+        std::sort(plan.unpacked.begin(), plan.unpacked.end());
+        return plan;
+    }
+
+    // Renders images much smaller than a tile together: every image is packed into a shared input
+    // tile with a replicated border as wide as the context the tile plan crops away. Only for models
+    // of unpadded convolutions, such as upconv_7, is that crop the receptive field, so nothing bleeds
+    // between neighbours and each output matches rendering the image on its own. Models that pool
+    // whole tiles or attend across windows mix neighbours in. Returns the images that have to be
+    // rendered on their own, their outputs are left empty.
+    [[maybe_unused]]
+    static inline std::vector<int> renderAtlas(TileBackend& backend, const std::vector<cv::Mat>& images,
+        std::vector<cv::Mat>& outputs, int scaling) {
+        const auto inputTileSize = backend.getInputTileSize();
+        const auto outputTileSize = backend.getOutputTileSize();
+        const auto margin = (inputTileSize.width - outputTileSize.width / scaling) / 2;
+        if (margin < 0 || outputTileSize != cv::Size2i(
+                (inputTileSize.width - 2 * margin) * scaling, (inputTileSize.height - 2 * margin) * scaling))
+            throw std::runtime_error("tile sizes do not map to an atlas");
+
+        std::vector<cv::Size2i> sizes;
+        sizes.reserve(images.size());
+        for (const auto& image : images) {
+            if (image.type() != CV_8UC3)
+                throw std::runtime_error("atlas image is not 8-bit BGR");
+            sizes.push_back(image.size());
+        }
+        const auto plan = packAtlas(sizes, inputTileSize, margin);
+
+        outputs.assign(images.size(), cv::Mat());
+        const auto batchSize = backend.getBatchSize();
+        std::vector<cv::Mat> inputTiles(batchSize);
+        std::vector<cv::Mat> outputTiles;
+        cv::Mat padded;
+        for (int first = 0; first < plan.tileCount; first += batchSize) {
+            for (auto& inputTile : inputTiles)
+                inputTile = cv::Mat(inputTileSize, CV_8UC3, cv::Scalar(0, 0, 0));
+            for (const auto& entry : plan.entries) {
+                if (entry.tile < first || entry.tile >= first + batchSize)
+                    continue;
+                cv::copyMakeBorder(images[entry.image], padded, margin, margin, margin, margin, cv::BORDER_REPLICATE);
+                padded.copyTo(inputTiles[entry.tile - first](entry.rect));
+            }
+
+            if (!backend.inferTiles(inputTiles, outputTiles))
+                throw std::runtime_error("failed to infer atlas tile " + std::to_string(first + 1)
+                    + "/" + std::to_string(plan.tileCount));
+
+            for (const auto& entry : plan.entries) {
+                if (entry.tile < first || entry.tile >= first + batchSize)
+                    continue;
+                const auto& size = sizes[entry.image];
+                outputTiles[entry.tile - first](cv::Rect2i(entry.rect.x * scaling, entry.rect.y * scaling,
+                    size.width * scaling, size.height * scaling)).convertTo(outputs[entry.image], CV_8UC3, 255.0);
+            }
+        }
+        return plan.unpacked;
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_ATLAS_H
\ No newline at end of file
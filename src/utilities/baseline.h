@@ -0,0 +1,206 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_BASELINE_H
+#define WAIFU2X_TENSORRT_UTILS_BASELINE_H
+
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace utils {
+    // Samples of one tracked metric of a benchmark run, compared at a percentile of them
+    struct BenchmarkMetric {
+        std::string name;
+        std::vector<double> samples; // one per iteration, or a single one for what is measured once per run
+        double percentile = 50.0;
+        bool higherIsBetter = false;
+    };
+
+    // Metrics of a run recorded under a name, only comparable on the same host and configuration
+    struct BenchmarkBaseline {
+        std::string name;
+        std::string host;   // fingerprint of the CPU
+        std::string config; // of the benchmark
+        std::vector<BenchmarkMetric> metrics;
+
+        void save(const std::string& path) const {
+            auto items = nlohmann::ordered_json::array();
+            for (const auto& metric : metrics) {
+                items.push_back(nlohmann::ordered_json{
+                    {"name", metric.name},
+                    {"percentile", metric.percentile},
+                    {"higherIsBetter", metric.higherIsBetter},
+                    {"samples", metric.samples}
+                });
+            }
+
+            std::ofstream file(path);
+            if (!file)
+                throw std::runtime_error("could not write baseline \"" + path + "\"");
+            file << nlohmann::ordered_json{
+                {"name", name},
+                {"host", host},
+                {"config", config},
+                {"metrics", items}
+            }.dump(4);
+        }
+
+        void load(const std::string& path) {
+            std::ifstream file(path);
+            if (!file)
+                throw std::runtime_error("could not read baseline \"" + path + "\"");
+            const auto j = nlohmann::json::parse(file);
+            name = j.at("name");
+            host = j.at("host");
+            config = j.at("config");
+            metrics.clear();
+            for (const auto& item : j.at("metrics")) {
+                metrics.push_back({
+                    .name = item.at("name"),
+                    .samples = item.at("samples").get<std::vector<double>>(),
+                    .percentile = item.at("percentile"),
+                    .higherIsBetter = item.at("higherIsBetter")
+                });
+            }
+        }
+    };
+
+    struct RegressionConfig {
+        double threshold = 0.05;     // relative change for the worse beyond which a metric regressed
+        double significance = 0.01;  // p-value the samples also need to differ by, when there are several
+    };
+
+    struct MetricComparison {
+        std::string name;
+        double baseline = 0.0;
+        double current = 0.0;
+        double change = 0.0; // relative, positive for the worse
+        double pValue = 1.0; // two-sided Mann-Whitney, 0 when either side has a single sample
+        bool regressed = false;
+    };
+
+    // Nearest rank percentile
+    [[maybe_unused]]
+    static inline double getPercentile(std::vector<double> samples, double percentile) {
+        if (samples.empty())
+            return 0.0;
+        std::sort(samples.begin(), samples.end());
+        const auto rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(samples.size())));
+        return samples[std::clamp(rank, size_t(1), samples.size()) - 1];
+    }
+
+    // Two-sided p-value of the Mann-Whitney U test that a and b come from the same distribution,
+    // through the normal approximation with the variance corrected for ties. It makes no
+    // assumption on the shape of the distributions, which timings with their long tail need.
+    [[maybe_unused]]
+    static inline double getMannWhitneyPValue(const std::vector<double>& a, const std::vector<double>& b) {
+        const auto n1 = static_cast<double>(a.size());
+        const auto n2 = static_cast<double>(b.size());
+        if (a.empty() || b.empty())
+            return 1.0;
+
+        std::vector<std::pair<double, bool>> values;
+        for (const auto value : a)
+            values.emplace_back(value, true);
+        for (const auto value : b)
+            values.emplace_back(value, false);
+        std::sort(values.begin(), values.end());
+
+        // Tied values share the mean of their ranks
+        double rankSum = 0.0;
+        double tieSum = 0.0;
+        for (size_t i = 0; i < values.size();) {
+            auto j = i;
+            while (j < values.size() && values[j].first == values[i].first)
+                ++j;
+            const auto rank = static_cast<double>(i + j + 1) / 2.0;
+            for (auto k = i; k < j; ++k) {
+                if (values[k].second)
+                    rankSum += rank;
+            }
+            const auto ties = static_cast<double>(j - i);
+            tieSum += ties * ties * ties - ties;
+            i = j;
+        }
+
+        const auto n = n1 + n2;
+        const auto u = rankSum - n1 * (n1 + 1.0) / 2.0;
+        const auto mean = n1 * n2 / 2.0;
+        const auto variance = n1 * n2 / 12.0 * ((n + 1.0) - tieSum / (n * (n - 1.0)));
+        if (variance <= 0.0)
+            return 1.0;
+        const auto z = std::max(0.0, std::abs(u - mean) - 0.5) / std::sqrt(variance);
+        return std::erfc(z / std::sqrt(2.0));
+    }
+
+    // Compares every metric of the baseline the run also has. A metric regressed when its
+    // percentile changed for the worse beyond the threshold and its samples differ significantly,
+    // so that a noisy run does not fail on its own.
+    [[maybe_unused]]
+    static inline std::vector<MetricComparison> compareBaseline(const BenchmarkBaseline& baseline,
+        const std::vector<BenchmarkMetric>& metrics, const RegressionConfig& config) {
+        std::vector<MetricComparison> comparisons;
+        for (const auto& metric : metrics) {
+            const auto it = std::find_if(baseline.metrics.begin(), baseline.metrics.end(),
+                [&](const BenchmarkMetric& other) { return other.name == metric.name; });
+            if (it == baseline.metrics.end() || it->samples.empty() || metric.samples.empty())
+                continue;
+
+            MetricComparison comparison;
+            comparison.name = metric.name;
+            comparison.baseline = getPercentile(it->samples, metric.percentile);
+            comparison.current = getPercentile(metric.samples, metric.percentile);
+            if (comparison.baseline != 0.0) {
+                comparison.change = (comparison.current - comparison.baseline) / std::abs(comparison.baseline);
+                if (metric.higherIsBetter)
+                    comparison.change = -comparison.change;
+            }
+            comparison.pValue = it->samples.size() > 1 && metric.samples.size() > 1
+                ? getMannWhitneyPValue(it->samples, metric.samples) : 0.0;
+            comparison.regressed = comparison.change > config.threshold && comparison.pValue < config.significance;
+            comparisons.push_back(comparison);
+        }
+        return comparisons;
+    }
+
+    // Baselines of every host live side by side, so one directory can be shared between machines
+    [[maybe_unused]]
+    static inline std::string getBaselinePath(const std::string& directory, const std::string& name, const std::string& host) {
+        return (std::filesystem::path(directory) / (name + "-" + host + ".json")).string();
+    }
+
+    // Peak resident memory of the process so far
+    [[maybe_unused]]
+    static inline uint64_t getPeakMemory() {
+#if defined(_WIN32) || defined(_WIN64)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_BASELINE_H
\ No newline at end of file
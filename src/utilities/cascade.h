@@ -0,0 +1,203 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_CASCADE_H
+#define WAIFU2X_TENSORRT_UTILS_CASCADE_H
+
+#include "dispatcher.h"
+#include "tiling.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace utils {
+    struct CascadeConfig {
+        double fraction = 0.25;  // share of the tiles with the most detail the heavy model renders again
+        double threshold = -1.0; // detail score above which a tile is rendered again, replaces fraction unless negative
+    };
+
+    struct CascadeReport {
+        int tileCount = 0;
+        int heavyTileCount = 0;
+        double cheapSeconds = 0.0;
+        double heavySeconds = 0.0;    // heavy model inference only
+        double overheadSeconds = 0.0; // scoring, error measurement and blending over the whole frame
+        double psnr = std::numeric_limits<double>::infinity(); // cheap against heavy output over the tiles rendered again
+        double maxDifference = 0.0;
+
+        // Heavy model time for every tile, extrapolated from the tiles it rendered
+        [[nodiscard]] double getFullHeavySeconds() const {
+            return heavyTileCount > 0 ? heavySeconds / heavyTileCount * tileCount : 0.0;
+        }
+
+        // Time saved against rendering every tile with the heavy model, 0 before it rendered a tile.
+        // The overhead does not grow with the heavy tiles, so it is charged once and not extrapolated.
+        [[nodiscard]] double getSavings() const {
+            const auto full = getFullHeavySeconds();
+            return full > 0.0 ? 1.0 - (cheapSeconds + heavySeconds + overheadSeconds) / full : 0.0;
+        }
+    };
+
+    // Mean absolute luma gradient of a float BGR image in [0, 1], 0 for flat regions
+    [[maybe_unused]]
+    static inline double getDetailScore(const cv::Mat& image) {
+        if (image.rows < 2 || image.cols < 2)
+            return 0.0;
+
+        auto getLuma = [](const float* pixel) {
+            return 0.114f * pixel[0] + 0.587f * pixel[1] + 0.299f * pixel[2];
+        };
+        double sum = 0.0;
+        for (int y = 0; y < image.rows - 1; ++y) {
+            const auto* row = image.ptr<float>(y);
+            const auto* nextRow = image.ptr<float>(y + 1);
+            for (int x = 0; x < image.cols - 1; ++x) {
+                const auto luma = getLuma(row + x * 3);
+                sum += std::abs(getLuma(row + x * 3 + 3) - luma) + std::abs(getLuma(nextRow + x * 3) - luma);
+            }
+        }
+        return sum / (static_cast<double>(image.rows - 1) * (image.cols - 1));
+    }
+
+    // Renders the whole frame with the cheap backends, then renders the tiles with the most detail
+    // again with the heavy backend. Detail is scored on the cheap output over the tile plan of the
+    // heavy backend, so the two models may use different tile sizes. Heavy tiles are blended over
+    // the cheap frame with the usual ramps, which fade into the cheap output where a neighbouring
+    // tile was not rendered again.
+    class TileCascade {
+    public:
+        void addCheapBackend(TileBackend* backend) {
+            cheap.addBackend(backend);
+        }
+
+        void setHeavyBackend(TileBackend* backend) {
+            heavy = backend;
+        }
+
+        CascadeReport render(const cv::Mat& src, cv::Mat& dst, int scaling, const cv::Point2d& overlap,
+            const CascadeConfig& config) {
+            if (!heavy)
+                throw std::runtime_error("no heavy backend to cascade to");
+
+            CascadeReport report;
+            const auto t0 = std::chrono::steady_clock::now();
+            cheap.render(src, dst, scaling, overlap);
+            const auto& cheapOutput = cheap.getOutput();
+            const auto t1 = std::chrono::steady_clock::now();
+            report.cheapSeconds = std::chrono::duration<double>(t1 - t0).count();
+
+            // Tile plan of the heavy backend
+            const auto inputTileSize = heavy->getInputTileSize();
+            const auto outputTileSize = heavy->getOutputTileSize();
+            const auto outputRect = cv::Rect2i(0, 0, cheapOutput.cols, cheapOutput.rows);
+            const auto [tileCount, inputTileRects, outputTileRects] = calculateTiles(
+                cv::Rect2i(0, 0, src.cols, src.rows), outputRect, inputTileSize, outputTileSize, scaling, overlap
+            );
+            report.tileCount = tileCount;
+
+            // Pick the tiles with the most detail
+            std::vector<double> scores(tileCount);
+            for (int i = 0; i < tileCount; ++i)
+                scores[i] = getDetailScore(cheapOutput(outputTileRects[i]));
+            std::vector<int> tiles(tileCount);
+            std::iota(tiles.begin(), tiles.end(), 0);
+            std::stable_sort(tiles.begin(), tiles.end(), [&](int a, int b) { return scores[a] > scores[b]; });
+            if (config.threshold >= 0.0) {
+                tiles.erase(std::find_if(tiles.begin(), tiles.end(),
+                    [&](int tile) { return scores[tile] <= config.threshold; }), tiles.end());
+            } else {
+                const auto count = static_cast<int>(std::lround(std::clamp(config.fraction, 0.0, 1.0) * tileCount));
+                tiles.resize(count);
+            }
+            std::sort(tiles.begin(), tiles.end());
+            report.heavyTileCount = static_cast<int>(tiles.size());
+
+            // Blend weights, the weight sum tells how much of the cheap output is left over
+            const auto overlapping = overlap.x != 0 || overlap.y != 0;
+            if (overlapping) {
+                const auto scaledOutputOverlap = cv::Point2i(
+                    static_cast<int>(std::lround(inputTileSize.width * scaling * overlap.x)),
+                    static_cast<int>(std::lround(inputTileSize.height * scaling * overlap.y))
+                );
+                createTileWeights(weights, scaledOutputOverlap, outputTileSize);
+            }
+            heavyOutput.create(cheapOutput.size(), CV_32FC3);
+            heavyOutput.setTo(cv::Scalar(0, 0, 0));
+            weightSum.create(cheapOutput.size(), CV_32FC3);
+            weightSum.setTo(cv::Scalar(0, 0, 0));
+
+            const auto batchSize = heavy->getBatchSize();
+            std::vector<cv::Rect2i> rects;
+            std::vector<cv::Mat> outputs;
+            double squaredError = 0.0;
+            double valueCount = 0.0;
+            for (size_t first = 0; first < tiles.size(); first += batchSize) {
+                const auto count = std::min(static_cast<int>(tiles.size() - first), batchSize);
+                rects.clear();
+                for (int i = 0; i < count; ++i)
+                    rects.push_back(inputTileRects[tiles[first + i]]);
+                const auto inferStart = std::chrono::steady_clock::now();
+                if (!heavy->inferRegions(src, rects, outputs))
+                    throw std::runtime_error("heavy backend failed to infer tile " + std::to_string(tiles[first] + 1)
+                        + "/" + std::to_string(tileCount));
+                report.heavySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - inferStart).count();
+
+                for (int i = 0; i < count; ++i) {
+                    const auto& outputTileRect = outputTileRects[tiles[first + i]];
+                    const auto region = cv::Rect2i(0, 0, outputTileRect.width, outputTileRect.height);
+
+                    // Quality delta of the cheap model on this tile
+                    for (int y = 0; y < region.height; ++y) {
+                        const auto* heavyRow = outputs[i].ptr<float>(y);
+                        const auto* cheapRow = cheapOutput.ptr<float>(outputTileRect.y + y) + outputTileRect.x * 3;
+                        for (int x = 0; x < region.width * 3; ++x) {
+                            const auto difference = static_cast<double>(heavyRow[x]) - cheapRow[x];
+                            squaredError += difference * difference;
+                            report.maxDifference = std::max(report.maxDifference, std::abs(difference));
+                        }
+                    }
+                    valueCount += static_cast<double>(region.area()) * 3;
+
+                    cv::Mat weight(outputTileSize, CV_32FC3, cv::Scalar(1.f, 1.f, 1.f));
+                    if (overlapping) {
+                        applyTileWeights(outputs[i], outputs[i], outputTileRect, outputRect, weights);
+                        applyTileWeights(weight, weight, outputTileRect, outputRect, weights);
+                    }
+                    cv::add(outputs[i](region), heavyOutput(outputTileRect), heavyOutput(outputTileRect));
+                    cv::add(weight(region), weightSum(outputTileRect), weightSum(outputTileRect));
+                }
+            }
+            if (valueCount > 0.0 && squaredError > 0.0)
+                report.psnr = 10.0 * std::log10(valueCount / squaredError);
+
+            // Cheap output fills whatever weight the heavy tiles left
+            output.create(cheapOutput.size(), CV_32FC3);
+            for (int y = 0; y < output.rows; ++y) {
+                const auto* cheapRow = cheapOutput.ptr<float>(y);
+                const auto* heavyRow = heavyOutput.ptr<float>(y);
+                const auto* weightRow = weightSum.ptr<float>(y);
+                auto* outputRow = output.ptr<float>(y);
+                for (int x = 0; x < output.cols * 3; ++x)
+                    outputRow[x] = heavyRow[x] + (1.0f - weightRow[x]) * cheapRow[x];
+            }
+            output.convertTo(dst, CV_8UC3, 255.0);
+            report.overheadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count()
+                - report.heavySeconds;
+
+            return report;
+        }
+
+    private:
+        TileDispatcher cheap;
+        TileBackend* heavy = nullptr;
+
+        std::array<cv::Mat, 4> weights;
+        cv::Mat heavyOutput;
+        cv::Mat weightSum;
+        cv::Mat output;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_CASCADE_H
\ No newline at end of file
@@ -0,0 +1,208 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_COUNTERS_H
+#define WAIFU2X_TENSORRT_UTILS_COUNTERS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "time.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace utils {
+    // Hardware counts of the measured threads over a stretch of the pipeline
+    struct CounterSample {
+        double cycles = 0.0;
+        double instructions = 0.0;
+        double cacheReferences = 0.0; // of the last level cache
+        double cacheMisses = 0.0;
+        double milliseconds = 0.0;    // wall time
+
+        CounterSample& operator+=(const CounterSample& other) noexcept {
+            cycles += other.cycles;
+            instructions += other.instructions;
+            cacheReferences += other.cacheReferences;
+            cacheMisses += other.cacheMisses;
+            milliseconds += other.milliseconds;
+            return *this;
+        }
+
+        [[nodiscard]] double getIpc() const noexcept {
+            return cycles > 0.0 ? instructions / cycles : 0.0;
+        }
+
+        // Memory traffic estimated as one cache line read per last level cache miss. Writebacks are
+        // not seen, so it is a lower bound, but enough to tell a stage bound by bandwidth apart.
+        [[nodiscard]] double getGigabytesPerSecond() const noexcept {
+            constexpr auto cacheLineBytes = 64.0;
+            return milliseconds > 0.0 ? cacheMisses * cacheLineBytes / (milliseconds * 1e6) : 0.0;
+        }
+    };
+
+    enum class Stage {
+        Pack,        // input tiles into the tensor
+        Convolution, // the model
+        Blend,       // output tensor unpacked, augmentations merged and tiles accumulated into the frame
+        Encode       // frame converted to 8-bit and written
+    };
+    constexpr int stageCount = 4;
+
+    [[maybe_unused]]
+    static inline const char* getStageName(Stage stage) {
+        switch (stage) {
+            case Stage::Pack:
+                return "pack";
+            case Stage::Convolution:
+                return "convolution";
+            case Stage::Blend:
+                return "blend";
+            case Stage::Encode:
+                return "encode";
+        }
+        return "unknown";
+    }
+
+    struct StageCounters {
+        std::array<CounterSample, stageCount> stages;
+        int tiles = 0; // inferred, augmented copies included
+
+        [[nodiscard]] CounterSample& operator[](Stage stage) noexcept {
+            return stages[static_cast<int>(stage)];
+        }
+
+        [[nodiscard]] const CounterSample& operator[](Stage stage) const noexcept {
+            return stages[static_cast<int>(stage)];
+        }
+    };
+
+    // Cycles, instructions and last level cache references and misses of a set of threads, through
+    // perf_event_open. Every thread opens its own group, counting user space only so that the
+    // default perf_event_paranoid level of 2 allows it. A stretch is measured by the difference of
+    // the sums over the threads before and after it, so the threads have to sleep outside of the
+    // measured stretches, as the workers of a ThreadPool do between tasks.
+    class PerfCounters {
+    public:
+        PerfCounters() = default;
+
+        ~PerfCounters() {
+            close();
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        // Opens the counters of the calling thread, false when perf events are not available
+        bool addThread() {
+#if defined(__linux__)
+            constexpr std::array<uint64_t, eventCount> events = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_REFERENCES,
+                PERF_COUNT_HW_CACHE_MISSES
+            };
+
+            Group group;
+            group.fill(-1);
+            for (int i = 0; i < eventCount; ++i) {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = events[i];
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                group[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group[0], PERF_FLAG_FD_CLOEXEC));
+                if (group[i] < 0) {
+                    closeGroup(group);
+                    return false;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            groups.push_back(group);
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& group : groups)
+                closeGroup(group);
+            groups.clear();
+        }
+
+        [[nodiscard]] bool isOpen() const noexcept {
+            return !groups.empty();
+        }
+
+        // Sums over every thread since they were opened, scaled up where the kernel multiplexed the
+        // counters with other events
+        [[nodiscard]] CounterSample read() const {
+            CounterSample sample;
+#if defined(__linux__)
+            struct {
+                uint64_t count;
+                uint64_t timeEnabled;
+                uint64_t timeRunning;
+                uint64_t values[eventCount];
+            } data{};
+            for (const auto& group : groups) {
+                if (::read(group[0], &data, sizeof(data)) != sizeof(data) || data.timeRunning == 0)
+                    continue;
+                const auto scale = static_cast<double>(data.timeEnabled) / static_cast<double>(data.timeRunning);
+                sample.cycles += static_cast<double>(data.values[0]) * scale;
+                sample.instructions += static_cast<double>(data.values[1]) * scale;
+                sample.cacheReferences += static_cast<double>(data.values[2]) * scale;
+                sample.cacheMisses += static_cast<double>(data.values[3]) * scale;
+            }
+#endif
+            return sample;
+        }
+
+        // Runs function and adds what it counted and its wall time to sample
+        void measure(CounterSample& sample, const std::function<void()>& function) const {
+            if (!isOpen()) {
+                function();
+                return;
+            }
+
+            const auto t0 = std::chrono::steady_clock::now();
+            const auto before = read();
+            function();
+            const auto after = read();
+            sample.cycles += after.cycles - before.cycles;
+            sample.instructions += after.instructions - before.instructions;
+            sample.cacheReferences += after.cacheReferences - before.cacheReferences;
+            sample.cacheMisses += after.cacheMisses - before.cacheMisses;
+            sample.milliseconds += getElapsedMilliseconds(t0, std::chrono::steady_clock::now());
+        }
+
+    private:
+        static constexpr int eventCount = 4;
+        using Group = std::array<int, eventCount>;
+
+        static void closeGroup(Group& group) {
+#if defined(__linux__)
+            for (auto& fd : group) {
+                if (fd >= 0)
+                    ::close(fd);
+                fd = -1;
+            }
+#endif
+        }
+
+        std::vector<Group> groups;
+        std::mutex mutex;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_COUNTERS_H
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_DISPATCHER_H
+#define WAIFU2X_TENSORRT_UTILS_DISPATCHER_H
+
+#include "tiling.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace utils {
+    // Inference backend the dispatcher hands batches of tiles to. Inputs are 8-bit BGR tiles of the
+    // input tile size, outputs are float BGR tiles in [0, 1] of the output tile size.
+    class TileBackend {
+    public:
+        virtual ~TileBackend() = default;
+        [[nodiscard]] virtual int getBatchSize() const = 0;
+        [[nodiscard]] virtual cv::Size2i getInputTileSize() const = 0;
+        [[nodiscard]] virtual cv::Size2i getOutputTileSize() const = 0;
+        virtual bool inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) = 0;
+
+        // Tiles at rects of an image, the parts outside of it replicate its border. Fewer rects
+        // than the batch size leave the rest of the batch blank. Backends that can read tiles
+        // straight out of the image override this, by default edge tiles are copied out padded.
+        virtual bool inferRegions(const cv::Mat& image, const std::vector<cv::Rect2i>& rects, std::vector<cv::Mat>& outputs) {
+            std::vector<cv::Mat> inputs(getBatchSize());
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i] = i < rects.size()
+                    ? padRoi(image, rects[i])
+                    : cv::Mat(getInputTileSize(), CV_8UC3, cv::Scalar(0, 0, 0));
+            }
+            return inferTiles(inputs, outputs);
+        }
+    };
+
+    // Splits the tiles of one frame across several backends with the same tile size, each driven by
+    // its own thread; the first one runs on the calling thread, so a GPU context current there stays
+    // usable. Backends pull batches from a shared queue, so faster ones take more tiles. Near the end
+    // of a frame a backend stops when the others are expected to finish the remaining tiles before
+    // it would finish its next batch, going by the throughput measured over the previous batches.
+    class TileDispatcher {
+    public:
+        void addBackend(TileBackend* backend) {
+            backends.push_back(backend);
+            throughput.push_back(0.0);
+            tileCounts.push_back(0);
+        }
+
+        [[nodiscard]] int size() const noexcept {
+            return static_cast<int>(backends.size());
+        }
+
+        // Tiles per second of every backend, 0 until it has inferred a batch
+        [[nodiscard]] const std::vector<double>& getThroughput() const noexcept {
+            return throughput;
+        }
+
+        // Float BGR accumulator of the last frame, before it is converted to 8 bits
+        [[nodiscard]] const cv::Mat& getOutput() const noexcept {
+            return output;
+        }
+
+        // Tiles every backend rendered of the last frame
+        [[nodiscard]] const std::vector<int>& getTileCounts() const noexcept {
+            return tileCounts;
+        }
+
+        void render(const cv::Mat& src, cv::Mat& dst, int scaling, const cv::Point2d& overlap) {
+            if (backends.empty())
+                throw std::runtime_error("no backends to dispatch tiles to");
+            if (src.type() != CV_8UC3)
+                throw std::runtime_error("input image is not 8-bit BGR");
+
+            const auto inputTileSize = backends[0]->getInputTileSize();
+            const auto outputTileSize = backends[0]->getOutputTileSize();
+            for (const auto* backend : backends) {
+                if (backend->getInputTileSize() != inputTileSize || backend->getOutputTileSize() != outputTileSize)
+                    throw std::runtime_error("backends were loaded with different tile sizes");
+            }
+
+            overlapping = overlap.x != 0 || overlap.y != 0;
+            if (overlapping && (weights[0].size() != outputTileSize || overlap != weightsOverlap || scaling != weightsScaling)) {
+                const auto scaledOutputOverlap = cv::Point2i(
+                    static_cast<int>(std::lround(inputTileSize.width * scaling * overlap.x)),
+                    static_cast<int>(std::lround(inputTileSize.height * scaling * overlap.y))
+                );
+                createTileWeights(weights, scaledOutputOverlap, outputTileSize);
+                weightsOverlap = overlap;
+                weightsScaling = scaling;
+            }
+
+            output.create(src.rows * scaling, src.cols * scaling, CV_32FC3);
+            output.setTo(cv::Scalar(0, 0, 0));
+            outputRect = cv::Rect2i(0, 0, output.cols, output.rows);
+            std::tie(tileCount, inputTileRects, outputTileRects) = calculateTiles(
+                cv::Rect2i(0, 0, src.cols, src.rows), outputRect, inputTileSize, outputTileSize, scaling, overlap
+            );
+
+            nextTile = 0;
+            error = nullptr;
+            active.assign(backends.size(), true);
+            busyUntil.assign(backends.size(), Clock::now());
+            std::fill(tileCounts.begin(), tileCounts.end(), 0);
+
+            std::vector<std::thread> threads;
+            threads.reserve(backends.size() - 1);
+            for (int i = 1; i < size(); ++i)
+                threads.emplace_back([&, i] { work(i, src); });
+            work(0, src);
+            for (auto& thread : threads)
+                thread.join();
+            if (error)
+                std::rethrow_exception(error);
+            if (nextTile != tileCount)
+                throw std::runtime_error("backends stopped with " + std::to_string(tileCount - nextTile) + " tiles left");
+
+            output.convertTo(dst, CV_8UC3, 255.0);
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        void work(int index, const cv::Mat& src) {
+            try {
+                auto* backend = backends[index];
+                const auto batchSize = backend->getBatchSize();
+                std::vector<cv::Rect2i> rects;
+                std::vector<cv::Mat> outputs;
+                int first = 0;
+                int count = 0;
+                while (claim(index, batchSize, first, count)) {
+                    rects.assign(inputTileRects.begin() + first, inputTileRects.begin() + first + count);
+                    const auto t0 = Clock::now();
+                    if (!backend->inferRegions(src, rects, outputs))
+                        throw std::runtime_error("backend " + std::to_string(index) + " failed to infer tiles "
+                            + std::to_string(first + 1) + "-" + std::to_string(first + count));
+                    const auto seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+                    for (int i = 0; i < count; ++i) {
+                        const auto& outputTileRect = outputTileRects[first + i];
+                        if (overlapping)
+                            applyTileWeights(outputs[i], outputs[i], outputTileRect, outputRect, weights);
+                    }
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (int i = 0; i < count; ++i) {
+                        const auto& outputTileRect = outputTileRects[first + i];
+                        cv::add(outputs[i](cv::Rect2i(0, 0, outputTileRect.width, outputTileRect.height)),
+                            output(outputTileRect), output(outputTileRect));
+                    }
+                    // A batch costs the same however many of its tiles are padding
+                    const auto rate = batchSize / std::max(seconds, 1e-6);
+                    throughput[index] = throughput[index] > 0.0 ? 0.75 * throughput[index] + 0.25 * rate : rate;
+                    tileCounts[index] += count;
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+                nextTile = tileCount;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            active[index] = false;
+        }
+
+        bool claim(int index, int batchSize, int& first, int& count) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto remaining = tileCount - nextTile;
+            if (remaining <= 0)
+                return false;
+
+            const auto now = Clock::now();
+            auto duration = Clock::duration::zero();
+            if (throughput[index] > 0.0) {
+                duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(batchSize / throughput[index]));
+
+                // Whole batches the other backends still start before this one would be done. A backend
+                // stops in the same critical section it declines in, so that the others no longer count
+                // on it, and the last one running never stops.
+                int absorbed = 0;
+                bool othersActive = false;
+                for (int i = 0; i < size(); ++i) {
+                    if (i == index || !active[i])
+                        continue;
+                    othersActive = true;
+                    if (throughput[i] <= 0.0)
+                        continue;
+                    const auto spare = std::chrono::duration<double>(now + duration - std::max(now, busyUntil[i])).count();
+                    const auto otherBatchSize = backends[i]->getBatchSize();
+                    if (spare > 0.0)
+                        absorbed += static_cast<int>(std::floor(spare * throughput[i] / otherBatchSize)) * otherBatchSize;
+                }
+                if (othersActive && absorbed >= remaining) {
+                    active[index] = false;
+                    return false;
+                }
+            }
+
+            first = nextTile;
+            count = std::min(batchSize, remaining);
+            nextTile += count;
+            busyUntil[index] = now + duration;
+            return true;
+        }
+
+        std::vector<TileBackend*> backends;
+        std::vector<double> throughput;
+        std::vector<int> tileCounts;
+
+        // Blending
+        std::array<cv::Mat, 4> weights;
+        cv::Point2d weightsOverlap;
+        int weightsScaling = 0;
+        bool overlapping = false;
+
+        // Frame
+        cv::Mat output;
+        cv::Rect2i outputRect;
+        int tileCount = 0;
+        std::vector<cv::Rect2i> inputTileRects;
+        std::vector<cv::Rect2i> outputTileRects;
+
+        // Shared between the backend threads
+        std::mutex mutex;
+        int nextTile = 0;
+        std::vector<bool> active;
+        std::vector<Clock::time_point> busyUntil;
+        std::exception_ptr error;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_DISPATCHER_H
\ No newline at end of file
@@ -0,0 +1,187 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_DUPLICATES_H
+#define WAIFU2X_TENSORRT_UTILS_DUPLICATES_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace utils {
+    struct DuplicateConfig {
+        int maxDistance = 10;  // differing bits of the 64-bit hashes up to which two images are near-duplicates
+        double minPsnr = 24.0; // PSNR the aligned output, scaled back down, needs against the image to be reused,
+                               // low enough for recompressed copies and high enough to reject a misalignment
+    };
+
+    struct DuplicateEntry {
+        uint64_t hash = 0;
+        std::string source;
+        std::string output;
+        cv::Size2i size;
+        std::string model; // outputs of other models or settings are not reused
+    };
+
+    // DCT hash of the image structure: the lowest 8x8 frequencies of the 32x32 luma, each bit set
+    // where the coefficient is above their median. Resizing and recompression barely move them.
+    [[maybe_unused]]
+    static inline uint64_t getPerceptualHash(const cv::Mat& image) {
+        cv::Mat luma;
+        cv::cvtColor(image, luma, cv::COLOR_BGR2GRAY);
+        cv::resize(luma, luma, cv::Size2i(32, 32), 0, 0, cv::INTER_AREA);
+        luma.convertTo(luma, CV_32F);
+        cv::Mat frequencies;
+        cv::dct(luma, frequencies);
+
+        // The median leaves out the DC term, which only carries the brightness
+        std::vector<float> coefficients;
+        coefficients.reserve(64);
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x)
+                coefficients.push_back(frequencies.at<float>(y, x));
+        }
+        std::vector<float> sorted(coefficients.begin() + 1, coefficients.end());
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        const auto median = sorted[sorted.size() / 2];
+
+        uint64_t hash = 0;
+        for (size_t i = 0; i < coefficients.size(); ++i) {
+            if (coefficients[i] > median)
+                hash |= uint64_t(1) << i;
+        }
+        return hash;
+    }
+
+    [[maybe_unused]]
+    static inline int getHashDistance(uint64_t a, uint64_t b) {
+        return std::popcount(a ^ b);
+    }
+
+    // Fits the output rendered for a near-duplicate of image to it, either as the same framing at
+    // another size or as a crop at the same size. The output scaled back down stands in for the
+    // source it was rendered from, and the fit is kept when it matches image above the PSNR of
+    // the config. Returns the PSNR of the fit, output is only written when it is kept.
+    [[maybe_unused]]
+    static inline double alignDuplicate(const cv::Mat& image, const cv::Mat& cachedOutput, int scaling, cv::Mat& output,
+        const DuplicateConfig& config) {
+        if (cachedOutput.empty() || cachedOutput.type() != CV_8UC3)
+            return 0.0;
+
+        cv::Mat cachedSource;
+        cv::resize(cachedOutput, cachedSource, cv::Size2i(cachedOutput.cols / scaling, cachedOutput.rows / scaling),
+            0, 0, cv::INTER_AREA);
+        const auto outputSize = cv::Size2i(image.cols * scaling, image.rows * scaling);
+
+        // Same framing, resized
+        cv::Mat resized;
+        cv::Mat check;
+        cv::resize(cachedOutput, resized, outputSize, 0, 0, cachedOutput.cols > outputSize.width ? cv::INTER_AREA : cv::INTER_CUBIC);
+        cv::resize(resized, check, image.size(), 0, 0, cv::INTER_AREA);
+        auto psnr = cv::PSNR(image, check);
+        auto best = resized;
+
+        // Cropped out of it at the same size, located by the best match of image within it
+        if (image.size() != cachedSource.size() && image.cols <= cachedSource.cols && image.rows <= cachedSource.rows) {
+            cv::Mat scores;
+            cv::matchTemplate(cachedSource, image, scores, cv::TM_SQDIFF);
+            cv::Point2i location;
+            cv::minMaxLoc(scores, nullptr, nullptr, &location, nullptr);
+            const auto cropPsnr = cv::PSNR(image, cachedSource(cv::Rect2i(location, image.size())));
+            if (cropPsnr > psnr) {
+                psnr = cropPsnr;
+                best = cachedOutput(cv::Rect2i(location.x * scaling, location.y * scaling, outputSize.width, outputSize.height));
+            }
+        }
+
+        if (psnr >= config.minPsnr)
+            best.copyTo(output);
+        return psnr;
+    }
+
+    // Hashes of rendered sources and where their outputs were written, kept in a JSON file so that
+    // later batch jobs find near-duplicates of what earlier ones rendered
+    class DuplicateIndex {
+    public:
+        void load(const std::string& path) {
+            entries.clear();
+            if (!std::filesystem::exists(path))
+                return;
+
+            std::ifstream file(path);
+            const auto j = nlohmann::json::parse(file);
+            for (const auto& item : j.at("entries")) {
+                entries.push_back({
+                    .hash = std::stoull(item.at("hash").get<std::string>(), nullptr, 16),
+                    .source = item.at("source"),
+                    .output = item.at("output"),
+                    .size = cv::Size2i(item.at("width").get<int>(), item.at("height").get<int>()),
+                    .model = item.at("model")
+                });
+            }
+        }
+
+        void save(const std::string& path) const {
+            auto items = nlohmann::ordered_json::array();
+            for (const auto& entry : entries) {
+                char hash[17];
+                std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(entry.hash));
+                items.push_back(nlohmann::ordered_json{
+                    {"hash", hash},
+                    {"source", entry.source},
+                    {"output", entry.output},
+                    {"width", entry.size.width},
+                    {"height", entry.size.height},
+                    {"model", entry.model}
+                });
+            }
+
+            std::ofstream file(path);
+            if (!file)
+                throw std::runtime_error("could not write duplicate index");
+            file << nlohmann::ordered_json{{"entries", items}}.dump(4);
+        }
+
+        // Replaces the entry of the same source, so that a source rendered again points to its latest output
+        void add(const DuplicateEntry& entry) {
+            const auto it = std::find_if(entries.begin(), entries.end(),
+                [&](const DuplicateEntry& other) { return other.source == entry.source && other.model == entry.model; });
+            if (it != entries.end())
+                *it = entry;
+            else
+                entries.push_back(entry);
+        }
+
+        // Closest entry of the same model within the distance of the config whose output still
+        // exists, nullptr without one
+        [[nodiscard]] const DuplicateEntry* find(uint64_t hash, const std::string& model, const DuplicateConfig& config) const {
+            const DuplicateEntry* closest = nullptr;
+            auto closestDistance = std::numeric_limits<int>::max();
+            for (const auto& entry : entries) {
+                const auto distance = getHashDistance(hash, entry.hash);
+                if (distance > config.maxDistance || distance >= closestDistance || entry.model != model
+                        || !std::filesystem::exists(entry.output))
+                    continue;
+                closest = &entry;
+                closestDistance = distance;
+            }
+            return closest;
+        }
+
+        [[nodiscard]] int size() const noexcept {
+            return static_cast<int>(entries.size());
+        }
+
+    private:
+        std::vector<DuplicateEntry> entries;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_DUPLICATES_H
\ No newline at end of file
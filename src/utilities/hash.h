@@ -0,0 +1,288 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_HASH_H
+#define WAIFU2X_TENSORRT_UTILS_HASH_H
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#include <opencv2/core/mat.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "cpu/helper.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#define UTILS_HASH_SHA_NI
+#if defined(_MSC_VER)
+#define UTILS_TARGET_SHA
+#else
+#define UTILS_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+namespace utils {
+    constexpr uint32_t sha256RoundConstants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    [[maybe_unused]]
+    static inline void sha256Compress(uint32_t (&state)[8], const uint8_t* blocks, size_t count) {
+        auto rotate = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+        for (; count > 0; --count, blocks += 64) {
+            uint32_t w[64];
+            for (int i = 0; i < 16; ++i) {
+                w[i] = uint32_t(blocks[4 * i]) << 24 | uint32_t(blocks[4 * i + 1]) << 16
+                    | uint32_t(blocks[4 * i + 2]) << 8 | uint32_t(blocks[4 * i + 3]);
+            }
+            for (int i = 16; i < 64; ++i) {
+                const auto s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                const auto s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            auto a = state[0], b = state[1], c = state[2], d = state[3];
+            auto e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; ++i) {
+                const auto t0 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + (g ^ (e & (f ^ g)))
+                    + sha256RoundConstants[i] + w[i];
+                const auto t1 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) | (c & (a | b)));
+                h = g; g = f; f = e; e = d + t0;
+                d = c; c = b; b = a; a = t0 + t1;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+    }
+
+#ifdef UTILS_HASH_SHA_NI
+    // Four rounds per sha256rnds2 pair, with the message schedule of the rounds ahead computed in
+    // between. The state is kept as ABEF and CDGH, the layout the instructions work on.
+    [[maybe_unused]]
+    UTILS_TARGET_SHA
+    static inline void sha256CompressNi(uint32_t (&state)[8], const uint8_t* blocks, size_t count) {
+        const auto byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+        auto tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1); // CDAB
+        auto state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B); // EFGH
+        auto state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);    // CDGH
+
+        for (; count > 0; --count, blocks += 64) {
+            const auto abefSave = state0;
+            const auto cdghSave = state1;
+            __m128i msg[4];
+            for (int g = 0; g < 16; ++g) {
+                if (g < 4)
+                    msg[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * g)), byteSwap);
+                auto rounds = _mm_add_epi32(msg[g % 4],
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sha256RoundConstants[4 * g])));
+                state1 = _mm_sha256rnds2_epu32(state1, state0, rounds);
+                if (g >= 3 && g <= 14) {
+                    tmp = _mm_alignr_epi8(msg[g % 4], msg[(g + 3) % 4], 4);
+                    msg[(g + 1) % 4] = _mm_sha256msg2_epu32(_mm_add_epi32(msg[(g + 1) % 4], tmp), msg[g % 4]);
+                }
+                rounds = _mm_shuffle_epi32(rounds, 0x0E);
+                state0 = _mm_sha256rnds2_epu32(state0, state1, rounds);
+                if (g >= 1 && g <= 12)
+                    msg[(g + 3) % 4] = _mm_sha256msg1_epu32(msg[(g + 3) % 4], msg[g % 4]);
+            }
+            state0 = _mm_add_epi32(state0, abefSave);
+            state1 = _mm_add_epi32(state1, cdghSave);
+        }
+
+        tmp = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+        state1 = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+        state1 = _mm_alignr_epi8(state1, tmp, 8);    // HGFE
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+    }
+#endif
+
+    // SHA-256 fed in pieces, for keys that have to stay the same across builds and machines.
+    // Uses the SHA extensions when the CPU has them, the digests are the same either way.
+    class Sha256 {
+    public:
+        explicit Sha256(bool accelerated = isAccelerated()) : accelerated(accelerated && isAccelerated()) {
+            reset();
+        }
+
+        [[nodiscard]] static bool isAccelerated() {
+#ifdef UTILS_HASH_SHA_NI
+            static const bool supported = (cpu::cpuGetFeatures() & (cpu::SHA | cpu::SSE42)) == (cpu::SHA | cpu::SSE42);
+            return supported;
+#else
+            return false;
+#endif
+        }
+
+        void reset() {
+            static constexpr uint32_t initialState[8] = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+            };
+            std::memcpy(state, initialState, sizeof(state));
+            length = 0;
+            buffered = 0;
+        }
+
+        Sha256& update(const void* data, size_t size) {
+            const auto* bytes = static_cast<const uint8_t*>(data);
+            length += size;
+            if (buffered > 0) {
+                const auto count = std::min(size, sizeof(buffer) - buffered);
+                std::memcpy(buffer + buffered, bytes, count);
+                buffered += count;
+                bytes += count;
+                size -= count;
+                if (buffered < sizeof(buffer))
+                    return *this;
+                compress(buffer, 1);
+                buffered = 0;
+            }
+            if (size >= sizeof(buffer)) {
+                compress(bytes, size / sizeof(buffer));
+                bytes += size / sizeof(buffer) * sizeof(buffer);
+                size %= sizeof(buffer);
+            }
+            if (size > 0)
+                std::memcpy(buffer, bytes, size);
+            buffered = size;
+            return *this;
+        }
+
+        Sha256& update(const std::string& s) {
+            return update(s.data(), s.size());
+        }
+
+        // Pads a copy of the state, so that more data can still be added afterwards
+        [[nodiscard]] std::array<uint8_t, 32> digest() const {
+            auto copy = *this;
+            const auto bits = copy.length * 8;
+            uint8_t padding[72] = {0x80};
+            const auto padded = (buffered < 56 ? 56 : 120) - buffered;
+            for (int i = 0; i < 8; ++i)
+                padding[padded + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+            copy.update(padding, padded + 8);
+
+            std::array<uint8_t, 32> result {};
+            for (int i = 0; i < 8; ++i) {
+                for (int j = 0; j < 4; ++j)
+                    result[4 * i + j] = static_cast<uint8_t>(copy.state[i] >> (24 - 8 * j));
+            }
+            return result;
+        }
+
+        [[nodiscard]] std::string hexDigest() const {
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string hex;
+            for (const auto byte : digest()) {
+                hex += digits[byte >> 4];
+                hex += digits[byte & 15];
+            }
+            return hex;
+        }
+
+    private:
+        void compress(const uint8_t* blocks, size_t count) {
+#ifdef UTILS_HASH_SHA_NI
+            if (accelerated) {
+                sha256CompressNi(state, blocks, count);
+                return;
+            }
+#endif
+            sha256Compress(state, blocks, count);
+        }
+
+        bool accelerated;
+        uint32_t state[8];
+        uint64_t length;
+        uint8_t buffer[64];
+        size_t buffered;
+    };
+
+    // 64-bit XXH3 fed in pieces, for telling tiles and frames apart on the hot path. Not a
+    // cryptographic hash and its values are only stable for the same xxHash version, so it is
+    // meant for keys that live as long as the process.
+    class Xxh3 {
+    public:
+        explicit Xxh3(uint64_t seed = 0) : seed(seed) {
+            reset();
+        }
+
+        void reset() {
+            XXH3_64bits_reset_withSeed(&state, seed);
+        }
+
+        Xxh3& update(const void* data, size_t size) {
+            XXH3_64bits_update(&state, data, size);
+            return *this;
+        }
+
+        Xxh3& update(const std::string& s) {
+            return update(s.data(), s.size());
+        }
+
+        // Hashes the pixels row by row, so that a view into a larger image hashes the same as a copy of it
+        Xxh3& update(const cv::Mat& image) {
+            const auto rowSize = image.cols * image.elemSize();
+            if (image.isContinuous())
+                return update(image.data, rowSize * image.rows);
+            for (int y = 0; y < image.rows; ++y)
+                update(image.ptr(y), rowSize);
+            return *this;
+        }
+
+        [[nodiscard]] uint64_t digest() const {
+            return XXH3_64bits_digest(&state);
+        }
+
+        [[nodiscard]] static uint64_t hash(const void* data, size_t size, uint64_t seed = 0) {
+            return XXH3_64bits_withSeed(data, size, seed);
+        }
+
+    private:
+        uint64_t seed;
+        XXH3_state_t state {};
+    };
+
+    struct HashBenchmark {
+        std::string name;
+        double gigabytesPerSecond = 0.0;
+    };
+
+    // Throughput of every hash the host can run over the same buffer
+    [[maybe_unused]]
+    static inline std::vector<HashBenchmark> benchmarkHashes(size_t size, int iterations) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i)
+            data[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+
+        auto time = [&](auto&& hash) {
+            hash();
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+                hash();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            return static_cast<double>(size) * iterations / elapsed.count() / 1e9;
+        };
+
+        std::vector<HashBenchmark> results;
+        volatile uint8_t sink = 0;
+        results.push_back({"sha256", time([&] { sink = Sha256(false).update(data.data(), size).digest()[0]; })});
+        if (Sha256::isAccelerated())
+            results.push_back({"sha256 sha-ni", time([&] { sink = Sha256(true).update(data.data(), size).digest()[0]; })});
+        results.push_back({"xxh3", time([&] { sink = static_cast<uint8_t>(Xxh3::hash(data.data(), size)); })});
+        return results;
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_HASH_H
\ No newline at end of file
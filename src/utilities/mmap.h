@@ -0,0 +1,202 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_MMAP_H
+#define WAIFU2X_TENSORRT_UTILS_MMAP_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utils {
+    // Read-only memory mapping of a whole file; pages are shared with every other
+    // process mapping the same file
+    class MappedFile {
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::string& path) {
+            open(path);
+        }
+
+        ~MappedFile() {
+            close();
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        void open(const std::string& path) {
+            close();
+#if defined(_WIN32) || defined(_WIN64)
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                throw std::runtime_error("could not open file \"" + path + "\"");
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+                close();
+                throw std::runtime_error("could not map empty file \"" + path + "\"");
+            }
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping) {
+                close();
+                throw std::runtime_error("could not map file \"" + path + "\"");
+            }
+            data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!data_) {
+                close();
+                throw std::runtime_error("could not map file \"" + path + "\"");
+            }
+            size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("could not open file \"" + path + "\"");
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                throw std::runtime_error("could not map empty file \"" + path + "\"");
+            }
+            void* ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("could not map file \"" + path + "\"");
+            data_ = ptr;
+            size_ = static_cast<size_t>(st.st_size);
+#endif
+        }
+
+        void close() noexcept {
+#if defined(_WIN32) || defined(_WIN64)
+            if (data_)
+                UnmapViewOfFile(data_);
+            if (mapping)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (data_)
+                munmap(data_, size_);
+#endif
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        [[nodiscard]] bool isOpened() const noexcept {
+            return data_ != nullptr;
+        }
+
+        // Reads a byte of every page, so that the first accesses afterwards do not fault
+        void prefault() const noexcept {
+            if (!data_)
+                return;
+#if defined(_WIN32) || defined(_WIN64)
+            WIN32_MEMORY_RANGE_ENTRY range{data_, size_};
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+            madvise(data_, size_, MADV_WILLNEED);
+#endif
+            const auto* bytes = static_cast<const volatile char*>(data_);
+            for (size_t i = 0; i < size_; i += 4096)
+                static_cast<void>(bytes[i]);
+        }
+
+        [[nodiscard]] const void* data() const noexcept {
+            return data_;
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return size_;
+        }
+
+    private:
+        void* data_ = nullptr;
+        size_t size_ = 0;
+#if defined(_WIN32) || defined(_WIN64)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
+
+    // Anonymous pages holding generated machine code; they are only writable while the code
+    // is copied in and executable afterwards
+    class ExecutableMemory {
+    public:
+        ExecutableMemory() = default;
+
+        ~ExecutableMemory() {
+            release();
+        }
+
+        ExecutableMemory(const ExecutableMemory&) = delete;
+        ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+        void assign(const void* code, size_t size) {
+            release();
+            if (size == 0)
+                return;
+#if defined(_WIN32) || defined(_WIN64)
+            data_ = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (!data_)
+                throw std::runtime_error("could not allocate executable memory");
+            size_ = size;
+            std::memcpy(data_, code, size);
+            DWORD oldProtection;
+            if (!VirtualProtect(data_, size, PAGE_EXECUTE_READ, &oldProtection)) {
+                release();
+                throw std::runtime_error("could not make memory executable");
+            }
+            FlushInstructionCache(GetCurrentProcess(), data_, size);
+#else
+            void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                throw std::runtime_error("could not allocate executable memory");
+            data_ = ptr;
+            size_ = size;
+            std::memcpy(data_, code, size);
+            if (mprotect(data_, size, PROT_READ | PROT_EXEC) != 0) {
+                release();
+                throw std::runtime_error("could not make memory executable");
+            }
+#endif
+        }
+
+        void release() noexcept {
+#if defined(_WIN32) || defined(_WIN64)
+            if (data_)
+                VirtualFree(data_, 0, MEM_RELEASE);
+#else
+            if (data_)
+                munmap(data_, size_);
+#endif
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        [[nodiscard]] const void* data() const noexcept {
+            return data_;
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return size_;
+        }
+
+    private:
+        void* data_ = nullptr;
+        size_t size_ = 0;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_MMAP_H
\ No newline at end of file
@@ -0,0 +1,325 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_MOTION_H
+#define WAIFU2X_TENSORRT_UTILS_MOTION_H
+
+#include "dispatcher.h"
+#include "tiling.h"
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace utils {
+    struct MotionConfig {
+        int threshold = 2;           // largest 8-bit difference between a tile and the shifted previous frame that still reuses it
+        double minResponse = 0.1;    // phase correlation peak below which the frame is treated as static
+        int analysisWidth = 320;     // frames are downscaled to about this width to estimate the shift
+        int refreshInterval = 120;   // frames after which every tile is rendered again, 0 never refreshes
+    };
+
+    struct MotionReport {
+        cv::Point2i shift;           // of the frame against the previous one, in input pixels
+        double response = 0.0;       // phase correlation peak, 0 when the shift came from a change map
+        int tileCount = 0;
+        int renderedTileCount = 0;
+    };
+
+    // Motion of the blocks of a frame against the previous one as the decoder predicted them, which
+    // tells the tiles that changed without comparing pixels
+    struct ChangeMap {
+        int blockSize = 4;
+        cv::Mat motion;  // CV_32SC2, shift of every block in pixels
+        cv::Mat changed; // CV_8U, nonzero for blocks that were not copied from the past by a whole-pixel shift
+
+        [[nodiscard]] bool empty() const noexcept {
+            return changed.empty();
+        }
+
+        // Most common shift of the blocks that were copied
+        [[nodiscard]] cv::Point2i getDominantShift() const {
+            std::map<std::pair<int, int>, int> counts;
+            for (int y = 0; y < changed.rows; ++y) {
+                const auto* changedRow = changed.ptr<uint8_t>(y);
+                const auto* motionRow = motion.ptr<int>(y);
+                for (int x = 0; x < changed.cols; ++x) {
+                    if (!changedRow[x])
+                        ++counts[{motionRow[x * 2], motionRow[x * 2 + 1]}];
+                }
+            }
+
+            auto shift = std::make_pair(0, 0);
+            auto count = 0;
+            for (const auto& [candidate, candidateCount] : counts) {
+                if (candidateCount > count) {
+                    shift = candidate;
+                    count = candidateCount;
+                }
+            }
+            return {shift.first, shift.second};
+        }
+
+        // Whether a block under rect changed or moved other than by shift. Blocks are clamped to the
+        // map, the same border replication the tiles are read with.
+        [[nodiscard]] bool isChanged(const cv::Rect2i& rect, const cv::Point2i& shift) const {
+            const auto x0 = std::clamp(rect.x / blockSize, 0, changed.cols - 1);
+            const auto y0 = std::clamp(rect.y / blockSize, 0, changed.rows - 1);
+            const auto x1 = std::clamp((rect.x + rect.width - 1) / blockSize, 0, changed.cols - 1);
+            const auto y1 = std::clamp((rect.y + rect.height - 1) / blockSize, 0, changed.rows - 1);
+            for (int y = y0; y <= y1; ++y) {
+                const auto* changedRow = changed.ptr<uint8_t>(y);
+                const auto* motionRow = motion.ptr<int>(y);
+                for (int x = x0; x <= x1; ++x) {
+                    if (changedRow[x] || motionRow[x * 2] != shift.x || motionRow[x * 2 + 1] != shift.y)
+                        return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // Whether every pixel of rect in current matches the pixel of previous it was shifted from.
+    // Coordinates are clamped to both images, the same border replication the tiles are read with.
+    [[maybe_unused]]
+    static inline bool matchesShifted(const cv::Mat& current, const cv::Mat& previous, const cv::Rect2i& rect,
+        const cv::Point2i& shift, int threshold) {
+        for (int y = rect.y; y < rect.y + rect.height; ++y) {
+            const auto* currentRow = current.ptr<uint8_t>(std::clamp(y, 0, current.rows - 1));
+            const auto* previousRow = previous.ptr<uint8_t>(std::clamp(y - shift.y, 0, previous.rows - 1));
+            for (int x = rect.x; x < rect.x + rect.width; ++x) {
+                const auto* currentPixel = currentRow + std::clamp(x, 0, current.cols - 1) * 3;
+                const auto* previousPixel = previousRow + std::clamp(x - shift.x, 0, previous.cols - 1) * 3;
+                for (int c = 0; c < 3; ++c) {
+                    if (std::abs(currentPixel[c] - previousPixel[c]) > threshold)
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Renders video frames that are mostly a shifted copy of the previous one, as in camera pans.
+    // The global translation is estimated by phase correlation on a downscaled luma frame and
+    // refined to the pixel at full resolution. The previous output is shifted along, and only the
+    // tiles it does not cover, or whose input changed by more than the threshold, are rendered and
+    // blended over it. A static frame is the case of a zero shift. Frames coming from a decoder can
+    // pass the change map it exported instead, then the shift and the changed tiles are taken from
+    // the motion of its blocks and no pixels are compared.
+    class MotionReuse {
+    public:
+        void setBackend(TileBackend* value) {
+            backend = value;
+            reset();
+        }
+
+        // Forgets the previous frame, e.g. at a cut, so the next frame is rendered in full
+        void reset() {
+            previousInput.release();
+            previousOutput.release();
+        }
+
+        MotionReport render(const cv::Mat& src, cv::Mat& dst, int scaling, const cv::Point2d& overlap,
+            const MotionConfig& config, const ChangeMap* changes = nullptr) {
+            if (!backend)
+                throw std::runtime_error("no backend to render tiles with");
+            if (src.type() != CV_8UC3)
+                throw std::runtime_error("input image is not 8-bit BGR");
+            if (changes && changes->empty())
+                changes = nullptr;
+            if (changes && changes->changed.size() != cv::Size2i(
+                    (src.cols + changes->blockSize - 1) / changes->blockSize, (src.rows + changes->blockSize - 1) / changes->blockSize))
+                throw std::runtime_error("change map does not match the frame");
+
+            MotionReport report;
+            const auto refresh = previousInput.size() != src.size() || scaling != previousScaling
+                || overlap != previousOverlap || (config.refreshInterval > 0 && framesSinceRefresh >= config.refreshInterval);
+
+            // Global shift, frames that do not correlate can still reuse their static tiles
+            analyze(src, config);
+            if (!refresh && changes) {
+                report.shift = changes->getDominantShift();
+            } else if (!refresh) {
+                const auto shift = cv::phaseCorrelate(previousLuma, luma, window, &report.response);
+                if (report.response >= config.minResponse) {
+                    report.shift = refineShift(cv::Point2d(
+                        shift.x * src.cols / luma.cols, shift.y * src.rows / luma.rows
+                    ));
+                }
+            }
+
+            // Tile plan
+            const auto inputTileSize = backend->getInputTileSize();
+            const auto outputTileSize = backend->getOutputTileSize();
+            const auto outputRect = cv::Rect2i(0, 0, src.cols * scaling, src.rows * scaling);
+            const auto [tileCount, inputTileRects, outputTileRects] = calculateTiles(
+                cv::Rect2i(0, 0, src.cols, src.rows), outputRect, inputTileSize, outputTileSize, scaling, overlap
+            );
+            report.tileCount = tileCount;
+
+            // Tiles the shifted previous output does not cover or whose input changed
+            const auto inputRect = cv::Rect2i(0, 0, src.cols, src.rows);
+            auto isChanged = [&](const cv::Rect2i& rect) {
+                if (!changes)
+                    return !matchesShifted(src, previousInput, rect, report.shift, config.threshold);
+
+                // The replicated border only moves along with the frame on an axis without motion
+                const auto inside = rect & inputRect;
+                if ((inside.width != rect.width && report.shift.x != 0) || (inside.height != rect.height && report.shift.y != 0))
+                    return true;
+                return changes->isChanged(rect, report.shift);
+            };
+            const auto outputShift = report.shift * scaling;
+            std::vector<int> tiles;
+            for (int i = 0; i < tileCount; ++i) {
+                const auto sourceRect = outputTileRects[i] - outputShift;
+                if (refresh || (sourceRect & outputRect) != sourceRect || isChanged(inputTileRects[i]))
+                    tiles.push_back(i);
+            }
+            report.renderedTileCount = static_cast<int>(tiles.size());
+
+            // Previous output moved along with the frame
+            predicted.create(outputRect.size(), CV_32FC3);
+            predicted.setTo(cv::Scalar(0, 0, 0));
+            if (!refresh) {
+                const auto overlapRect = (outputRect + outputShift) & outputRect;
+                if (!overlapRect.empty())
+                    previousOutput(overlapRect - outputShift).copyTo(predicted(overlapRect));
+            }
+
+            // Blend weights, the weight sum tells how much of the shifted output is left over
+            const auto overlapping = overlap.x != 0 || overlap.y != 0;
+            if (overlapping) {
+                const auto scaledOutputOverlap = cv::Point2i(
+                    static_cast<int>(std::lround(inputTileSize.width * scaling * overlap.x)),
+                    static_cast<int>(std::lround(inputTileSize.height * scaling * overlap.y))
+                );
+                createTileWeights(weights, scaledOutputOverlap, outputTileSize);
+            }
+            rendered.create(outputRect.size(), CV_32FC3);
+            rendered.setTo(cv::Scalar(0, 0, 0));
+            weightSum.create(outputRect.size(), CV_32FC3);
+            weightSum.setTo(cv::Scalar(0, 0, 0));
+
+            const auto batchSize = backend->getBatchSize();
+            std::vector<cv::Rect2i> rects;
+            std::vector<cv::Mat> outputs;
+            for (size_t first = 0; first < tiles.size(); first += batchSize) {
+                const auto count = std::min(static_cast<int>(tiles.size() - first), batchSize);
+                rects.clear();
+                for (int i = 0; i < count; ++i)
+                    rects.push_back(inputTileRects[tiles[first + i]]);
+                if (!backend->inferRegions(src, rects, outputs))
+                    throw std::runtime_error("failed to infer tile " + std::to_string(tiles[first] + 1)
+                        + "/" + std::to_string(tileCount));
+
+                for (int i = 0; i < count; ++i) {
+                    const auto& outputTileRect = outputTileRects[tiles[first + i]];
+                    const auto region = cv::Rect2i(0, 0, outputTileRect.width, outputTileRect.height);
+                    cv::Mat weight(outputTileSize, CV_32FC3, cv::Scalar(1.f, 1.f, 1.f));
+                    if (overlapping) {
+                        applyTileWeights(outputs[i], outputs[i], outputTileRect, outputRect, weights);
+                        applyTileWeights(weight, weight, outputTileRect, outputRect, weights);
+                    }
+                    cv::add(outputs[i](region), rendered(outputTileRect), rendered(outputTileRect));
+                    cv::add(weight(region), weightSum(outputTileRect), weightSum(outputTileRect));
+                }
+            }
+
+            // Shifted output fills whatever weight the rendered tiles left
+            output.create(outputRect.size(), CV_32FC3);
+            for (int y = 0; y < output.rows; ++y) {
+                const auto* predictedRow = predicted.ptr<float>(y);
+                const auto* renderedRow = rendered.ptr<float>(y);
+                const auto* weightRow = weightSum.ptr<float>(y);
+                auto* outputRow = output.ptr<float>(y);
+                for (int x = 0; x < output.cols * 3; ++x)
+                    outputRow[x] = renderedRow[x] + (1.0f - weightRow[x]) * predictedRow[x];
+            }
+            output.convertTo(dst, CV_8UC3, 255.0);
+
+            // Keep this frame for the next one
+            src.copyTo(previousInput);
+            std::swap(output, previousOutput);
+            std::swap(luma, previousLuma);
+            std::swap(fullLuma, previousFullLuma);
+            previousScaling = scaling;
+            previousOverlap = overlap;
+            framesSinceRefresh = refresh ? 1 : framesSinceRefresh + 1;
+
+            return report;
+        }
+
+    private:
+        void analyze(const cv::Mat& src, const MotionConfig& config) {
+            const auto factor = std::max(1, src.cols / std::max(1, config.analysisWidth));
+            cv::cvtColor(src, fullLuma, cv::COLOR_BGR2GRAY);
+            cv::resize(fullLuma, smallLuma, cv::Size2i(std::max(1, src.cols / factor), std::max(1, src.rows / factor)),
+                0, 0, cv::INTER_AREA);
+            smallLuma.convertTo(luma, CV_32F);
+            if (window.size() != luma.size())
+                cv::createHanningWindow(window, luma.size(), CV_32F);
+        }
+
+        // Integer shift around the estimate with the least luma difference, on a sparse grid
+        cv::Point2i refineShift(const cv::Point2d& estimate) const {
+            constexpr auto step = 4;
+            const auto center = cv::Point2i(static_cast<int>(std::lround(estimate.x)), static_cast<int>(std::lround(estimate.y)));
+            auto best = center;
+            auto bestCost = std::numeric_limits<double>::infinity();
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const auto shift = center + cv::Point2i(dx, dy);
+                    const auto rect = cv::Rect2i(shift.x, shift.y, fullLuma.cols, fullLuma.rows)
+                        & cv::Rect2i(0, 0, fullLuma.cols, fullLuma.rows);
+                    if (rect.width <= step || rect.height <= step)
+                        continue;
+
+                    double cost = 0.0;
+                    int count = 0;
+                    for (int y = rect.y; y < rect.y + rect.height; y += step) {
+                        const auto* row = fullLuma.ptr<uint8_t>(y);
+                        const auto* previousRow = previousFullLuma.ptr<uint8_t>(y - shift.y);
+                        for (int x = rect.x; x < rect.x + rect.width; x += step, ++count)
+                            cost += std::abs(row[x] - previousRow[x - shift.x]);
+                    }
+                    cost /= count;
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        best = shift;
+                    }
+                }
+            }
+            return best;
+        }
+
+        TileBackend* backend = nullptr;
+
+        // Analysis
+        cv::Mat fullLuma;
+        cv::Mat smallLuma;
+        cv::Mat luma;
+        cv::Mat window;
+
+        // Previous frame
+        cv::Mat previousInput;
+        cv::Mat previousOutput;
+        cv::Mat previousFullLuma;
+        cv::Mat previousLuma;
+        int previousScaling = 0;
+        cv::Point2d previousOverlap;
+        int framesSinceRefresh = 0;
+
+        // Blending
+        std::array<cv::Mat, 4> weights;
+        cv::Mat predicted;
+        cv::Mat rendered;
+        cv::Mat weightSum;
+        cv::Mat output;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_MOTION_H
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_PROFILE_H
+#define WAIFU2X_TENSORRT_UTILS_PROFILE_H
+
+#include <algorithm>
+
+namespace utils {
+    enum class ExecutionProfile {
+        Latency,
+        Throughput,
+        Balanced
+    };
+
+    // What a profile sets the options that were not given explicitly to
+    struct ProfileConfig {
+        int batchSize = 1;      // tiles per inference
+        int workers = 0;        // processes rendering whole files, 0 renders in this one (cpu backend only)
+        int threads = 0;        // per worker, 0 uses every hardware thread
+        int framesInFlight = 1; // video frames streamed through the engine at a time (tensorrt backend only)
+    };
+
+    // Latency splits the tiles of a single image over every thread, with one tile per batch and one
+    // frame in flight. Throughput renders one file per single threaded worker process, so that no
+    // thread waits on another, with larger batches and three frames in flight. Balanced runs workers
+    // of four threads each, or a single process on hosts with fewer than eight hardware threads.
+    [[maybe_unused]]
+    static inline ProfileConfig getProfileConfig(ExecutionProfile profile, int hardwareThreads) {
+        hardwareThreads = std::max(1, hardwareThreads);
+        switch (profile) {
+            default:
+            case ExecutionProfile::Latency:
+                return {.batchSize = 1, .workers = 0, .threads = 0, .framesInFlight = 1};
+
+            case ExecutionProfile::Throughput:
+                return {.batchSize = 4, .workers = hardwareThreads, .threads = 1, .framesInFlight = 3};
+
+            case ExecutionProfile::Balanced: {
+                const auto workers = hardwareThreads / 4;
+                return {.batchSize = 2, .workers = workers >= 2 ? workers : 0, .threads = workers >= 2 ? 4 : 0,
+                    .framesInFlight = 2};
+            }
+        }
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_PROFILE_H
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_THREADPOOL_H
+#define WAIFU2X_TENSORRT_UTILS_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+    // Fixed set of workers executing index ranges; the calling thread takes part in every
+    // parallelFor, so a pool of size 1 runs everything inline. Not reentrant.
+    class ThreadPool {
+    public:
+        explicit ThreadPool(int threadCount = 0) {
+            if (threadCount <= 0)
+                threadCount = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+            workers.reserve(threadCount - 1);
+            for (int i = 0; i < threadCount - 1; ++i)
+                workers.emplace_back([this] { workerLoop(); });
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        [[nodiscard]] int size() const noexcept {
+            return static_cast<int>(workers.size()) + 1;
+        }
+
+        void parallelFor(int count, const std::function<void(int)>& function) {
+            if (count <= 0)
+                return;
+            if (workers.empty() || count == 1) {
+                for (int i = 0; i < count; ++i)
+                    function(i);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                task = &function;
+                taskCount = count;
+                next = 0;
+                active = static_cast<int>(workers.size());
+                error = nullptr;
+                ++generation;
+            }
+            wake.notify_all();
+            work();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this] { return active == 0; });
+            task = nullptr;
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        // Runs function once on every thread of the pool, the calling one included, function must not
+        // throw. A thread holds its index until every thread has taken one, so that none takes a second.
+        void runOnEachThread(const std::function<void()>& function) {
+            const auto count = size();
+            std::atomic<int> arrived = 0;
+            parallelFor(count, [&](int) {
+                function();
+                arrived.fetch_add(1);
+                while (arrived.load() < count)
+                    std::this_thread::yield();
+            });
+        }
+
+    private:
+        void workerLoop() {
+            uint64_t seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                lock.unlock();
+                work();
+                lock.lock();
+                if (--active == 0)
+                    done.notify_one();
+            }
+        }
+
+        void work() {
+            for (int i = next.fetch_add(1); i < taskCount; i = next.fetch_add(1)) {
+                try {
+                    (*task)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                    next = taskCount;
+                }
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const std::function<void(int)>* task = nullptr;
+        int taskCount = 0;
+        std::atomic<int> next = 0;
+        int active = 0;
+        uint64_t generation = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+    };
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_THREADPOOL_H
\ No newline at end of file
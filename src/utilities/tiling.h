@@ -0,0 +1,172 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_TILING_H
+#define WAIFU2X_TENSORRT_UTILS_TILING_H
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+#include <vector>
+
+namespace utils {
+    enum Augmentation {
+        None,
+        FlipHorizontal,
+        FlipVertical,
+        Rotate90,
+        Rotate180,
+        Rotate270,
+        FlipHorizontalRotate90,
+        FlipVerticalRotate90
+    };
+
+    [[maybe_unused]]
+    static inline std::tuple<const int, std::vector<cv::Rect2i>, std::vector<cv::Rect2i>>
+    calculateTiles(const cv::Rect2i& inputRect, const cv::Rect2i& outputRect,
+        const cv::Size2i& inputTileSize, const cv::Size2i& outputTileSize,
+        int scaling, const cv::Point2d& overlap) {
+        const auto scaledOutputTileSize = cv::Size2i(
+            inputTileSize.width * scaling,
+            inputTileSize.width * scaling
+        );
+
+        const auto scaledInputTileSize = cv::Size2i(
+            static_cast<int>(std::lround(static_cast<double>(outputTileSize.width) / scaledOutputTileSize.width * inputTileSize.width)),
+            static_cast<int>(std::lround(static_cast<double>(outputTileSize.height) / scaledOutputTileSize.height * inputTileSize.height))
+        );
+
+        const auto inputOverlap = cv::Point2i(
+            static_cast<int>(std::lround(inputTileSize.width * overlap.x)),
+            static_cast<int>(std::lround(inputTileSize.height * overlap.y))
+        );
+
+        const auto scaledOutputOverlap = cv::Point2i(
+            static_cast<int>(std::lround(scaledOutputTileSize.width * overlap.x)),
+            static_cast<int>(std::lround(scaledOutputTileSize.height * overlap.y))
+        );
+
+        // Images no larger than the overlap still need a tile
+        const auto tiling = cv::Point2i(
+            std::max(1, static_cast<int>(std::lround(std::ceil(static_cast<double>(inputRect.width - inputOverlap.x) / (scaledInputTileSize.width - inputOverlap.x))))),
+            std::max(1, static_cast<int>(std::lround(std::ceil(static_cast<double>(inputRect.height - inputOverlap.y) / (scaledInputTileSize.height - inputOverlap.y)))))
+        );
+
+        const auto tileCount = tiling.x * tiling.y;
+
+        std::vector<cv::Rect2i> inputTileRects;
+        std::vector<cv::Rect2i> outputTileRects;
+        inputTileRects.reserve(tileCount);
+        outputTileRects.reserve(tileCount);
+
+        for (auto i = 0; i < tiling.x; ++i) {
+            for (auto j = 0; j < tiling.y; ++j) {
+                // offset_border + offset_scaled_tile - offset_overlap
+                inputTileRects.emplace_back(
+                    -((inputTileSize.width - scaledInputTileSize.width) / 2) + (i * scaledInputTileSize.width) - (i * inputOverlap.x),
+                    -((inputTileSize.height - scaledInputTileSize.height) / 2) + (j * scaledInputTileSize.height) - (j * inputOverlap.y),
+                    inputTileSize.width,
+                    inputTileSize.height
+                );
+
+                // offset_tile - offset_overlap
+                const auto x = i * outputTileSize.width - (i * scaledOutputOverlap.x);
+                const auto y = j * outputTileSize.height - (j * scaledOutputOverlap.y);
+                outputTileRects.emplace_back(
+                    x,
+                    y,
+                    x + outputTileSize.width > outputRect.width ? outputRect.width - x : outputTileSize.width,
+                    y + outputTileSize.height > outputRect.height ? outputRect.height - y : outputTileSize.height
+                );
+            }
+        }
+
+        return std::make_tuple(tileCount, inputTileRects, outputTileRects);
+    }
+
+    // Region of the image, the part outside of it replicates the border
+    [[maybe_unused]]
+    static inline cv::Mat padRoi(const cv::Mat& input, const cv::Rect2i& roi) {
+        int tl_x = roi.x;
+        int tl_y = roi.y;
+        int br_x = roi.x + roi.width;
+        int br_y = roi.y + roi.height;
+        int width = roi.width;
+        int height = roi.height;
+
+        if (tl_x < 0 || tl_y < 0 || br_x > input.cols || br_y > input.rows) {
+            int left = 0, right = 0, top = 0, bottom = 0;
+
+            if (tl_x < 0) {
+                width += tl_x;
+                left = -tl_x;
+                tl_x = 0;
+            }
+            if (tl_y < 0) {
+                height += tl_y;
+                top = -tl_y;
+                tl_y = 0;
+            }
+            if (br_x > input.cols) {
+                width -= br_x - input.cols;
+                right = br_x - input.cols;
+            }
+            if (br_y > input.rows) {
+                height -= br_y - input.rows;
+                bottom = br_y - input.rows;
+            }
+
+            cv::Mat output;
+            cv::copyMakeBorder(input(cv::Rect2i(tl_x, tl_y, width, height)),
+                output, top, bottom, left, right, cv::BORDER_REPLICATE);
+            return output;
+        } else {
+            return input(cv::Rect2i(tl_x, tl_y, width, height));
+        }
+    }
+
+    // Top, right, bottom and left ramps blending the overlap of neighbouring output tiles
+    [[maybe_unused]]
+    static inline void createTileWeights(std::array<cv::Mat, 4>& weights, const cv::Point2i& overlap, const cv::Size2i& size) {
+        weights[0] = cv::Mat(size, CV_32FC3, cv::Scalar(1.f, 1.f, 1.f));
+        weights[3] = cv::Mat(size, CV_32FC3, cv::Scalar(1.f, 1.f, 1.f));
+
+        // Top
+        const int height = overlap.y + 1;
+        for (int i = 1; i < height; ++i) {
+            double alpha = static_cast<double>(i) / height;
+            weights[0].row(i - 1).setTo(cv::Scalar(alpha, alpha, alpha));
+        }
+
+        // Left
+        const int width = overlap.x + 1;
+        for (int i = 1; i < width; ++i) {
+            double alpha = static_cast<double>(i) / width;
+            weights[3].col(i - 1).setTo(cv::Scalar(alpha, alpha, alpha));
+        }
+
+        // Bottom
+        cv::flip(weights[0], weights[2], 0);
+
+        // Right
+        cv::flip(weights[3], weights[1], 1);
+    }
+
+    [[maybe_unused]]
+    static inline void applyTileWeights(const cv::Mat& src, cv::Mat& dst,
+        const cv::Rect2i& srcRect, const cv::Rect2i& dstRect,
+        const std::array<cv::Mat, 4>& weights) {
+        if (srcRect.x > dstRect.x)
+            cv::multiply(src, weights[3], dst);
+
+        if (srcRect.y > dstRect.y)
+            cv::multiply(src, weights[0], dst);
+
+        if (srcRect.x + srcRect.width < dstRect.width)
+            cv::multiply(src, weights[1], dst);
+
+        if (srcRect.y + srcRect.height < dstRect.height)
+            cv::multiply(src, weights[2], dst);
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_TILING_H
\ No newline at end of file
@@ -1,13 +1,48 @@
 #ifndef WAIFU2X_TENSORRT_UTILS_TIME_H
 #define WAIFU2X_TENSORRT_UTILS_TIME_H
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
+#include <vector>
 
 namespace utils {
     template<typename T>
     static inline double getElapsedMilliseconds(std::chrono::time_point<T> t0, std::chrono::time_point<T> t1) {
         return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count()) / 1000.0;
     }
+
+    // Latency of the synthetic batches a backend runs when it is loaded. The first one pays for
+    // the lazy initialization the later ones no longer see.
+    struct WarmupResult {
+        int batches = 0;
+        double coldMilliseconds = 0.0;
+        double warmMilliseconds = 0.0; // median of the batches after the first
+    };
+
+    // Times batches calls of run, stopping at the first one that fails
+    [[maybe_unused]]
+    static inline bool measureWarmup(int batches, const std::function<bool()>& run, WarmupResult& result) {
+        std::vector<double> milliseconds;
+        for (int i = 0; i < batches; ++i) {
+            const auto t0 = std::chrono::steady_clock::now();
+            if (!run())
+                return false;
+            milliseconds.push_back(getElapsedMilliseconds(t0, std::chrono::steady_clock::now()));
+        }
+
+        result = WarmupResult();
+        result.batches = batches;
+        if (milliseconds.empty())
+            return true;
+        result.coldMilliseconds = milliseconds.front();
+        if (milliseconds.size() > 1) {
+            std::vector<double> warm(milliseconds.begin() + 1, milliseconds.end());
+            std::nth_element(warm.begin(), warm.begin() + warm.size() / 2, warm.end());
+            result.warmMilliseconds = warm[warm.size() / 2];
+        }
+        return true;
+    }
 }
 
 #endif //WAIFU2X_TENSORRT_UTILS_TIME_H
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef WAIFU2X_TENSORRT_UTILS_WORKERS_H
+#define WAIFU2X_TENSORRT_UTILS_WORKERS_H
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace utils {
+    struct WorkerConfig {
+        int workers = 1;
+        int maxRestarts = 3; // forks again of a worker killed by a signal before it counts as failed
+    };
+
+    struct WorkerExit {
+        int worker = 0;
+        int exitCode = 0; // of a worker that returned
+        int signal = 0;   // that killed the worker, 0 when it returned
+        bool restarted = false;
+    };
+
+    struct WorkerReport {
+        int restarts = 0;
+        int failed = 0;
+    };
+
+    // Forks the worker processes and supervises them. Whatever the parent mapped or loaded before is
+    // shared with every worker copy-on-write, such as the pages of a compiled model and its generated
+    // code, so a worker only adds the pages it writes to itself. A worker killed by a signal is forked
+    // again from the same state, a worker that returns an error is not. The parent has to be single
+    // threaded when calling this, since no other thread is copied into the workers. Returns the index
+    // of the worker in a worker process, and -1 in the parent once every worker has exited.
+    [[maybe_unused]]
+    static inline int forkWorkers(const WorkerConfig& config, WorkerReport& report,
+        const std::function<void(const WorkerExit&)>& onExit = nullptr) {
+#if defined(_WIN32) || defined(_WIN64)
+        throw std::runtime_error("worker processes are not supported on windows");
+#else
+        std::map<pid_t, int> workers;
+        std::vector<int> restarts(config.workers, 0);
+        report = WorkerReport();
+
+        // True in the forked process
+        auto spawn = [&](int worker) {
+            const auto pid = fork();
+            if (pid < 0)
+                throw std::runtime_error("could not fork worker: " + std::string(std::strerror(errno)));
+            if (pid == 0)
+                return true;
+            workers[pid] = worker;
+            return false;
+        };
+
+        for (int i = 0; i < config.workers; ++i) {
+            if (spawn(i))
+                return i;
+        }
+
+        while (!workers.empty()) {
+            int status = 0;
+            const auto pid = waitpid(-1, &status, 0);
+            if (pid < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error("could not wait for workers: " + std::string(std::strerror(errno)));
+            }
+            const auto it = workers.find(pid);
+            if (it == workers.end())
+                continue;
+
+            WorkerExit exit;
+            exit.worker = it->second;
+            workers.erase(it);
+            if (WIFEXITED(status)) {
+                exit.exitCode = WEXITSTATUS(status);
+                if (exit.exitCode == 0)
+                    continue;
+            } else if (WIFSIGNALED(status)) {
+                exit.signal = WTERMSIG(status);
+                exit.restarted = restarts[exit.worker] < config.maxRestarts;
+            }
+
+            if (exit.restarted) {
+                ++restarts[exit.worker];
+                ++report.restarts;
+            } else {
+                ++report.failed;
+            }
+            if (onExit)
+                onExit(exit);
+            if (exit.restarted && spawn(exit.worker))
+                return exit.worker;
+        }
+        return -1;
+#endif
+    }
+}
+
+#endif //WAIFU2X_TENSORRT_UTILS_WORKERS_H
\ No newline at end of file
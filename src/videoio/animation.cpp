@@ -0,0 +1,478 @@
+#include "animation.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+AnimationReader::AnimationReader() = default;
+
+AnimationReader::~AnimationReader() {
+    release();
+}
+
+uint16_t readWord(const uint8_t* bytes) {
+    return static_cast<uint16_t>(bytes[0] | bytes[1] << 8);
+}
+
+uint32_t readBigEndian(const uint8_t* bytes) {
+    return static_cast<uint32_t>(bytes[0]) << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+}
+
+// Browsers show frames without a delay, or with a delay of 10 ms, for 100 ms
+int getGifDelay(int delay) {
+    return delay <= 1 ? 10 : delay;
+}
+
+// Decodes the LZW compressed color indices of a GIF frame, a truncated stream leaves the
+// remaining indices at 0
+void decodeLzw(const std::vector<uint8_t>& codes, int minCodeSize, std::vector<uint8_t>& indices) {
+    constexpr int maxCodes = 4096;
+    std::array<uint16_t, maxCodes> prefix {};
+    std::array<uint8_t, maxCodes> suffix {};
+    std::vector<uint8_t> stack;
+    stack.reserve(maxCodes);
+
+    const auto clear = 1 << minCodeSize;
+    const auto end = clear + 1;
+    for (int i = 0; i < clear; ++i)
+        suffix[i] = static_cast<uint8_t>(i);
+
+    auto codeSize = minCodeSize + 1;
+    auto next = clear + 2;
+    auto previous = -1;
+    auto first = 0;
+    size_t bit = 0;
+    size_t written = 0;
+    while (written < indices.size() && bit + codeSize <= codes.size() * 8) {
+        auto code = 0;
+        for (int i = 0; i < codeSize; ++i, ++bit)
+            code |= (codes[bit / 8] >> (bit % 8) & 1) << i;
+
+        if (code == clear) {
+            codeSize = minCodeSize + 1;
+            next = clear + 2;
+            previous = -1;
+            continue;
+        }
+        if (code == end || code > next || (previous < 0 && code >= clear))
+            break;
+
+        if (previous < 0) {
+            indices[written++] = suffix[code];
+            first = code;
+            previous = code;
+            continue;
+        }
+
+        // A code one past the table is the previous string followed by its own first index
+        const auto current = code;
+        if (code == next) {
+            stack.push_back(static_cast<uint8_t>(first));
+            code = previous;
+        }
+        while (code >= clear) {
+            stack.push_back(suffix[code]);
+            code = prefix[code];
+        }
+        first = code;
+        stack.push_back(static_cast<uint8_t>(first));
+        while (!stack.empty() && written < indices.size()) {
+            indices[written++] = stack.back();
+            stack.pop_back();
+        }
+        stack.clear();
+
+        if (next < maxCodes) {
+            prefix[next] = static_cast<uint16_t>(previous);
+            suffix[next] = static_cast<uint8_t>(first);
+            ++next;
+            if (next == 1 << codeSize && codeSize < 12)
+                ++codeSize;
+        }
+        previous = current;
+    }
+}
+
+void AnimationReader::open(const std::string& path) try {
+    release();
+
+    // Check if file exists
+    if (!std::filesystem::exists(path))
+        throw std::runtime_error("input file does not exist");
+
+    std::ifstream file(path, std::ios::binary);
+    char signature[6] = {};
+    file.read(signature, sizeof(signature));
+    gif = file && std::string(signature, 4) == "GIF8";
+
+    if (!gif) {
+        // Every frame becomes a whole canvas at the rate of the stream
+        capture.open(path);
+        frameSize = capture.getFrameSize();
+        frameRate = capture.getFrameRate();
+        frameDelay = 1;
+        opened = true;
+        return;
+    }
+
+    file.seekg(0);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    scanGif();
+    opened = true;
+}
+catch (...) {
+    release();
+    throw;
+}
+
+// Reads the logical screen and walks the blocks once for the frame delays and the loop count, so
+// that a frame rate can be picked every delay is a whole number of frames at
+void AnimationReader::scanGif() {
+    auto need = [&](size_t size) {
+        if (position + size > data.size())
+            throw std::runtime_error("gif image is truncated");
+    };
+    auto skipSubBlocks = [&] {
+        while (true) {
+            need(1);
+            const auto size = data[position++];
+            if (size == 0)
+                return;
+            need(size);
+            position += size;
+        }
+    };
+
+    position = 6;
+    need(7);
+    frameSize = cv::Size2i(readWord(&data[position]), readWord(&data[position + 2]));
+    const auto flags = data[position + 4];
+    const auto backgroundIndex = data[position + 5];
+    position += 7;
+    if (frameSize.width <= 0 || frameSize.height <= 0)
+        throw std::runtime_error("gif image is empty");
+
+    globalPalette.clear();
+    if (flags & 0x80) {
+        const auto colorCount = 2 << (flags & 0x07);
+        need(colorCount * 3);
+        for (int i = 0; i < colorCount; ++i, position += 3)
+            globalPalette.emplace_back(data[position + 2], data[position + 1], data[position]);
+    }
+    background = backgroundIndex < globalPalette.size() ? globalPalette[backgroundIndex] : cv::Vec3b(0, 0, 0);
+    const auto firstBlock = position;
+
+    // Without a loop extension the animation plays once
+    loopCount = 1;
+    std::vector<int> delays;
+    auto delay = getGifDelay(0);
+    auto scanning = true;
+    while (scanning) {
+        need(1);
+        switch (data[position++]) {
+            case 0x21: {
+                need(1);
+                const auto label = data[position++];
+                if (label == 0xF9 && position + 5 < data.size() && data[position] >= 4)
+                    delay = getGifDelay(readWord(&data[position + 2]));
+                if (label == 0xFF && position + 15 < data.size() && data[position] == 11
+                        && std::string(reinterpret_cast<const char*>(&data[position + 1]), 11) == "NETSCAPE2.0"
+                        && data[position + 12] >= 3 && data[position + 13] == 1) {
+                    const auto repeats = readWord(&data[position + 14]);
+                    loopCount = repeats == 0 ? 0 : repeats + 1;
+                }
+                skipSubBlocks();
+                break;
+            }
+            case 0x2C: {
+                need(9);
+                const auto imageFlags = data[position + 8];
+                position += 9;
+                if (imageFlags & 0x80)
+                    position += 3 * (2 << (imageFlags & 0x07));
+                need(1);
+                ++position;
+                skipSubBlocks();
+                delays.push_back(delay);
+                delay = getGifDelay(0);
+                break;
+            }
+            case 0x3B:
+                scanning = false;
+                break;
+            default:
+                throw std::runtime_error("gif image has an invalid block");
+        }
+    }
+    if (delays.empty())
+        throw std::runtime_error("gif image has no frames");
+
+    // Delays are in hundredths of a second
+    delayUnit = std::accumulate(delays.begin(), delays.end(), delays.front(),
+        [](int a, int b) { return std::gcd(a, b); });
+    frameRate = 100.0 / delayUnit;
+
+    position = firstBlock;
+    canvas.create(frameSize, CV_8UC3);
+    canvas.setTo(cv::Scalar(background[0], background[1], background[2]));
+    disposedRect = cv::Rect2i();
+    disposal = 0;
+}
+
+bool AnimationReader::isOpened() const noexcept {
+    return opened;
+}
+
+bool AnimationReader::read(cv::Mat& frame, cv::Rect2i& dirtyRect) {
+    if (!opened)
+        throw std::runtime_error("animation reader is not opened");
+
+    if (gif)
+        return readGif(frame, dirtyRect);
+
+    if (!capture.read(frame))
+        return false;
+
+    // The bounds of the pixels that differ from the previous canvas
+    if (previousFrame.empty()) {
+        dirtyRect = cv::Rect2i(0, 0, frame.cols, frame.rows);
+    } else {
+        auto x0 = frame.cols, y0 = frame.rows, x1 = -1, y1 = -1;
+        for (int y = 0; y < frame.rows; ++y) {
+            const auto* row = frame.ptr<uint8_t>(y);
+            const auto* previousRow = previousFrame.ptr<uint8_t>(y);
+            for (int x = 0; x < frame.cols; ++x) {
+                if (row[x * 3] != previousRow[x * 3] || row[x * 3 + 1] != previousRow[x * 3 + 1]
+                        || row[x * 3 + 2] != previousRow[x * 3 + 2]) {
+                    x0 = std::min(x0, x);
+                    x1 = std::max(x1, x);
+                    y0 = std::min(y0, y);
+                    y1 = y;
+                }
+            }
+        }
+        dirtyRect = x1 < 0 ? cv::Rect2i() : cv::Rect2i(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    }
+    frame.copyTo(previousFrame);
+    ++frameIndex;
+    return true;
+}
+
+bool AnimationReader::read(cv::Mat& frame, utils::ChangeMap& changes) {
+    cv::Rect2i dirtyRect;
+    if (!read(frame, dirtyRect))
+        return false;
+
+    const auto blockSize = changes.blockSize;
+    const auto mapSize = cv::Size2i(
+        (frameSize.width + blockSize - 1) / blockSize,
+        (frameSize.height + blockSize - 1) / blockSize
+    );
+    changes.motion.create(mapSize, CV_32SC2);
+    changes.motion.setTo(cv::Scalar(0, 0));
+    changes.changed.create(mapSize, CV_8U);
+    changes.changed.setTo(cv::Scalar(0));
+    if (!dirtyRect.empty()) {
+        const auto x0 = dirtyRect.x / blockSize;
+        const auto y0 = dirtyRect.y / blockSize;
+        const auto x1 = (dirtyRect.x + dirtyRect.width + blockSize - 1) / blockSize;
+        const auto y1 = (dirtyRect.y + dirtyRect.height + blockSize - 1) / blockSize;
+        changes.changed(cv::Rect2i(x0, y0, x1 - x0, y1 - y0)).setTo(cv::Scalar(1));
+    }
+    return true;
+}
+
+// Disposes of the previous frame, then draws the next one over the canvas. The dirty rectangle
+// covers both, clipped to the canvas.
+bool AnimationReader::readGif(cv::Mat& frame, cv::Rect2i& dirtyRect) {
+    auto need = [&](size_t size) {
+        if (position + size > data.size())
+            throw std::runtime_error("gif image is truncated");
+    };
+
+    const auto canvasRect = cv::Rect2i(0, 0, canvas.cols, canvas.rows);
+    auto transparentIndex = -1;
+    auto nextDisposal = 0;
+    auto delay = getGifDelay(0);
+    while (true) {
+        need(1);
+        const auto block = data[position++];
+        if (block == 0x3B) {
+            --position;
+            return false;
+        }
+
+        if (block == 0x21) {
+            need(1);
+            const auto label = data[position++];
+            if (label == 0xF9 && position + 5 < data.size() && data[position] >= 4) {
+                const auto flags = data[position + 1];
+                nextDisposal = flags >> 2 & 0x07;
+                delay = getGifDelay(readWord(&data[position + 2]));
+                transparentIndex = flags & 0x01 ? data[position + 4] : -1;
+            }
+            while (true) {
+                need(1);
+                const auto size = data[position++];
+                if (size == 0)
+                    break;
+                need(size);
+                position += size;
+            }
+            continue;
+        }
+
+        // Image descriptor, scanGif already rejected other blocks
+        need(9);
+        const auto rect = cv::Rect2i(readWord(&data[position]), readWord(&data[position + 2]),
+            readWord(&data[position + 4]), readWord(&data[position + 6]));
+        const auto imageFlags = data[position + 8];
+        position += 9;
+
+        auto palette = globalPalette;
+        if (imageFlags & 0x80) {
+            const auto colorCount = 2 << (imageFlags & 0x07);
+            need(colorCount * 3);
+            palette.clear();
+            for (int i = 0; i < colorCount; ++i, position += 3)
+                palette.emplace_back(data[position + 2], data[position + 1], data[position]);
+        }
+
+        need(1);
+        const auto minCodeSize = std::clamp<int>(data[position++], 2, 11);
+        std::vector<uint8_t> codes;
+        while (true) {
+            need(1);
+            const auto size = data[position++];
+            if (size == 0)
+                break;
+            need(size);
+            codes.insert(codes.end(), data.begin() + static_cast<long>(position), data.begin() + static_cast<long>(position + size));
+            position += size;
+        }
+        std::vector<uint8_t> indices(static_cast<size_t>(rect.area()));
+        decodeLzw(codes, minCodeSize, indices);
+
+        // Dispose of the previous frame
+        if (disposal == 2)
+            canvas(disposedRect).setTo(cv::Scalar(background[0], background[1], background[2]));
+        else if (disposal == 3)
+            savedCanvas.copyTo(canvas(disposedRect));
+        dirtyRect = frameIndex < 0 ? canvasRect
+            : (disposal == 2 || disposal == 3 ? disposedRect | (rect & canvasRect) : rect & canvasRect);
+
+        disposal = nextDisposal;
+        disposedRect = rect & canvasRect;
+        if (disposal == 3)
+            canvas(disposedRect).copyTo(savedCanvas);
+
+        // Interlaced frames store every 8th row from 0, every 8th from 4, every 4th from 2, then the rest
+        std::vector<int> rows;
+        rows.reserve(rect.height);
+        if (imageFlags & 0x40) {
+            for (const auto& [start, step] : {std::pair(0, 8), std::pair(4, 8), std::pair(2, 4), std::pair(1, 2)}) {
+                for (int y = start; y < rect.height; y += step)
+                    rows.push_back(y);
+            }
+        } else {
+            for (int y = 0; y < rect.height; ++y)
+                rows.push_back(y);
+        }
+
+        for (int i = 0; i < rect.height; ++i) {
+            const auto y = rect.y + rows[i];
+            if (y < 0 || y >= canvas.rows)
+                continue;
+            auto* canvasRow = canvas.ptr<cv::Vec3b>(y);
+            const auto* indexRow = &indices[static_cast<size_t>(i) * rect.width];
+            for (int x = 0; x < rect.width; ++x) {
+                const auto index = indexRow[x];
+                if (index == transparentIndex || index >= palette.size() || rect.x + x >= canvas.cols)
+                    continue;
+                canvasRow[rect.x + x] = palette[index];
+            }
+        }
+
+        canvas.copyTo(frame);
+        frameDelay = delay / delayUnit;
+        ++frameIndex;
+        return true;
+    }
+}
+
+void AnimationReader::release() {
+    capture.release();
+    opened = false;
+    gif = false;
+
+    data.clear();
+    position = 0;
+    globalPalette.clear();
+    canvas.release();
+    savedCanvas.release();
+    previousFrame.release();
+    disposedRect = cv::Rect2i();
+    disposal = 0;
+    delayUnit = 1;
+
+    frameSize = cv::Size2i(-1, -1);
+    frameRate = -1;
+    frameDelay = 1;
+    loopCount = 0;
+    frameIndex = -1;
+}
+
+bool AnimationReader::isAnimated(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::array<uint8_t, 21> header {};
+    file.read(reinterpret_cast<char*>(header.data()), header.size());
+    if (!file)
+        return false;
+
+    if (std::memcmp(header.data(), "GIF8", 4) == 0)
+        return true;
+
+    // An animated PNG has an animation control chunk before the image data
+    if (std::memcmp(header.data(), "\x89PNG\r\n\x1a\n", 8) == 0) {
+        file.seekg(8);
+        std::array<uint8_t, 8> chunk {};
+        while (file.read(reinterpret_cast<char*>(chunk.data()), chunk.size())) {
+            const auto type = std::string(reinterpret_cast<const char*>(&chunk[4]), 4);
+            if (type == "acTL")
+                return true;
+            if (type == "IDAT" || type == "IEND")
+                return false;
+            file.seekg(readBigEndian(chunk.data()) + 4, std::ios::cur);
+        }
+        return false;
+    }
+
+    // An animated WebP has the animation flag set in its extended header
+    return std::memcmp(header.data(), "RIFF", 4) == 0 && std::memcmp(header.data() + 8, "WEBPVP8X", 8) == 0
+        && header[20] & 0x02;
+}
+
+// region Getters
+const cv::Size2i& AnimationReader::getFrameSize() const noexcept {
+    return frameSize;
+}
+
+double AnimationReader::getFrameRate() const noexcept {
+    return frameRate;
+}
+
+int AnimationReader::getFrameDelay() const noexcept {
+    return frameDelay;
+}
+
+int AnimationReader::getLoopCount() const noexcept {
+    return loopCount;
+}
+
+int AnimationReader::getFrameIndex() const noexcept {
+    return frameIndex;
+}
+// endregion
\ No newline at end of file
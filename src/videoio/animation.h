@@ -0,0 +1,70 @@
+#ifndef WAIFU2X_TENSORRT_VIDEOIO_ANIMATION_H
+#define WAIFU2X_TENSORRT_VIDEOIO_ANIMATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core/mat.hpp>
+#include "capture.h"
+#include "utilities/motion.h"
+
+// Reads animated GIF, APNG and WebP images frame by frame as the composited canvas, along with
+// the rectangle of the canvas each frame updated. GIFs are decoded in-process, so the rectangle is
+// the one the file stores the frame as, plus the area the previous frame was disposed of. APNG
+// and WebP are decoded through ffmpeg, which hands out whole canvases, so the rectangle bounds
+// the pixels that differ from the previous canvas. Transparency is flattened like for images.
+class AnimationReader {
+public:
+    AnimationReader();
+    virtual ~AnimationReader();
+    void open(const std::string& path);
+    [[nodiscard]] bool isOpened() const noexcept;
+    bool read(cv::Mat& frame, cv::Rect2i& dirtyRect);
+
+    // Marks the blocks under the dirty rectangle as changed and every block as not moved
+    bool read(cv::Mat& frame, utils::ChangeMap& changes);
+    void release();
+
+    // Whether the file is a GIF, or a PNG or WebP with more than one frame
+    static bool isAnimated(const std::string& path);
+
+    // region Getters
+    [[nodiscard]] const cv::Size2i& getFrameSize() const noexcept;
+    // Rate every frame delay is a whole number of frames at
+    [[nodiscard]] double getFrameRate() const noexcept;
+    // Frames at the frame rate the last frame read is shown for
+    [[nodiscard]] int getFrameDelay() const noexcept;
+    // Times the animation is played, 0 plays it forever
+    [[nodiscard]] int getLoopCount() const noexcept;
+    [[nodiscard]] int getFrameIndex() const noexcept;
+    // endregion
+private:
+    void scanGif();
+    bool readGif(cv::Mat& frame, cv::Rect2i& dirtyRect);
+
+    bool opened = false;
+    bool gif = false;
+
+    // GIF
+    std::vector<uint8_t> data;
+    size_t position = 0;
+    std::vector<cv::Vec3b> globalPalette;
+    cv::Vec3b background;
+    cv::Mat canvas;
+    cv::Mat savedCanvas;
+    cv::Rect2i disposedRect;
+    int disposal = 0;
+    int delayUnit = 1;
+
+    // APNG and WebP
+    VideoCapture capture;
+    cv::Mat previousFrame;
+
+    cv::Size2i frameSize = cv::Size2i(-1, -1);
+    double frameRate = -1;
+    int frameDelay = 1;
+    int loopCount = 0;
+    int frameIndex = -1;
+};
+
+#endif //WAIFU2X_TENSORRT_VIDEOIO_ANIMATION_H
\ No newline at end of file
@@ -5,6 +5,15 @@
 #include <map>
 #include <utility>
 
+#ifdef WAIFU2X_WITH_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/motion_vector.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
 #if defined(_WIN32) || defined(_WIN64)
 #define popen _popen
 #define pclose _pclose
@@ -61,6 +70,42 @@ void VideoCapture::open(const std::string& path) try {
     if (!std::filesystem::exists(path))
         throw std::runtime_error("input file does not exist");
 
+#ifdef WAIFU2X_WITH_LIBAV
+    // Decode in-process, so that the motion vectors of the decoder are not thrown away
+    if (avformat_open_input(&formatContext, path.c_str(), nullptr, nullptr) < 0)
+        throw std::runtime_error("could not open input file");
+    if (avformat_find_stream_info(formatContext, nullptr) < 0)
+        throw std::runtime_error("could not find stream info");
+
+    const AVCodec* codec = nullptr;
+    streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (streamIndex < 0 || !codec)
+        throw std::runtime_error("input file has no decodable video stream");
+    const auto* stream = formatContext->streams[streamIndex];
+
+    codecContext = avcodec_alloc_context3(codec);
+    if (!codecContext || avcodec_parameters_to_context(codecContext, stream->codecpar) < 0)
+        throw std::runtime_error("could not create decoder");
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "flags2", "+export_mvs", 0);
+    const auto result = avcodec_open2(codecContext, codec, &options);
+    av_dict_free(&options);
+    if (result < 0)
+        throw std::runtime_error("could not open decoder");
+
+    packet = av_packet_alloc();
+    decodedFrame = av_frame_alloc();
+    if (!packet || !decodedFrame)
+        throw std::runtime_error("could not allocate frame");
+
+    frameSize.width = codecContext->width;
+    frameSize.height = codecContext->height;
+    frameRate = av_q2d(stream->r_frame_rate);
+    frameCount = stream->nb_frames > 0 ? static_cast<int>(stream->nb_frames) : 1;
+    opened = true;
+    return;
+#endif
+
     // Get file info
     const auto ffprobeCmd = ffmpegDir +
         "ffprobe -v error -select_streams v:0 -show_entries "
@@ -90,7 +135,7 @@ void VideoCapture::open(const std::string& path) try {
     frameSize.width = std::stoi(propMap.at("width"));
     frameSize.height = std::stoi(propMap.at("height"));
     frameRate = fractionStringToDouble(propMap.at("r_frame_rate"));
-    frameCount = propMap.at("nb_frames") == "n/a" ? 1 : std::stoi(propMap.at("nb_frames"));
+    frameCount = propMap.at("nb_frames") == "n/a" ? -1 : std::stoi(propMap.at("nb_frames"));
 
     // Open ffmpeg
     const auto ffmpegCmd = ffmpegDir +
@@ -117,22 +162,162 @@ bool VideoCapture::read(cv::Mat& frame) {
     if (!opened)
         throw std::runtime_error("video capture is not opened");
 
-    if (frameIndex + 1 >= frameCount)
+#ifdef WAIFU2X_WITH_LIBAV
+    // Frame counts of containers are estimates, so the stream is read until the decoder runs out
+    if (!decode())
+        return false;
+
+    swsContext = sws_getCachedContext(swsContext, decodedFrame->width, decodedFrame->height,
+        static_cast<AVPixelFormat>(decodedFrame->format), frameSize.width, frameSize.height,
+        AV_PIX_FMT_BGR24, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!swsContext)
+        throw std::runtime_error("could not convert frame to bgr24");
+
+    frame.create(frameSize, CV_8UC3);
+    uint8_t* data[1] = { frame.data };
+    const int lineSize[1] = { static_cast<int>(frame.step) };
+    sws_scale(swsContext, decodedFrame->data, decodedFrame->linesize, 0, decodedFrame->height, data, lineSize);
+    ++frameIndex;
+    return true;
+#endif
+
+    if (frameCount >= 0 && frameIndex + 1 >= frameCount)
         return false;
 
+    // Without a frame count in the container, such as for animated images, the pipe runs out instead
     frame.create(frameSize, CV_8UC3);
-    if (fread(frame.data, 1, frame.total() * frame.elemSize(), pipe) <= 0)
+    const auto bytesRead = fread(frame.data, 1, frame.total() * frame.elemSize(), pipe);
+    if (bytesRead == 0 && frameCount < 0)
+        return false;
+    if (bytesRead <= 0)
         throw std::runtime_error("could not read frame from pipe");
     ++frameIndex;
     return true;
 }
 
+bool VideoCapture::read(cv::Mat& frame, utils::ChangeMap& changes) {
+    if (!read(frame))
+        return false;
+
+#ifdef WAIFU2X_WITH_LIBAV
+    exportChanges(changes);
+#else
+    changes.motion.release();
+    changes.changed.release();
+#endif
+    return true;
+}
+
+#ifdef WAIFU2X_WITH_LIBAV
+bool VideoCapture::decode() {
+    while (true) {
+        const auto received = avcodec_receive_frame(codecContext, decodedFrame);
+        if (received == 0)
+            return true;
+        if (received == AVERROR_EOF)
+            return false;
+        if (received != AVERROR(EAGAIN))
+            throw std::runtime_error("could not decode frame");
+
+        // The decoder needs more input, an empty packet drains it at the end of the file
+        if (flushing)
+            return false;
+        if (av_read_frame(formatContext, packet) < 0) {
+            flushing = true;
+            if (avcodec_send_packet(codecContext, nullptr) < 0)
+                throw std::runtime_error("could not flush decoder");
+            continue;
+        }
+
+        const auto sent = packet->stream_index == streamIndex ? avcodec_send_packet(codecContext, packet) : 0;
+        av_packet_unref(packet);
+        if (sent < 0)
+            throw std::runtime_error("could not send packet to decoder");
+    }
+}
+
+// Blocks start out changed, a block copied from the past by a whole-pixel shift gets that shift.
+// Blocks predicted from the future or from several shifts, and intra blocks, which have no
+// vector, stay changed. Vectors do not tell which past frame they point into, so the map is only
+// exported for streams that predict from the previous frame alone, i.e. without B-frames and with
+// a single reference frame; otherwise it is left empty.
+void VideoCapture::exportChanges(utils::ChangeMap& changes) const {
+    if (codecContext->has_b_frames > 0 || codecContext->refs > 1) {
+        changes.motion.release();
+        changes.changed.release();
+        return;
+    }
+
+    const auto blockSize = changes.blockSize;
+    const auto mapSize = cv::Size2i(
+        (frameSize.width + blockSize - 1) / blockSize,
+        (frameSize.height + blockSize - 1) / blockSize
+    );
+    changes.motion.create(mapSize, CV_32SC2);
+    changes.changed.create(mapSize, CV_8U);
+    changes.changed.setTo(cv::Scalar(1));
+    cv::Mat predicted(mapSize, CV_8U, cv::Scalar(0));
+    cv::Mat conflicting(mapSize, CV_8U, cv::Scalar(0));
+
+    const auto* sideData = av_frame_get_side_data(decodedFrame, AV_FRAME_DATA_MOTION_VECTORS);
+    if (!sideData)
+        return;
+
+    const auto* vectors = reinterpret_cast<const AVMotionVector*>(sideData->data);
+    const auto vectorCount = sideData->size / sizeof(AVMotionVector);
+    for (size_t i = 0; i < vectorCount; ++i) {
+        const auto& vector = vectors[i];
+        const auto mapRect = cv::Rect2i(0, 0, mapSize.width, mapSize.height);
+        const auto x0 = (vector.dst_x - vector.w / 2) / blockSize;
+        const auto y0 = (vector.dst_y - vector.h / 2) / blockSize;
+        const auto x1 = (vector.dst_x + (vector.w + 1) / 2 + blockSize - 1) / blockSize;
+        const auto y1 = (vector.dst_y + (vector.h + 1) / 2 + blockSize - 1) / blockSize;
+        const auto blocks = cv::Rect2i(x0, y0, x1 - x0, y1 - y0) & mapRect;
+
+        // Destination minus source, so that the block is the previous frame shifted by it
+        const auto copied = vector.source < 0 && vector.motion_scale > 0
+            && vector.motion_x % vector.motion_scale == 0 && vector.motion_y % vector.motion_scale == 0;
+        const auto shiftX = copied ? -vector.motion_x / vector.motion_scale : 0;
+        const auto shiftY = copied ? -vector.motion_y / vector.motion_scale : 0;
+        for (int y = blocks.y; y < blocks.y + blocks.height; ++y) {
+            auto* motionRow = changes.motion.ptr<int>(y);
+            for (int x = blocks.x; x < blocks.x + blocks.width; ++x) {
+                if (!copied || (predicted.at<uint8_t>(y, x)
+                        && (motionRow[x * 2] != shiftX || motionRow[x * 2 + 1] != shiftY))) {
+                    conflicting.at<uint8_t>(y, x) = 1;
+                    continue;
+                }
+                predicted.at<uint8_t>(y, x) = 1;
+                motionRow[x * 2] = shiftX;
+                motionRow[x * 2 + 1] = shiftY;
+            }
+        }
+    }
+
+    for (int y = 0; y < mapSize.height; ++y) {
+        for (int x = 0; x < mapSize.width; ++x)
+            changes.changed.at<uint8_t>(y, x) = !predicted.at<uint8_t>(y, x) || conflicting.at<uint8_t>(y, x);
+    }
+}
+#endif
+
 void VideoCapture::release() {
     if (pipe)
         pclose(pipe);
     pipe = nullptr;
     opened = false;
 
+#ifdef WAIFU2X_WITH_LIBAV
+    sws_freeContext(swsContext);
+    swsContext = nullptr;
+    av_frame_free(&decodedFrame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+    streamIndex = -1;
+    flushing = false;
+#endif
+
     frameSize = cv::Size2i(-1, -1);
     frameRate = -1;
     frameCount = -1;
@@ -2,6 +2,15 @@
 #define WAIFU2X_TENSORRT_VIDEOIO_CAPTURE_H
 
 #include <opencv2/core/mat.hpp>
+#include "utilities/motion.h"
+
+#ifdef WAIFU2X_WITH_LIBAV
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+#endif
 
 class VideoCapture {
 public:
@@ -10,6 +19,10 @@ public:
     void open(const std::string& path);
     [[nodiscard]] bool isOpened() const noexcept;
     bool read(cv::Mat& frame);
+
+    // Also exports the motion of the blocks against the previous frame, which needs the video to
+    // be decoded in-process; without libav the map is left empty
+    bool read(cv::Mat& frame, utils::ChangeMap& changes);
     void release();
 
     // region Getters
@@ -23,6 +36,19 @@ private:
     FILE* pipe = nullptr;
     bool opened = false;
 
+#ifdef WAIFU2X_WITH_LIBAV
+    bool decode();
+    void exportChanges(utils::ChangeMap& changes) const;
+
+    AVFormatContext* formatContext = nullptr;
+    AVCodecContext* codecContext = nullptr;
+    SwsContext* swsContext = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* decodedFrame = nullptr;
+    int streamIndex = -1;
+    bool flushing = false;
+#endif
+
     std::string ffmpegDir;
     cv::Size2i frameSize = cv::Size2i(-1, -1);
     double frameRate = -1;
@@ -0,0 +1,145 @@
+#include "renditions.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+RenditionWriter::RenditionWriter() = default;
+
+RenditionWriter::~RenditionWriter() noexcept {
+    release();
+}
+
+VideoWriter& RenditionWriter::addRendition() {
+    if (opened)
+        throw std::runtime_error("renditions cannot be added when writer is open");
+    auto& rendition = renditions.emplace_back();
+    rendition.writer = std::make_unique<VideoWriter>();
+    return *rendition.writer;
+}
+
+void RenditionWriter::open() {
+    release();
+
+    if (renditions.empty())
+        throw std::invalid_argument("no renditions to write");
+
+    for (auto& rendition : renditions)
+        rendition.writer->open();
+
+    frameCount = 0;
+    closing = false;
+    error = nullptr;
+    opened = true;
+    for (size_t i = 0; i < renditions.size(); ++i) {
+        renditions[i].framesWritten = 0;
+        renditions[i].thread = std::thread(&RenditionWriter::work, this, i);
+    }
+}
+
+bool RenditionWriter::isOpened() const noexcept {
+    return opened;
+}
+
+void RenditionWriter::write(const cv::Mat& frame) {
+    if (!opened)
+        throw std::runtime_error("rendition writer is not opened");
+
+    if (frame.type() != CV_8UC3)
+        throw std::invalid_argument("frame type must be CV_8UC3");
+
+    // Wait until every rendition is done with the frame that used this buffer before
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&] {
+        return error || std::all_of(renditions.begin(), renditions.end(),
+            [&](const Rendition& rendition) { return rendition.framesWritten + 1 >= frameCount; });
+    });
+    if (error)
+        std::rethrow_exception(error);
+
+    frame.copyTo(frames[frameCount % frames.size()]);
+    ++frameCount;
+    lock.unlock();
+    condition.notify_all();
+}
+
+void RenditionWriter::close() {
+    if (opened) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        condition.notify_all();
+        for (auto& rendition : renditions)
+            rendition.thread.join();
+    }
+    opened = false;
+
+    // Every writer is closed, even after another one failed. A rendition that failed on one of the
+    // last frames, after the final write, is only reported here.
+    std::exception_ptr closeError;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeError = error;
+        error = nullptr;
+    }
+    for (auto& rendition : renditions) {
+        try {
+            rendition.writer->close();
+        }
+        catch (...) {
+            if (!closeError)
+                closeError = std::current_exception();
+        }
+    }
+    if (closeError)
+        std::rethrow_exception(closeError);
+}
+
+void RenditionWriter::release() noexcept {
+    try {
+        close();
+    }
+    catch (const std::exception&) {
+        // Reported by close only
+    }
+}
+
+int RenditionWriter::size() const noexcept {
+    return static_cast<int>(renditions.size());
+}
+
+// Writes the frames in order, the last ones after closing has been requested as well
+void RenditionWriter::work(size_t index) {
+    auto& rendition = renditions[index];
+    const auto& frameSize = rendition.writer->getFrameSize();
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return error || closing || rendition.framesWritten < frameCount; });
+        if (error || rendition.framesWritten >= frameCount)
+            return;
+        const auto& frame = frames[rendition.framesWritten % frames.size()];
+        lock.unlock();
+
+        try {
+            if (frame.size() == frameSize) {
+                rendition.writer->write(frame);
+            } else {
+                cv::resize(frame, rendition.frame, frameSize, 0, 0, cv::INTER_AREA);
+                rendition.writer->write(rendition.frame);
+            }
+        }
+        catch (...) {
+            lock.lock();
+            if (!error)
+                error = std::current_exception();
+            lock.unlock();
+            condition.notify_all();
+            return;
+        }
+
+        lock.lock();
+        ++rendition.framesWritten;
+        lock.unlock();
+        condition.notify_all();
+    }
+}
\ No newline at end of file
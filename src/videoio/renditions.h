@@ -0,0 +1,58 @@
+#ifndef WAIFU2X_TENSORRT_VIDEOIO_RENDITIONS_H
+#define WAIFU2X_TENSORRT_VIDEOIO_RENDITIONS_H
+
+#include "writer.h"
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Writes one rendered video at several resolutions. Every rendition is downscaled from the
+// rendered frame and encoded by its own writer on its own thread, so the encoders run in parallel
+// with each other and with the render of the next frame, and the full-size output is never
+// decoded again to produce the smaller ones.
+class RenditionWriter {
+public:
+    RenditionWriter();
+    virtual ~RenditionWriter() noexcept;
+
+    // Writer of a rendition to set up before opening, its frame size is the size frames are
+    // downscaled to
+    VideoWriter& addRendition();
+    void open();
+    [[nodiscard]] bool isOpened() const noexcept;
+    void write(const cv::Mat& frame);
+    // Finishes every rendition, throws the first failure of a rendition or of its writer
+    void close();
+    // Closes without reporting failures
+    void release() noexcept;
+
+    [[nodiscard]] int size() const noexcept;
+
+private:
+    void work(size_t index);
+
+    struct Rendition {
+        std::unique_ptr<VideoWriter> writer;
+        std::thread thread;
+        cv::Mat frame;
+        long long framesWritten = 0;
+    };
+
+    std::vector<Rendition> renditions;
+    bool opened = false;
+
+    // Frames alternate between two buffers, so the next one can be copied in while the
+    // renditions still work on the previous one
+    std::array<cv::Mat, 2> frames;
+    long long frameCount = 0;
+    bool closing = false;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::exception_ptr error;
+};
+
+#endif //WAIFU2X_TENSORRT_VIDEOIO_RENDITIONS_H
\ No newline at end of file
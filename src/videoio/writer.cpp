@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <stdexcept>
 #include "writer.h"
 
@@ -6,6 +11,16 @@
 #define pclose _pclose
 #endif
 
+// x264 and x265 presets from the fastest to the slowest
+constexpr std::array<const char*, 9> presets = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow"
+};
+
+int getPresetIndex(const std::string& preset) {
+    const auto it = std::find(presets.begin(), presets.end(), preset);
+    return it == presets.end() ? -1 : static_cast<int>(it - presets.begin());
+}
+
 VideoWriter::VideoWriter() = default;
 
 VideoWriter::~VideoWriter() noexcept {
@@ -21,21 +36,52 @@ void VideoWriter::open() {
     if (outputFile.empty())
         throw std::invalid_argument("output file is empty");
 
-    std::string ffmpegCmd = "ffmpeg -v error -y -f rawvideo -vcodec rawvideo"
+    if (segmentFrames > 0) {
+        segmentPresets.clear();
+        segmentPresetIndex = getPresetIndex(preset);
+        framesInSegment = 0;
+        blockedSeconds = 0.0;
+        blockedFraction = 0.0;
+        balanceStart = std::chrono::steady_clock::now();
+        opened = true;
+        openSegment();
+        return;
+    }
+
+    const auto ffmpegCmd = getCommand(outputFile, preset);
+    pipe = popen(ffmpegCmd.c_str(), "wb");
+    if (!pipe)
+        throw std::runtime_error("could not open ffmpeg pipe");
+    opened = true;
+}
+
+std::string VideoWriter::getCommand(const std::string& file, const std::string& segmentPreset) const {
+    // Animated image muxers count plays differently, GIF counts the repeats after the first play
+    std::string loop;
+    if (loopCount >= 0) {
+        const auto muxer = format.empty() ? std::filesystem::path(file).extension().string() : "." + format;
+        if (muxer == ".gif")
+            loop = " -loop " + std::to_string(loopCount == 0 ? 0 : loopCount == 1 ? -1 : loopCount - 1);
+        else if (muxer == ".apng")
+            loop = " -plays " + std::to_string(loopCount);
+        else
+            loop = " -loop " + std::to_string(loopCount);
+    }
+
+    return "ffmpeg -v error -y -f rawvideo -vcodec rawvideo"
         " -s " + std::to_string(frameSize.width) + "x" + std::to_string(frameSize.height) +
         " -pix_fmt bgr24" +
         (frameRate <= 0 ? "" : " -r " + std::to_string(frameRate)) +
         " -i -" +
+        (filter.empty() ? "" : " -filter_complex \"" + filter + "\"") +
         (codec.empty() ? "" : " -vcodec " + codec) +
         (pixelFormat.empty() ? "" : " -pix_fmt " + pixelFormat) +
+        (segmentPreset.empty() ? "" : " -preset " + segmentPreset) +
         (crf < 0 ? "" : " -crf " + std::to_string(crf)) +
         (quality < 0 ? "" : " -q:v " + std::to_string(quality)) +
-        " \"" + outputFile + "\"";
-
-    pipe = popen(ffmpegCmd.c_str(), "wb");
-    if (!pipe)
-        throw std::runtime_error("could not open ffmpeg pipe");
-    opened = true;
+        loop +
+        (format.empty() ? "" : " -f " + format) +
+        " \"" + file + "\"";
 }
 
 bool VideoWriter::isOpened() const noexcept {
@@ -52,15 +98,177 @@ void VideoWriter::write(const cv::Mat& frame) {
     if (frame.type() != CV_8UC3)
         throw std::invalid_argument("frame type must be CV_8UC3");
 
+    if (segmentFrames > 0) {
+        if (framesInSegment == segmentFrames) {
+            balance();
+            closeSegment();
+            openSegment();
+        }
+
+        // A segment queues a few frames only, full frames of a long segment would take gigabytes. The time
+        // the renderer waits on a full queue counts as blocked, so that the presets speed up.
+        auto& segment = *segments.back();
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto t0 = std::chrono::steady_clock::now();
+        condition.wait(lock, [&] { return segment.failed || segment.queue.size() < segmentQueueFrames; });
+        blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (segment.failed)
+            throw std::runtime_error("could not write frame to pipe");
+        segment.queue.push_back(frame.clone());
+        lock.unlock();
+        condition.notify_all();
+        ++framesInSegment;
+        return;
+    }
+
     if (fwrite(frame.data, 1, frame.total() * frame.elemSize(), pipe) <= 0)
         throw std::runtime_error("could not write frame to pipe");
 }
 
-void VideoWriter::release() noexcept {
-    if (pipe)
-        pclose(pipe);
-    pipe = nullptr;
+void VideoWriter::close() {
     opened = false;
+    if (pipe) {
+        const auto status = pclose(pipe);
+        pipe = nullptr;
+        if (status != 0)
+            throw std::runtime_error("could not encode \"" + outputFile + "\", ffmpeg failed");
+    }
+
+    if (!segments.empty()) {
+        closeSegment();
+        for (auto& segment : segments) {
+            if (segment->thread.joinable())
+                segment->thread.join();
+        }
+        const auto finishedSegments = std::move(segments);
+        segments.clear();
+        concatenate(finishedSegments);
+    }
+}
+
+void VideoWriter::release() noexcept {
+    try {
+        close();
+    }
+    catch (const std::exception&) {
+        // Reported by close only
+    }
+}
+
+// Starts the encoder of the next segment once fewer than the maximum are still encoding, the
+// time spent waiting for one counts as the renderer being blocked by the encoders
+void VideoWriter::openSegment() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto t0 = std::chrono::steady_clock::now();
+        condition.wait(lock, [&] {
+            return std::count_if(segments.begin(), segments.end(),
+                [](const auto& segment) { return !segment->finished; }) < maxEncoders;
+        });
+        blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    const auto path = std::filesystem::path(outputFile);
+    const auto segmentPreset = segmentPresetIndex >= 0 ? std::string(presets[segmentPresetIndex]) : preset;
+    auto segment = std::make_unique<Segment>();
+    segment->file = (path.parent_path() / (path.stem().string() + ".part"
+        + std::to_string(segments.size()) + ".ts")).string();
+    const auto ffmpegCmd = getCommand(segment->file, segmentPreset);
+    segment->pipe = popen(ffmpegCmd.c_str(), "wb");
+    if (!segment->pipe)
+        throw std::runtime_error("could not open ffmpeg pipe");
+    segment->thread = std::thread(&VideoWriter::encode, this, std::ref(*segment));
+    segments.push_back(std::move(segment));
+    segmentPresets.push_back(segmentPreset);
+    framesInSegment = 0;
+}
+
+void VideoWriter::closeSegment() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        segments.back()->closed = true;
+    }
+    condition.notify_all();
+}
+
+// Writes the queued frames until the segment is closed and drained, a failed pipe keeps draining
+// the queue so that the renderer does not wait on it
+void VideoWriter::encode(Segment& segment) {
+    while (true) {
+        cv::Mat frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&] { return segment.closed || !segment.queue.empty(); });
+            if (segment.queue.empty())
+                break;
+            frame = std::move(segment.queue.front());
+            segment.queue.pop_front();
+        }
+        condition.notify_all();
+
+        if (!segment.failed && fwrite(frame.data, 1, frame.total() * frame.elemSize(), segment.pipe) <= 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            segment.failed = true;
+        }
+    }
+
+    const auto status = pclose(segment.pipe);
+    segment.pipe = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        segment.failed = segment.failed || status != 0;
+        segment.finished = true;
+    }
+    condition.notify_all();
+}
+
+// Moves the preset of the next segment one step faster while the encoders hold up the renderer,
+// and back towards the requested preset once they keep up
+void VideoWriter::balance() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration<double>(now - balanceStart).count();
+    // Smoothed over segments, encoders finishing in turns block every other boundary
+    blockedFraction = 0.5 * blockedFraction + 0.5 * (elapsed > 0.0 ? blockedSeconds / elapsed : 0.0);
+    blockedSeconds = 0.0;
+    balanceStart = now;
+
+    const auto slowest = getPresetIndex(preset);
+    const auto fastest = fastestPreset.empty() ? slowest : getPresetIndex(fastestPreset);
+    if (slowest < 0 || fastest < 0)
+        return;
+
+    if (blockedFraction > 0.1)
+        segmentPresetIndex = std::max(fastest, segmentPresetIndex - 1);
+    else if (blockedFraction < 0.02)
+        segmentPresetIndex = std::min(slowest, segmentPresetIndex + 1);
+}
+
+// Joins the segments into the output file without encoding them again, MPEG-TS segments carry
+// their parameter sets in-band, so segments encoded with different presets can follow each other.
+// The segments are only removed once the output is complete.
+void VideoWriter::concatenate(const std::vector<std::unique_ptr<Segment>>& finishedSegments) {
+    for (const auto& segment : finishedSegments) {
+        if (segment->failed)
+            throw std::runtime_error("could not encode segment \"" + segment->file + "\"");
+    }
+
+    const auto listFile = outputFile + ".segments.txt";
+    std::ofstream list(listFile);
+    for (const auto& segment : finishedSegments)
+        list << "file '" << std::filesystem::path(segment->file).filename().string() << "'\n";
+    list.close();
+    if (!list)
+        throw std::runtime_error("could not write segment list \"" + listFile + "\"");
+
+    const auto ffmpegCmd = "ffmpeg -v error -y -f concat -safe 0 -i \"" + listFile + "\" -c copy \"" + outputFile + "\"";
+    const auto status = std::system(ffmpegCmd.c_str());
+    std::error_code error;
+    std::filesystem::remove(listFile, error);
+    if (status != 0)
+        throw std::runtime_error("could not join segments into \"" + outputFile + "\", ffmpeg failed");
+
+    for (const auto& segment : finishedSegments)
+        std::filesystem::remove(segment->file, error);
 }
 
 #undef popen
@@ -99,6 +307,38 @@ int VideoWriter::getQuality() const noexcept {
     return quality;
 }
 
+const std::string& VideoWriter::getPreset() const noexcept {
+    return preset;
+}
+
+const std::string& VideoWriter::getFastestPreset() const noexcept {
+    return fastestPreset;
+}
+
+int VideoWriter::getSegmentFrames() const noexcept {
+    return segmentFrames;
+}
+
+int VideoWriter::getMaxEncoders() const noexcept {
+    return maxEncoders;
+}
+
+const std::vector<std::string>& VideoWriter::getSegmentPresets() const noexcept {
+    return segmentPresets;
+}
+
+const std::string& VideoWriter::getFormat() const noexcept {
+    return format;
+}
+
+const std::string& VideoWriter::getFilter() const noexcept {
+    return filter;
+}
+
+int VideoWriter::getLoopCount() const noexcept {
+    return loopCount;
+}
+
 constexpr auto errorWriterOpened = "properties cannot be set when writer is open";
 
 VideoWriter& VideoWriter::setFfmpegDir(const std::string& value) {
@@ -164,4 +404,59 @@ VideoWriter& VideoWriter::setQuality(int value) {
     quality = value;
     return *this;
 }
+
+VideoWriter& VideoWriter::setPreset(const std::string& value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    preset = value;
+    return *this;
+}
+
+VideoWriter& VideoWriter::setFastestPreset(const std::string& value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    if (!value.empty() && getPresetIndex(value) < 0)
+        throw std::invalid_argument("fastest preset must be an x264 preset");
+    fastestPreset = value;
+    return *this;
+}
+
+VideoWriter& VideoWriter::setSegmentFrames(int value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    if (value < 0)
+        throw std::invalid_argument("segment frames must not be negative");
+    segmentFrames = value;
+    return *this;
+}
+
+VideoWriter& VideoWriter::setMaxEncoders(int value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    if (value <= 0)
+        throw std::invalid_argument("max encoders must be greater than 0");
+    maxEncoders = value;
+    return *this;
+}
+
+VideoWriter& VideoWriter::setFormat(const std::string& value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    format = value;
+    return *this;
+}
+
+VideoWriter& VideoWriter::setFilter(const std::string& value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    filter = value;
+    return *this;
+}
+
+VideoWriter& VideoWriter::setLoopCount(int value) {
+    if (opened)
+        throw std::runtime_error(errorWriterOpened);
+    loopCount = value;
+    return *this;
+}
 // endregion
\ No newline at end of file
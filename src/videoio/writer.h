@@ -1,7 +1,14 @@
 #ifndef WAIFU2X_TENSORRT_VIDEOIO_WRITER_H
 #define WAIFU2X_TENSORRT_VIDEOIO_WRITER_H
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <opencv2/core/mat.hpp>
 
 class VideoWriter {
@@ -11,6 +18,10 @@ public:
     void open();
     [[nodiscard]] bool isOpened() const noexcept;
     void write(const cv::Mat& frame);
+    // Finishes the video, throws when an encoder or joining the segments failed. The segments of a
+    // video that could not be joined are kept next to the output.
+    void close();
+    // Closes without reporting failures
     void release() noexcept;
 
     // region Getters and setters
@@ -22,6 +33,14 @@ public:
     [[nodiscard]] const std::string& getCodec() const noexcept;
     [[nodiscard]] int getConstantRateFactor() const noexcept;
     [[nodiscard]] int getQuality() const noexcept;
+    [[nodiscard]] const std::string& getPreset() const noexcept;
+    [[nodiscard]] const std::string& getFastestPreset() const noexcept;
+    [[nodiscard]] int getSegmentFrames() const noexcept;
+    [[nodiscard]] int getMaxEncoders() const noexcept;
+    [[nodiscard]] const std::vector<std::string>& getSegmentPresets() const noexcept;
+    [[nodiscard]] const std::string& getFormat() const noexcept;
+    [[nodiscard]] const std::string& getFilter() const noexcept;
+    [[nodiscard]] int getLoopCount() const noexcept;
 
     VideoWriter& setFfmpegDir(const std::string& value);
     VideoWriter& setFrameSize(const cv::Size2i& value);
@@ -31,12 +50,49 @@ public:
     VideoWriter& setCodec(const std::string& value);
     VideoWriter& setConstantRateFactor(int value);
     VideoWriter& setQuality(int value);
+    VideoWriter& setPreset(const std::string& value);
+    VideoWriter& setFastestPreset(const std::string& value);
+    VideoWriter& setSegmentFrames(int value);
+    VideoWriter& setMaxEncoders(int value);
+    VideoWriter& setFormat(const std::string& value);
+    VideoWriter& setFilter(const std::string& value);
+    VideoWriter& setLoopCount(int value);
     // endregion
 
 private:
+    // Segment of the video encoded by its own ffmpeg process, fed from a queue by its own thread
+    static constexpr size_t segmentQueueFrames = 4;
+    struct Segment {
+        std::string file;
+        FILE* pipe = nullptr;
+        std::thread thread;
+        std::deque<cv::Mat> queue;
+        bool closed = false;
+        bool finished = false;
+        bool failed = false;
+    };
+
+    [[nodiscard]] std::string getCommand(const std::string& file, const std::string& segmentPreset) const;
+    void openSegment();
+    void closeSegment();
+    void encode(Segment& segment);
+    void balance();
+    void concatenate(const std::vector<std::unique_ptr<Segment>>& finishedSegments);
+
     FILE* pipe = nullptr;
     bool opened = false;
 
+    // Segmented encoding
+    std::vector<std::unique_ptr<Segment>> segments;
+    std::vector<std::string> segmentPresets;
+    std::mutex mutex;
+    std::condition_variable condition;
+    int segmentPresetIndex = -1;
+    int framesInSegment = 0;
+    double blockedSeconds = 0.0;
+    double blockedFraction = 0.0;
+    std::chrono::steady_clock::time_point balanceStart;
+
     std::string ffmpegDir;
     cv::Size2i frameSize = cv::Size2i(-1, -1);
     double frameRate = -1;
@@ -45,6 +101,13 @@ private:
     std::string codec;
     int crf = -1;
     int quality = -1;
+    std::string preset;
+    std::string fastestPreset;
+    int segmentFrames = 0;
+    int maxEncoders = 2;
+    std::string format;
+    std::string filter;
+    int loopCount = -1;
     // tune, preset, hardware accel...
 };
 
@@ -0,0 +1,175 @@
+#include "utilities/atlas.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* message) {
+        if (!condition) {
+            std::printf("FAILED: %s\n", message);
+            ++failures;
+        }
+    }
+
+    // Renders a tile like unpadded convolutions do: every output pixel is the mean of the input
+    // pixels within a radius, upscaled by nearest neighbour, and the margin is cropped away. With
+    // pooling, the mean of the whole tile is added on top, as squeeze and excitation blocks do.
+    class MockBackend : public utils::TileBackend {
+    public:
+        MockBackend(int batchSize, cv::Size2i inputTileSize, int scaling, int margin, int radius, bool pooling)
+            : batchSize(batchSize), inputTileSize(inputTileSize), scaling(scaling), margin(margin), radius(radius),
+              pooling(pooling) {}
+
+        [[nodiscard]] int getBatchSize() const override {
+            return batchSize;
+        }
+
+        [[nodiscard]] cv::Size2i getInputTileSize() const override {
+            return inputTileSize;
+        }
+
+        [[nodiscard]] cv::Size2i getOutputTileSize() const override {
+            return cv::Size2i((inputTileSize.width - 2 * margin) * scaling, (inputTileSize.height - 2 * margin) * scaling);
+        }
+
+        bool inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) override {
+            const auto outputTileSize = getOutputTileSize();
+            const auto window = static_cast<float>((2 * radius + 1) * (2 * radius + 1));
+            outputs.resize(inputs.size());
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                float tileMean = 0.0f;
+                if (pooling) {
+                    for (int y = 0; y < inputs[i].rows; ++y) {
+                        for (int x = 0; x < inputs[i].cols; ++x)
+                            tileMean += inputs[i].at<cv::Vec3b>(y, x)[0];
+                    }
+                    tileMean /= static_cast<float>(inputs[i].rows * inputs[i].cols) * 255.0f * 4.0f;
+                }
+
+                outputs[i] = cv::Mat(outputTileSize, CV_32FC3);
+                for (int y = 0; y < outputTileSize.height; ++y) {
+                    for (int x = 0; x < outputTileSize.width; ++x) {
+                        const auto centerX = x / scaling + margin;
+                        const auto centerY = y / scaling + margin;
+                        cv::Vec3f sum(0.0f, 0.0f, 0.0f);
+                        for (int dy = -radius; dy <= radius; ++dy) {
+                            for (int dx = -radius; dx <= radius; ++dx) {
+                                const auto& pixel = inputs[i].at<cv::Vec3b>(centerY + dy, centerX + dx);
+                                for (int c = 0; c < 3; ++c)
+                                    sum[c] += pixel[c];
+                            }
+                        }
+                        auto& output = outputs[i].at<cv::Vec3f>(y, x);
+                        for (int c = 0; c < 3; ++c)
+                            output[c] = sum[c] / window / 255.0f * 0.75f + tileMean;
+                    }
+                }
+            }
+            return true;
+        }
+
+    private:
+        int batchSize;
+        cv::Size2i inputTileSize;
+        int scaling;
+        int margin;
+        int radius;
+        bool pooling;
+    };
+
+    cv::Mat createImage(int width, int height, int seed) {
+        cv::Mat image(height, width, CV_8UC3);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                image.at<cv::Vec3b>(y, x) = cv::Vec3b((x * 7 + y * 3 + seed * 40) % 256, (x * y + seed * 13) % 256,
+                    (x + y * 11 + seed * 90) % 256);
+            }
+        }
+        return image;
+    }
+
+    int getMaxDifference(const cv::Mat& a, const cv::Mat& b) {
+        if (a.size() != b.size())
+            return 256;
+        int difference = 0;
+        for (int y = 0; y < a.rows; ++y) {
+            for (int x = 0; x < a.cols; ++x) {
+                for (int c = 0; c < 3; ++c)
+                    difference = std::max(difference, std::abs(a.at<cv::Vec3b>(y, x)[c] - b.at<cv::Vec3b>(y, x)[c]));
+            }
+        }
+        return difference;
+    }
+
+    std::vector<cv::Mat> createImages() {
+        const std::vector<cv::Size2i> sizes = {
+            {12, 9}, {5, 14}, {20, 20}, {7, 7}, {16, 3}, {9, 11}, {30, 8}, {4, 4}, {60, 50}
+        };
+        std::vector<cv::Mat> images;
+        for (size_t i = 0; i < sizes.size(); ++i)
+            images.push_back(createImage(sizes[i].width, sizes[i].height, static_cast<int>(i)));
+        return images;
+    }
+
+    // Every packed image matches the same image rendered on its own through the tile plan, and
+    // images that do not fit into a tile with their margin are left to be rendered on their own
+    void testMatchesRenderedAlone() {
+        constexpr int scaling = 2;
+        constexpr int margin = 3;
+        const cv::Size2i tileSize(48, 48);
+        MockBackend backend(2, tileSize, scaling, margin, margin, false);
+        const auto images = createImages();
+
+        std::vector<cv::Mat> outputs;
+        const auto unpacked = utils::renderAtlas(backend, images, outputs, scaling);
+        check(unpacked == std::vector<int>{8}, "only the image larger than a tile is left unpacked");
+        check(outputs[8].empty(), "the unpacked image has no output");
+
+        utils::TileDispatcher alone;
+        alone.addBackend(&backend);
+        for (size_t i = 0; i < images.size(); ++i) {
+            if (std::find(unpacked.begin(), unpacked.end(), static_cast<int>(i)) != unpacked.end())
+                continue;
+            cv::Mat expected;
+            alone.render(images[i], expected, scaling, cv::Point2d(0, 0));
+            check(getMaxDifference(outputs[i], expected) == 0, "atlas output matches the image rendered on its own");
+        }
+    }
+
+    // A model that pools over the whole tile sees the neighbours, which is why --atlas is limited
+    // to models of plain convolutions
+    void testPoolingBleeds() {
+        constexpr int scaling = 2;
+        constexpr int margin = 3;
+        const cv::Size2i tileSize(48, 48);
+        MockBackend backend(2, tileSize, scaling, margin, margin, true);
+        const auto images = createImages();
+
+        std::vector<cv::Mat> outputs;
+        const auto unpacked = utils::renderAtlas(backend, images, outputs, scaling);
+
+        utils::TileDispatcher alone;
+        alone.addBackend(&backend);
+        int difference = 0;
+        for (size_t i = 0; i < images.size(); ++i) {
+            if (std::find(unpacked.begin(), unpacked.end(), static_cast<int>(i)) != unpacked.end())
+                continue;
+            cv::Mat expected;
+            alone.render(images[i], expected, scaling, cv::Point2d(0, 0));
+            difference = std::max(difference, getMaxDifference(outputs[i], expected));
+        }
+        check(difference > 0, "pooling over the atlas tile differs from the image rendered on its own");
+    }
+}
+
+int main() {
+    testMatchesRenderedAlone();
+    testPoolingBleeds();
+    if (failures > 0)
+        return 1;
+    std::printf("All atlas tests passed\n");
+    return 0;
+}
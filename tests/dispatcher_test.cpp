@@ -0,0 +1,159 @@
+#include "utilities/dispatcher.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* message) {
+        if (!condition) {
+            std::printf("FAILED: %s\n", message);
+            ++failures;
+        }
+    }
+
+    // Renders a tile as a constant, or as the tile upscaled by nearest neighbour when the constant
+    // is negative, after sleeping for its latency
+    class MockBackend : public utils::TileBackend {
+    public:
+        MockBackend(int batchSize, cv::Size2i inputTileSize, int scaling, float value, int latencyMilliseconds)
+            : batchSize(batchSize), inputTileSize(inputTileSize), scaling(scaling), value(value),
+              latency(latencyMilliseconds) {}
+
+        [[nodiscard]] int getBatchSize() const override {
+            return batchSize;
+        }
+
+        [[nodiscard]] cv::Size2i getInputTileSize() const override {
+            return inputTileSize;
+        }
+
+        [[nodiscard]] cv::Size2i getOutputTileSize() const override {
+            return cv::Size2i(inputTileSize.width * scaling, inputTileSize.height * scaling);
+        }
+
+        bool inferTiles(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs) override {
+            std::this_thread::sleep_for(latency);
+            outputs.resize(inputs.size());
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                if (value >= 0.0f) {
+                    outputs[i] = cv::Mat(getOutputTileSize(), CV_32FC3, cv::Scalar(value, value, value));
+                } else {
+                    cv::Mat upscaled;
+                    cv::resize(inputs[i], upscaled, getOutputTileSize(), 0, 0, cv::INTER_NEAREST);
+                    upscaled.convertTo(outputs[i], CV_32FC3, 1.0 / 255.0);
+                }
+            }
+            return true;
+        }
+
+    private:
+        int batchSize;
+        cv::Size2i inputTileSize;
+        int scaling;
+        float value;
+        std::chrono::milliseconds latency;
+    };
+
+    cv::Mat createImage(int width, int height) {
+        cv::Mat image(height, width, CV_8UC3);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x)
+                image.at<cv::Vec3b>(y, x) = cv::Vec3b((x * 7 + y * 3) % 256, (x * y) % 256, (x + y * 11) % 256);
+        }
+        return image;
+    }
+
+    float getMaxDifference(const cv::Mat& a, const cv::Mat& b) {
+        float difference = 0.0f;
+        for (int y = 0; y < a.rows; ++y) {
+            for (int x = 0; x < a.cols; ++x) {
+                for (int c = 0; c < 3; ++c)
+                    difference = std::max(difference, std::abs(a.at<cv::Vec3f>(y, x)[c] - b.at<cv::Vec3f>(y, x)[c]));
+            }
+        }
+        return difference;
+    }
+
+    // Without overlap every output pixel is covered by one tile, so it holds the constant of exactly
+    // one backend when its tile was rendered once, and 0 or a sum of constants otherwise. The later
+    // frames run with measured throughput, so backends decline near the end of a frame.
+    void testEveryTileOnce() {
+        constexpr int scaling = 2;
+        const cv::Size2i tileSize(16, 16);
+        const std::vector<float> values = {1.0f, 10.0f, 100.0f};
+        const std::vector<int> latencies = {1, 5, 20};
+        std::vector<std::unique_ptr<MockBackend>> backends;
+        utils::TileDispatcher dispatcher;
+        for (size_t i = 0; i < values.size(); ++i) {
+            backends.push_back(std::make_unique<MockBackend>(static_cast<int>(i) + 1, tileSize, scaling, values[i], latencies[i]));
+            dispatcher.addBackend(backends.back().get());
+        }
+
+        const auto image = createImage(100, 70);
+        const auto tileCount = std::get<0>(utils::calculateTiles(cv::Rect2i(0, 0, image.cols, image.rows),
+            cv::Rect2i(0, 0, image.cols * scaling, image.rows * scaling), tileSize, backends[0]->getOutputTileSize(), scaling, cv::Point2d(0, 0)));
+        for (int frame = 0; frame < 5; ++frame) {
+            cv::Mat dst;
+            dispatcher.render(image, dst, scaling, cv::Point2d(0, 0));
+
+            int rendered = 0;
+            for (const auto count : dispatcher.getTileCounts())
+                rendered += count;
+            check(rendered == tileCount, "every tile is claimed once");
+
+            const auto& output = dispatcher.getOutput();
+            bool once = output.rows == image.rows * scaling && output.cols == image.cols * scaling;
+            for (int y = 0; y < output.rows && once; ++y) {
+                for (int x = 0; x < output.cols && once; ++x) {
+                    const auto pixel = output.at<cv::Vec3f>(y, x)[0];
+                    once = std::find(values.begin(), values.end(), pixel) != values.end();
+                }
+            }
+            check(once, "every output pixel is rendered by exactly one backend");
+        }
+    }
+
+    // Tiles rendered by any backend are the same, so the blended frame matches a single backend's
+    void testMatchesSingleBackend() {
+        constexpr int scaling = 2;
+        const cv::Size2i tileSize(16, 16);
+        const cv::Point2d overlap(0.125, 0.125);
+        const auto image = createImage(90, 60);
+
+        MockBackend single(2, tileSize, scaling, -1.0f, 0);
+        utils::TileDispatcher reference;
+        reference.addBackend(&single);
+        cv::Mat expected;
+        reference.render(image, expected, scaling, overlap);
+        const auto expectedOutput = reference.getOutput().clone();
+
+        MockBackend fast(4, tileSize, scaling, -1.0f, 1);
+        MockBackend slow(1, tileSize, scaling, -1.0f, 10);
+        MockBackend medium(2, tileSize, scaling, -1.0f, 3);
+        utils::TileDispatcher dispatcher;
+        dispatcher.addBackend(&fast);
+        dispatcher.addBackend(&slow);
+        dispatcher.addBackend(&medium);
+        for (int frame = 0; frame < 3; ++frame) {
+            cv::Mat dst;
+            dispatcher.render(image, dst, scaling, overlap);
+            check(getMaxDifference(dispatcher.getOutput(), expectedOutput) < 1e-5f, "merged output matches the single backend output");
+        }
+    }
+}
+
+int main() {
+    testEveryTileOnce();
+    testMatchesSingleBackend();
+    if (failures > 0)
+        return 1;
+    std::printf("All dispatcher tests passed\n");
+    return 0;
+}